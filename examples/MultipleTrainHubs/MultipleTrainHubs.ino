@@ -1,13 +1,15 @@
 /**
  * A Legoino example for connecting multiple hubs at the same time
- * Two train hubs and to train remotes are connected
- * 
+ * Two train hubs and to train remotes are connected. All hubs are found
+ * in one shared scan of the hub manager
+ *
  * (c) Copyright 2020 - Cornelius Munz
  * Released under MIT License
- * 
+ *
  */
 
 #include "Lpf2Hub.h"
+#include "Lpf2HubManager.h"
 
 // create a hub instance
 Lpf2Hub myTrainHub1;
@@ -15,70 +17,48 @@ Lpf2Hub myTrainHub2;
 Lpf2Hub myRemote1;
 Lpf2Hub myRemote2;
 
-void setup()
-{
-  Serial.begin(115200);
-  myTrainHub1.init(); // initalize the PoweredUpHub instance
-}
+// one scan for all hubs
+Lpf2HubManager myHubManager;
 
-// main loop
-void loop()
+void connect(Lpf2Hub *hub, const char *name)
 {
-  // connect flow. Search for BLE services and try to connect if the uuid of the hub is found
-  if (myTrainHub1.isConnecting())
+  // connect flow. Try to connect if the hub was found by the scan
+  if (hub->isConnecting())
   {
-    myTrainHub1.connectHub();
-    if (myTrainHub1.isConnected())
+    hub->connectHub();
+    if (hub->isConnected())
     {
-      Serial.println("Connected to HUB1");
-      myTrainHub2.init();
+      Serial.print("Connected to ");
+      Serial.println(name);
     }
     else
     {
       Serial.println("Failed to connect to HUB");
     }
   }
+}
 
-  if (myTrainHub2.isConnecting())
-  {
-    myTrainHub2.connectHub();
-    if (myTrainHub2.isConnected())
-    {
-      Serial.println("Connected to HUB2");
-      myRemote1.init();
-    }
-    else
-    {
-      Serial.println("Failed to connect to HUB");
-    }
-  }
+void setup()
+{
+  Serial.begin(115200);
+  // the hubs could be assigned by type, address (e.g. "90:84:2b:00:00:01") or advertising name
+  myHubManager.addHub(&myTrainHub1, HubType::POWERED_UP_HUB);
+  myHubManager.addHub(&myTrainHub2, HubType::POWERED_UP_HUB);
+  myHubManager.addHub(&myRemote1, HubType::POWERED_UP_REMOTE);
+  myHubManager.addHub(&myRemote2, HubType::POWERED_UP_REMOTE);
+  myHubManager.start();
+}
 
-  if (myRemote1.isConnecting())
-  {
-    myRemote1.connectHub();
-    if (myRemote1.isConnected())
-    {
-      Serial.println("Connected to Remote1");
-      myRemote2.init();
-    }
-    else
-    {
-      Serial.println("Failed to connect to HUB");
-    }
-  }
+// main loop
+void loop()
+{
+  connect(&myTrainHub1, "HUB1");
+  connect(&myTrainHub2, "HUB2");
+  connect(&myRemote1, "Remote1");
+  connect(&myRemote2, "Remote2");
 
-  if (myRemote2.isConnecting())
-  {
-    myRemote2.connectHub();
-    if (myRemote2.isConnected())
-    {
-      Serial.println("Connected to Remote2");
-    }
-    else
-    {
-      Serial.println("Failed to connect to HUB");
-    }
-  }
+  // continue the scan if it was interrupted by a connect and hubs are still missing
+  myHubManager.poll();
 
   delay(100);
 
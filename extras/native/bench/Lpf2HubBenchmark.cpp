@@ -0,0 +1,165 @@
+/*
+ * Lpf2HubBenchmark.cpp - Host benchmark of the Lpf2Hub notification parsing and command encoding paths
+ *
+ * A hub is "connected" through the NimBLE stand-in, devices are attached by injecting
+ * HUB_ATTACHED_IO notifications and afterwards the hot paths are measured in a loop.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#include "Lpf2Hub.h"
+
+#include <chrono>
+
+static const uint32_t ITERATIONS = 1000000;
+
+// prevent the compiler from optimizing away the measured calls
+static volatile int sink;
+
+template <typename Function>
+static void benchmark(const char *name, Function function)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++)
+  {
+    function(i);
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  double nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  printf("%-40s %10.1f ns/call\n", name, nanoseconds / ITERATIONS);
+}
+
+static void attachDevice(NimBLERemoteCharacteristic *pCharacteristic, byte port, DeviceType deviceType)
+{
+  uint8_t attachMessage[15] = {0x0F, 0x00, (byte)MessageType::HUB_ATTACHED_IO, port, (byte)Event::ATTACHED_IO, (byte)deviceType, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10};
+  pCharacteristic->notify(attachMessage, sizeof(attachMessage));
+}
+
+int main()
+{
+  Lpf2Hub hub;
+  hub.init();
+
+  NimBLEAdvertisedDevice advertisedDevice;
+  advertisedDevice.setAddress(NimBLEAddress("90:84:2b:00:00:01"));
+  advertisedDevice.setName("Technic Hub");
+  advertisedDevice.setServiceUUID(NimBLEUUID(LPF2_UUID));
+  advertisedDevice.setManufacturerData(std::string("\x97\x03\x00\x80\x06\x00", 6));
+  NimBLEDevice::getScan()->advertise(advertisedDevice);
+
+  if (!hub.isConnecting() || !hub.connectHub())
+  {
+    printf("failed to connect to the emulated hub\n");
+    return 1;
+  }
+
+  NimBLERemoteCharacteristic *pCharacteristic = hub._pRemoteCharacteristic;
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::A, DeviceType::TECHNIC_LARGE_LINEAR_MOTOR);
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::B, DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR);
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::C, DeviceType::COLOR_DISTANCE_SENSOR);
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::D, DeviceType::MEDIUM_LINEAR_MOTOR);
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::LED, DeviceType::HUB_LED);
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::CURRENT, DeviceType::CURRENT_SENSOR);
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::VOLTAGE, DeviceType::VOLTAGE_SENSOR);
+  attachDevice(pCharacteristic, (byte)ControlPlusHubPort::TILT, DeviceType::TECHNIC_MEDIUM_HUB_TILT_SENSOR);
+
+  printf("notification parsing\n");
+
+  uint8_t tachoMessage[8] = {0x08, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, (byte)ControlPlusHubPort::D, 0x10, 0x01, 0x00, 0x00};
+  benchmark("PORT_VALUE_SINGLE tacho motor", [&](uint32_t i) {
+    tachoMessage[4] = (uint8_t)i;
+    pCharacteristic->notify(tachoMessage, sizeof(tachoMessage));
+  });
+
+  uint8_t voltageMessage[6] = {0x06, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, (byte)ControlPlusHubPort::VOLTAGE, 0x00, 0x0F};
+  benchmark("PORT_VALUE_SINGLE voltage sensor", [&](uint32_t i) {
+    voltageMessage[4] = (uint8_t)i;
+    pCharacteristic->notify(voltageMessage, sizeof(voltageMessage));
+  });
+
+  uint8_t colorDistanceMessage[8] = {0x08, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, (byte)ControlPlusHubPort::C, 0x09, 0x03, 0x00, 0x02};
+  benchmark("PORT_VALUE_SINGLE color distance sensor", [&](uint32_t i) {
+    colorDistanceMessage[5] = (uint8_t)(i & 0x0F);
+    pCharacteristic->notify(colorDistanceMessage, sizeof(colorDistanceMessage));
+  });
+
+  uint8_t tiltMessage[10] = {0x0A, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, (byte)ControlPlusHubPort::TILT, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00};
+  benchmark("PORT_VALUE_SINGLE hub tilt sensor", [&](uint32_t i) {
+    tiltMessage[4] = (uint8_t)i;
+    pCharacteristic->notify(tiltMessage, sizeof(tiltMessage));
+  });
+
+  uint8_t batteryMessage[6] = {0x06, 0x00, (byte)MessageType::HUB_PROPERTIES, (byte)HubPropertyReference::BATTERY_VOLTAGE, (byte)HubPropertyOperation::UPDATE_UPSTREAM, 0x5A};
+  benchmark("HUB_PROPERTIES battery level", [&](uint32_t i) {
+    batteryMessage[5] = (uint8_t)(i % 100);
+    pCharacteristic->notify(batteryMessage, sizeof(batteryMessage));
+  });
+
+  printf("sensor decoding (double vs. integer)\n");
+
+  benchmark("parseVoltageSensor", [&](uint32_t i) {
+    voltageMessage[4] = (uint8_t)i;
+    sink = (int)hub.parseVoltageSensor(voltageMessage);
+  });
+
+  benchmark("parseVoltageSensorMilliVolts", [&](uint32_t i) {
+    voltageMessage[4] = (uint8_t)i;
+    sink = hub.parseVoltageSensorMilliVolts(voltageMessage);
+  });
+
+  uint8_t currentMessage[6] = {0x06, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, (byte)ControlPlusHubPort::CURRENT, 0x00, 0x08};
+  benchmark("parseCurrentSensor", [&](uint32_t i) {
+    currentMessage[4] = (uint8_t)i;
+    sink = (int)hub.parseCurrentSensor(currentMessage);
+  });
+
+  benchmark("parseCurrentSensorMilliAmps", [&](uint32_t i) {
+    currentMessage[4] = (uint8_t)i;
+    sink = hub.parseCurrentSensorMilliAmps(currentMessage);
+  });
+
+  benchmark("parseDistance", [&](uint32_t i) {
+    colorDistanceMessage[5] = (uint8_t)(i & 0x0F);
+    colorDistanceMessage[7] = (uint8_t)(i >> 4 & 0x07);
+    sink = (int)hub.parseDistance(colorDistanceMessage);
+  });
+
+  benchmark("parseDistanceMillimeters", [&](uint32_t i) {
+    colorDistanceMessage[5] = (uint8_t)(i & 0x0F);
+    colorDistanceMessage[7] = (uint8_t)(i >> 4 & 0x07);
+    sink = hub.parseDistanceMillimeters(colorDistanceMessage);
+  });
+
+  printf("command encoding\n");
+
+  benchmark("setBasicMotorSpeed", [&](uint32_t i) {
+    hub.setBasicMotorSpeed((byte)ControlPlusHubPort::A, (int)(i % 201) - 100);
+  });
+
+  benchmark("setTachoMotorSpeedForDegrees", [&](uint32_t i) {
+    hub.setTachoMotorSpeedForDegrees((byte)ControlPlusHubPort::B, 50, (int32_t)i);
+  });
+
+  benchmark("setAbsoluteMotorPosition", [&](uint32_t i) {
+    hub.setAbsoluteMotorPosition((byte)ControlPlusHubPort::D, 50, (int32_t)i);
+  });
+
+  benchmark("setLedRGBColor", [&](uint32_t i) {
+    hub.setLedRGBColor((char)i, (char)(i >> 8), (char)(i >> 16));
+  });
+
+  uint8_t rgb[3];
+  benchmark("LegoinoCommon::HsvToRgb", [&](uint32_t i) {
+    LegoinoCommon::HsvToRgb((int)(i % 360), (uint8_t)(i >> 8), 255, rgb);
+    sink = rgb[0] + rgb[1] + rgb[2];
+  });
+
+  benchmark("setLedHSVColor", [&](uint32_t i) {
+    hub.setLedHSVColor((int)(i % 360), 1.0, 1.0);
+  });
+
+  sink = (int)pCharacteristic->getWriteCount();
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Arduino.h - Minimal host stand-in for the Arduino core which is used to build
+ * the hub parsing and encoding paths of Legoino natively on Linux/macOS.
+ *
+ * Only the subset used by the Lpf2Hub sources is provided. This header is not
+ * part of the Arduino library and is never seen by the Arduino IDE.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <mutex>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::max;
+using std::min;
+
+// The Arduino core uses mixed argument types (e.g. min(pData[0] - 5, 14)), std::min does not
+template <class T, class L>
+auto min(const T &a, const L &b) -> decltype((b < a) ? b : a)
+{
+  return (b < a) ? b : a;
+}
+
+template <class T, class L>
+auto max(const T &a, const L &b) -> decltype((b < a) ? b : a)
+{
+  return (a < b) ? b : a;
+}
+
+// FreeRTOS task stand-ins (the ESP32 core includes freertos/FreeRTOS.h and freertos/task.h),
+// a task is run in a detached thread
+typedef void (*TaskFunction_t)(void *);
+typedef void *TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+#define pdPASS 1
+#define pdFAIL 0
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask);
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+
+// FreeRTOS critical section stand-ins (the spinlock of the ESP32 port is emulated with a recursive mutex)
+typedef std::recursive_mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->lock()
+#define portEXIT_CRITICAL(mux) (mux)->unlock()
+
+// log levels follow the ESP32 core (0..None - 5..Verbose), default is no output
+#ifndef CORE_DEBUG_LEVEL
+#define CORE_DEBUG_LEVEL 0
+#endif
+
+#define LEGOINO_NATIVE_LOG(level, format, ...) fprintf(stderr, "[" level "][%s] " format "\n", __func__, ##__VA_ARGS__)
+
+#if CORE_DEBUG_LEVEL >= 1
+#define log_e(format, ...) LEGOINO_NATIVE_LOG("E", format, ##__VA_ARGS__)
+#else
+#define log_e(format, ...)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 2
+#define log_w(format, ...) LEGOINO_NATIVE_LOG("W", format, ##__VA_ARGS__)
+#else
+#define log_w(format, ...)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 3
+#define log_i(format, ...) LEGOINO_NATIVE_LOG("I", format, ##__VA_ARGS__)
+#else
+#define log_i(format, ...)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 4
+#define log_d(format, ...) LEGOINO_NATIVE_LOG("D", format, ##__VA_ARGS__)
+#else
+#define log_d(format, ...)
+#endif
+
+#if CORE_DEBUG_LEVEL >= 5
+#define log_v(format, ...) LEGOINO_NATIVE_LOG("V", format, ##__VA_ARGS__)
+#else
+#define log_v(format, ...)
+#endif
+
+#endif // Arduino_h
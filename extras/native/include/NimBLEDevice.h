@@ -0,0 +1,249 @@
+/*
+ * NimBLEDevice.h - Minimal host stand-in for the NimBLE-Arduino client API which is used
+ * to build the hub parsing and encoding paths of Legoino natively on Linux/macOS.
+ *
+ * There is no radio behind these classes. Connects always succeed, the remote
+ * characteristic records the last written value and notifications can be injected
+ * with NimBLERemoteCharacteristic::notify() to drive Lpf2Hub::notifyCallback.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#ifndef NimBLEDevice_h
+#define NimBLEDevice_h
+
+#include "Arduino.h"
+
+#include <vector>
+
+#define NIMBLE_MAX_CONNECTIONS 9
+
+class NimBLEAdvertisedDevice;
+class NimBLEClient;
+class NimBLERemoteCharacteristic;
+class NimBLEScan;
+
+class NimBLEUUID
+{
+public:
+  NimBLEUUID();
+  NimBLEUUID(const std::string &uuid);
+  NimBLEUUID(const char *uuid);
+  bool equals(const NimBLEUUID &uuid) const;
+  std::string toString() const;
+
+private:
+  std::string m_uuid;
+};
+
+class NimBLEAddress
+{
+public:
+  NimBLEAddress();
+  NimBLEAddress(const std::string &address);
+  bool equals(const NimBLEAddress &address) const;
+  std::string toString() const;
+
+private:
+  std::string m_address;
+};
+
+// parameters of a connection update request (interval in unit 1.25 ms, timeout in unit 10 ms)
+struct ble_gap_upd_params
+{
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint16_t latency;
+  uint16_t supervision_timeout;
+  uint16_t min_ce_len;
+  uint16_t max_ce_len;
+};
+
+class NimBLEConnInfo
+{
+public:
+  NimBLEConnInfo(uint16_t interval, uint16_t latency, uint16_t timeout);
+  uint16_t getConnInterval();
+  uint16_t getConnLatency();
+  uint16_t getConnTimeout();
+
+private:
+  uint16_t m_interval;
+  uint16_t m_latency;
+  uint16_t m_timeout;
+};
+
+typedef std::function<void(NimBLERemoteCharacteristic *pBLERemoteCharacteristic, uint8_t *pData, size_t length, bool isNotify)> notify_callback;
+
+class NimBLERemoteCharacteristic
+{
+public:
+  NimBLERemoteCharacteristic(const NimBLEUUID &uuid);
+  NimBLEUUID getUUID();
+  bool canNotify();
+  bool subscribe(bool notifications = true, notify_callback notifyCallback = nullptr, bool response = false);
+  bool unsubscribe(bool response = false);
+  bool writeValue(const uint8_t *data, size_t length, bool response = false);
+
+  // host only: inject a notification as if it was received from the hub
+  void notify(uint8_t *pData, size_t length);
+  // host only: inspect what was written to the characteristic
+  const uint8_t *getLastWrittenValue();
+  size_t getLastWrittenLength();
+  uint32_t getWriteCount();
+
+private:
+  NimBLEUUID m_uuid;
+  notify_callback m_notifyCallback;
+  uint8_t m_lastWrittenValue[512];
+  size_t m_lastWrittenLength = 0;
+  uint32_t m_writeCount = 0;
+};
+
+class NimBLERemoteService
+{
+public:
+  NimBLERemoteService(const NimBLEUUID &uuid);
+  NimBLERemoteCharacteristic *getCharacteristic(const NimBLEUUID &uuid);
+
+private:
+  NimBLEUUID m_uuid;
+  NimBLERemoteCharacteristic m_characteristic;
+};
+
+class NimBLEClientCallbacks
+{
+public:
+  virtual ~NimBLEClientCallbacks() {}
+  virtual void onConnect(NimBLEClient *pClient) {}
+  virtual void onDisconnect(NimBLEClient *pClient) {}
+  virtual bool onConnParamsUpdateRequest(NimBLEClient *pClient, const ble_gap_upd_params *params) { return true; }
+};
+
+class NimBLEClient
+{
+public:
+  NimBLEClient();
+  ~NimBLEClient();
+  bool connect(const NimBLEAddress &address, bool deleteAttributes = true);
+  int disconnect();
+  bool isConnected();
+  NimBLEAddress getPeerAddress();
+  int getRssi();
+  NimBLERemoteService *getService(const NimBLEUUID &uuid);
+  void setClientCallbacks(NimBLEClientCallbacks *pClientCallbacks, bool deleteCallbacks = true);
+  void setConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout, uint16_t scanInterval = 16, uint16_t scanWindow = 16);
+  void updateConnParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout);
+  NimBLEConnInfo getConnInfo();
+
+  // host only: connection parameter update which is requested by the peripheral
+  bool requestConnParamsUpdate(const ble_gap_upd_params &params);
+
+private:
+  NimBLEAddress m_peerAddress;
+  // the peripheral accepts the max. interval of a request, without a request it uses 45 ms
+  uint16_t m_requestedInterval = 36;
+  uint16_t m_requestedLatency = 0;
+  uint16_t m_requestedTimeout = 500;
+  uint16_t m_interval = 0;
+  uint16_t m_latency = 0;
+  uint16_t m_timeout = 0;
+  bool m_isConnected = false;
+  NimBLERemoteService *m_pService = nullptr;
+  NimBLEClientCallbacks *m_pClientCallbacks = nullptr;
+  bool m_deleteCallbacks = false;
+};
+
+class NimBLEAdvertisedDevice
+{
+public:
+  NimBLEAdvertisedDevice();
+  NimBLEAddress getAddress();
+  std::string getName();
+  std::string getManufacturerData();
+  NimBLEUUID getServiceUUID();
+  NimBLEScan *getScan();
+  bool haveServiceUUID();
+  bool haveManufacturerData();
+  std::string toString();
+
+  // host only: describe the advertisement which is reported by NimBLEScan::advertise()
+  void setAddress(const NimBLEAddress &address);
+  void setName(const std::string &name);
+  void setManufacturerData(const std::string &manufacturerData);
+  void setServiceUUID(const NimBLEUUID &uuid);
+
+private:
+  friend class NimBLEScan;
+  NimBLEAddress m_address;
+  std::string m_name;
+  std::string m_manufacturerData;
+  NimBLEUUID m_serviceUuid;
+  bool m_haveServiceUuid = false;
+  NimBLEScan *m_pScan = nullptr;
+};
+
+class NimBLEScanResults
+{
+public:
+  int getCount();
+  NimBLEAdvertisedDevice getDevice(uint32_t i);
+
+private:
+  friend class NimBLEScan;
+  std::vector<NimBLEAdvertisedDevice> m_devices;
+};
+
+class NimBLEAdvertisedDeviceCallbacks
+{
+public:
+  virtual ~NimBLEAdvertisedDeviceCallbacks() {}
+  virtual void onResult(NimBLEAdvertisedDevice *advertisedDevice) = 0;
+};
+
+class NimBLEScan
+{
+public:
+  void setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks *pAdvertisedDeviceCallbacks, bool wantDuplicates = false);
+  void setActiveScan(bool active);
+  bool start(uint32_t duration, void (*scanCompleteCB)(NimBLEScanResults), bool is_continue = false);
+  bool stop();
+  bool isScanning();
+
+  // host only: report an advertisement to the registered callbacks while scanning
+  void advertise(NimBLEAdvertisedDevice &advertisedDevice);
+
+private:
+  NimBLEAdvertisedDeviceCallbacks *m_pAdvertisedDeviceCallbacks = nullptr;
+  void (*m_scanCompleteCB)(NimBLEScanResults) = nullptr;
+  NimBLEScanResults m_results;
+  bool m_isScanning = false;
+};
+
+class NimBLEDevice
+{
+public:
+  static void init(const std::string &deviceName);
+  static NimBLEScan *getScan();
+  static NimBLEClient *createClient();
+  static bool deleteClient(NimBLEClient *pClient);
+  static NimBLEClient *getClientByPeerAddress(const NimBLEAddress &peerAddress);
+  static NimBLEClient *getDisconnectedClient();
+  static size_t getClientListSize();
+};
+
+typedef NimBLEUUID BLEUUID;
+typedef NimBLEAddress BLEAddress;
+typedef NimBLERemoteCharacteristic BLERemoteCharacteristic;
+typedef NimBLERemoteService BLERemoteService;
+typedef NimBLEClientCallbacks BLEClientCallbacks;
+typedef NimBLEClient BLEClient;
+typedef NimBLEAdvertisedDevice BLEAdvertisedDevice;
+typedef NimBLEAdvertisedDeviceCallbacks BLEAdvertisedDeviceCallbacks;
+typedef NimBLEScanResults BLEScanResults;
+typedef NimBLEScan BLEScan;
+typedef NimBLEDevice BLEDevice;
+
+#endif // NimBLEDevice_h
@@ -0,0 +1,38 @@
+/*
+ * Preferences.h - Minimal host stand-in for the Preferences library of the ESP32 Arduino core
+ *
+ * The namespaces are kept in memory of the process (no NVS), so stored values survive
+ * an end()/begin() cycle but not a restart of the program.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#ifndef Preferences_h
+#define Preferences_h
+
+#include "Arduino.h"
+
+#include <string>
+
+class Preferences
+{
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+
+  bool clear();
+  bool remove(const char *key);
+
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+
+private:
+  std::string _namespace;
+  bool _started = false;
+  bool _readOnly = false;
+};
+
+#endif // Preferences_h
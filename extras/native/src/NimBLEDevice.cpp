@@ -0,0 +1,411 @@
+/*
+ * NimBLEDevice.cpp - Minimal host stand-in for the NimBLE-Arduino client API
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#include "NimBLEDevice.h"
+
+static NimBLEScan scan;
+static std::vector<NimBLEClient *> clients;
+
+NimBLEUUID::NimBLEUUID() {}
+
+NimBLEUUID::NimBLEUUID(const std::string &uuid) : m_uuid(uuid) {}
+
+NimBLEUUID::NimBLEUUID(const char *uuid) : m_uuid(uuid) {}
+
+bool NimBLEUUID::equals(const NimBLEUUID &uuid) const
+{
+  return m_uuid == uuid.m_uuid;
+}
+
+std::string NimBLEUUID::toString() const
+{
+  return m_uuid;
+}
+
+NimBLEAddress::NimBLEAddress() : m_address("00:00:00:00:00:00") {}
+
+NimBLEAddress::NimBLEAddress(const std::string &address) : m_address(address) {}
+
+bool NimBLEAddress::equals(const NimBLEAddress &address) const
+{
+  return m_address == address.m_address;
+}
+
+std::string NimBLEAddress::toString() const
+{
+  return m_address;
+}
+
+NimBLERemoteCharacteristic::NimBLERemoteCharacteristic(const NimBLEUUID &uuid) : m_uuid(uuid) {}
+
+NimBLEUUID NimBLERemoteCharacteristic::getUUID()
+{
+  return m_uuid;
+}
+
+bool NimBLERemoteCharacteristic::canNotify()
+{
+  return true;
+}
+
+bool NimBLERemoteCharacteristic::subscribe(bool notifications, notify_callback notifyCallback, bool response)
+{
+  m_notifyCallback = notifications ? notifyCallback : nullptr;
+  return true;
+}
+
+bool NimBLERemoteCharacteristic::unsubscribe(bool response)
+{
+  m_notifyCallback = nullptr;
+  return true;
+}
+
+bool NimBLERemoteCharacteristic::writeValue(const uint8_t *data, size_t length, bool response)
+{
+  m_lastWrittenLength = min(length, sizeof(m_lastWrittenValue));
+  memcpy(m_lastWrittenValue, data, m_lastWrittenLength);
+  m_writeCount++;
+  return true;
+}
+
+void NimBLERemoteCharacteristic::notify(uint8_t *pData, size_t length)
+{
+  if (m_notifyCallback)
+  {
+    m_notifyCallback(this, pData, length, true);
+  }
+}
+
+const uint8_t *NimBLERemoteCharacteristic::getLastWrittenValue()
+{
+  return m_lastWrittenValue;
+}
+
+size_t NimBLERemoteCharacteristic::getLastWrittenLength()
+{
+  return m_lastWrittenLength;
+}
+
+uint32_t NimBLERemoteCharacteristic::getWriteCount()
+{
+  return m_writeCount;
+}
+
+NimBLERemoteService::NimBLERemoteService(const NimBLEUUID &uuid) : m_uuid(uuid), m_characteristic(NimBLEUUID("00001624-1212-efde-1623-785feabcd123")) {}
+
+NimBLERemoteCharacteristic *NimBLERemoteService::getCharacteristic(const NimBLEUUID &uuid)
+{
+  return m_characteristic.getUUID().equals(uuid) ? &m_characteristic : nullptr;
+}
+
+NimBLEConnInfo::NimBLEConnInfo(uint16_t interval, uint16_t latency, uint16_t timeout)
+    : m_interval(interval), m_latency(latency), m_timeout(timeout) {}
+
+uint16_t NimBLEConnInfo::getConnInterval()
+{
+  return m_interval;
+}
+
+uint16_t NimBLEConnInfo::getConnLatency()
+{
+  return m_latency;
+}
+
+uint16_t NimBLEConnInfo::getConnTimeout()
+{
+  return m_timeout;
+}
+
+NimBLEClient::NimBLEClient() {}
+
+NimBLEClient::~NimBLEClient()
+{
+  delete m_pService;
+  if (m_deleteCallbacks)
+  {
+    delete m_pClientCallbacks;
+  }
+}
+
+bool NimBLEClient::connect(const NimBLEAddress &address, bool deleteAttributes)
+{
+  if (deleteAttributes)
+  {
+    delete m_pService;
+    m_pService = nullptr;
+  }
+  m_peerAddress = address;
+  m_isConnected = true;
+  m_interval = m_requestedInterval;
+  m_latency = m_requestedLatency;
+  m_timeout = m_requestedTimeout;
+  if (m_pClientCallbacks != nullptr)
+  {
+    m_pClientCallbacks->onConnect(this);
+  }
+  return true;
+}
+
+int NimBLEClient::disconnect()
+{
+  m_isConnected = false;
+  if (m_pClientCallbacks != nullptr)
+  {
+    m_pClientCallbacks->onDisconnect(this);
+  }
+  return 0;
+}
+
+bool NimBLEClient::isConnected()
+{
+  return m_isConnected;
+}
+
+NimBLEAddress NimBLEClient::getPeerAddress()
+{
+  return m_peerAddress;
+}
+
+int NimBLEClient::getRssi()
+{
+  return -50;
+}
+
+NimBLERemoteService *NimBLEClient::getService(const NimBLEUUID &uuid)
+{
+  if (m_pService == nullptr)
+  {
+    m_pService = new NimBLERemoteService(uuid);
+  }
+  return m_pService;
+}
+
+void NimBLEClient::setClientCallbacks(NimBLEClientCallbacks *pClientCallbacks, bool deleteCallbacks)
+{
+  if (m_deleteCallbacks && m_pClientCallbacks != pClientCallbacks)
+  {
+    delete m_pClientCallbacks;
+  }
+  m_pClientCallbacks = pClientCallbacks;
+  m_deleteCallbacks = deleteCallbacks;
+}
+
+void NimBLEClient::setConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout, uint16_t scanInterval, uint16_t scanWindow)
+{
+  m_requestedInterval = maxInterval;
+  m_requestedLatency = latency;
+  m_requestedTimeout = timeout;
+}
+
+void NimBLEClient::updateConnParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout)
+{
+  if (m_isConnected)
+  {
+    m_interval = maxInterval;
+    m_latency = latency;
+    m_timeout = timeout;
+  }
+}
+
+NimBLEConnInfo NimBLEClient::getConnInfo()
+{
+  return NimBLEConnInfo(m_interval, m_latency, m_timeout);
+}
+
+bool NimBLEClient::requestConnParamsUpdate(const ble_gap_upd_params &params)
+{
+  if (m_pClientCallbacks != nullptr && !m_pClientCallbacks->onConnParamsUpdateRequest(this, &params))
+  {
+    return false;
+  }
+  m_interval = params.itvl_max;
+  m_latency = params.latency;
+  m_timeout = params.supervision_timeout;
+  return true;
+}
+
+NimBLEAdvertisedDevice::NimBLEAdvertisedDevice() {}
+
+NimBLEAddress NimBLEAdvertisedDevice::getAddress()
+{
+  return m_address;
+}
+
+std::string NimBLEAdvertisedDevice::getName()
+{
+  return m_name;
+}
+
+std::string NimBLEAdvertisedDevice::getManufacturerData()
+{
+  return m_manufacturerData;
+}
+
+NimBLEUUID NimBLEAdvertisedDevice::getServiceUUID()
+{
+  return m_serviceUuid;
+}
+
+NimBLEScan *NimBLEAdvertisedDevice::getScan()
+{
+  return m_pScan;
+}
+
+bool NimBLEAdvertisedDevice::haveServiceUUID()
+{
+  return m_haveServiceUuid;
+}
+
+bool NimBLEAdvertisedDevice::haveManufacturerData()
+{
+  return !m_manufacturerData.empty();
+}
+
+std::string NimBLEAdvertisedDevice::toString()
+{
+  return "Name: " + m_name + ", Address: " + m_address.toString();
+}
+
+void NimBLEAdvertisedDevice::setAddress(const NimBLEAddress &address)
+{
+  m_address = address;
+}
+
+void NimBLEAdvertisedDevice::setName(const std::string &name)
+{
+  m_name = name;
+}
+
+void NimBLEAdvertisedDevice::setManufacturerData(const std::string &manufacturerData)
+{
+  m_manufacturerData = manufacturerData;
+}
+
+void NimBLEAdvertisedDevice::setServiceUUID(const NimBLEUUID &uuid)
+{
+  m_serviceUuid = uuid;
+  m_haveServiceUuid = true;
+}
+
+int NimBLEScanResults::getCount()
+{
+  return (int)m_devices.size();
+}
+
+NimBLEAdvertisedDevice NimBLEScanResults::getDevice(uint32_t i)
+{
+  return m_devices[i];
+}
+
+void NimBLEScan::setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks *pAdvertisedDeviceCallbacks, bool wantDuplicates)
+{
+  m_pAdvertisedDeviceCallbacks = pAdvertisedDeviceCallbacks;
+}
+
+void NimBLEScan::setActiveScan(bool active) {}
+
+bool NimBLEScan::start(uint32_t duration, void (*scanCompleteCB)(NimBLEScanResults), bool is_continue)
+{
+  if (!is_continue)
+  {
+    m_results.m_devices.clear();
+  }
+  m_scanCompleteCB = scanCompleteCB;
+  m_isScanning = true;
+  return true;
+}
+
+bool NimBLEScan::stop()
+{
+  if (!m_isScanning)
+  {
+    return true;
+  }
+  m_isScanning = false;
+  if (m_scanCompleteCB != nullptr)
+  {
+    m_scanCompleteCB(m_results);
+  }
+  return true;
+}
+
+bool NimBLEScan::isScanning()
+{
+  return m_isScanning;
+}
+
+void NimBLEScan::advertise(NimBLEAdvertisedDevice &advertisedDevice)
+{
+  if (!m_isScanning)
+  {
+    return;
+  }
+  advertisedDevice.m_pScan = this;
+  m_results.m_devices.push_back(advertisedDevice);
+  if (m_pAdvertisedDeviceCallbacks != nullptr)
+  {
+    m_pAdvertisedDeviceCallbacks->onResult(&advertisedDevice);
+  }
+}
+
+void NimBLEDevice::init(const std::string &deviceName) {}
+
+NimBLEScan *NimBLEDevice::getScan()
+{
+  return &scan;
+}
+
+NimBLEClient *NimBLEDevice::createClient()
+{
+  NimBLEClient *pClient = new NimBLEClient();
+  clients.push_back(pClient);
+  return pClient;
+}
+
+bool NimBLEDevice::deleteClient(NimBLEClient *pClient)
+{
+  for (size_t i = 0; i < clients.size(); i++)
+  {
+    if (clients[i] == pClient)
+    {
+      clients.erase(clients.begin() + i);
+      delete pClient;
+      return true;
+    }
+  }
+  return false;
+}
+
+NimBLEClient *NimBLEDevice::getClientByPeerAddress(const NimBLEAddress &peerAddress)
+{
+  for (size_t i = 0; i < clients.size(); i++)
+  {
+    if (clients[i]->getPeerAddress().equals(peerAddress))
+    {
+      return clients[i];
+    }
+  }
+  return nullptr;
+}
+
+NimBLEClient *NimBLEDevice::getDisconnectedClient()
+{
+  for (size_t i = 0; i < clients.size(); i++)
+  {
+    if (!clients[i]->isConnected())
+    {
+      return clients[i];
+    }
+  }
+  return nullptr;
+}
+
+size_t NimBLEDevice::getClientListSize()
+{
+  return clients.size();
+}
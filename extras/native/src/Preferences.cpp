@@ -0,0 +1,99 @@
+/*
+ * Preferences.cpp - Minimal host stand-in for the Preferences library of the ESP32 Arduino core
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#include "Preferences.h"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// stored values of all namespaces, the key is "<namespace>/<key>"
+static std::map<std::string, std::vector<uint8_t>> storage;
+static std::mutex storageMutex;
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+  if (_started || name == nullptr || strlen(name) > 15)
+  {
+    return false;
+  }
+  _namespace = name;
+  _readOnly = readOnly;
+  _started = true;
+  return true;
+}
+
+void Preferences::end()
+{
+  _started = false;
+}
+
+bool Preferences::clear()
+{
+  if (!_started || _readOnly)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(storageMutex);
+  std::string prefix = _namespace + "/";
+  for (auto it = storage.begin(); it != storage.end();)
+  {
+    it = it->first.compare(0, prefix.size(), prefix) == 0 ? storage.erase(it) : std::next(it);
+  }
+  return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+  if (!_started || _readOnly || key == nullptr)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(storageMutex);
+  return storage.erase(_namespace + "/" + key) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+  if (!_started || _readOnly || key == nullptr || strlen(key) > 15 || (value == nullptr && len > 0))
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(storageMutex);
+  const uint8_t *bytes = (const uint8_t *)value;
+  storage[_namespace + "/" + key] = std::vector<uint8_t>(bytes, bytes + len);
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+  if (!_started || key == nullptr)
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(storageMutex);
+  auto it = storage.find(_namespace + "/" + key);
+  return it == storage.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+  if (!_started || key == nullptr || buf == nullptr)
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(storageMutex);
+  auto it = storage.find(_namespace + "/" + key);
+  if (it == storage.end() || it->second.size() > maxLen)
+  {
+    return 0;
+  }
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
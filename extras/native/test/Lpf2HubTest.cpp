@@ -0,0 +1,498 @@
+/*
+ * Lpf2HubTest.cpp - Host tests of the Lpf2Hub notification parsing, command tracking and port discovery
+ *
+ * A hub is "connected" through the NimBLE stand-in, notifications of the hub are injected with
+ * notify() and the decoded results and the written commands are checked. The executable returns
+ * a nonzero exit code if a check fails, so it could be run with ctest.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#include "Lpf2Hub.h"
+
+#include <cstring>
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(condition)                                                  \
+  do                                                                      \
+  {                                                                       \
+    checks++;                                                             \
+    if (!(condition))                                                     \
+    {                                                                     \
+      failures++;                                                         \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    }                                                                     \
+  } while (0)
+
+static NimBLERemoteCharacteristic *connectHub(Lpf2Hub &hub, const char *address)
+{
+  hub.initDirect(address, HubType::CONTROL_PLUS_HUB);
+  if (!hub.connectHub())
+  {
+    return nullptr;
+  }
+  return hub._pRemoteCharacteristic;
+}
+
+static void disconnectHub(const char *address)
+{
+  NimBLEDevice::getClientByPeerAddress(NimBLEAddress(address))->disconnect();
+}
+
+static void attachDevice(NimBLERemoteCharacteristic *pCharacteristic, byte port, byte deviceType, byte softwareVersion = 0x10)
+{
+  uint8_t attachMessage[15] = {0x0F, 0x00, (byte)MessageType::HUB_ATTACHED_IO, port, (byte)Event::ATTACHED_IO, deviceType, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, softwareVersion};
+  pCharacteristic->notify(attachMessage, sizeof(attachMessage));
+}
+
+static void notifyFeedback(NimBLERemoteCharacteristic *pCharacteristic, byte port, byte feedback)
+{
+  uint8_t feedbackMessage[5] = {0x05, 0x00, (byte)MessageType::PORT_OUTPUT_COMMAND_FEEDBACK, port, feedback};
+  pCharacteristic->notify(feedbackMessage, sizeof(feedbackMessage));
+}
+
+static int valueCalls = 0;
+static int lastValue = 0;
+
+static void tachoMotorCallback(void *hub, byte portNumber, DeviceType deviceType, uint8_t *pData)
+{
+  valueCalls++;
+  lastValue = ((Lpf2Hub *)hub)->parseTachoMotor(pData);
+}
+
+static void testMessageViews()
+{
+  Lpf2Hub hub;
+  uint8_t tiltMessage[10] = {0x0A, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, 0x63, 0x01, 0x00, 0x22, 0x11, 0x44, 0x33};
+  CHECK(hub.parseControlPlusHubTiltSensorX(tiltMessage) == 1);
+  CHECK(hub.parseControlPlusHubTiltSensorY(tiltMessage) == 0x1122);
+  CHECK(hub.parseControlPlusHubTiltSensorZ(tiltMessage) == 0x3344);
+  // values behind the length of the message are not read
+  tiltMessage[0] = 0x06;
+  CHECK(hub.parseControlPlusHubTiltSensorZ(tiltMessage) == 0);
+
+  uint8_t nameMessage[11] = {0x0B, 0x00, (byte)MessageType::HUB_PROPERTIES, (byte)HubPropertyReference::ADVERTISING_NAME, 0x06, 'T', 'e', 'c', 'h', 'n', 'i'};
+  CHECK(hub.parseHubAdvertisingName(nameMessage) == "Techni");
+
+  uint8_t versionMessage[9] = {0x09, 0x00, (byte)MessageType::HUB_PROPERTIES, (byte)HubPropertyReference::FW_VERSION, 0x06, 0x34, 0x12, 0x05, 0x17};
+  Version version = hub.parseVersion(versionMessage);
+  CHECK(version.Major == 1 && version.Minor == 7 && version.Bugfix == 5 && version.Build == 0x1234);
+
+  const uint8_t feedbackMessage[7] = {0x07, 0x00, (byte)MessageType::PORT_OUTPUT_COMMAND_FEEDBACK, 0x01, 0x0A, 0x02, 0x08};
+  CommandFeedbackMessageView feedback(feedbackMessage, sizeof(feedbackMessage));
+  CHECK(feedback.numberOfPorts() == 2 && feedback.portNumber(1) == 2 && feedback.feedback(1) == 0x08);
+
+  const uint8_t valueMessage[8] = {0x08, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, 0x01, 0x10, 0x20, 0x30, 0x40};
+  CHECK(PortValueMessageView(valueMessage, 8).valueInt32LE() == 0x40302010);
+  CHECK(PortValueMessageView(valueMessage, 7).valueInt32LE() == 0);
+}
+
+static void testFraming()
+{
+  const char *address = "90:84:2b:00:01:01";
+  Lpf2Hub hub;
+  NimBLERemoteCharacteristic *pCharacteristic = connectHub(hub, address);
+  CHECK(pCharacteristic != nullptr);
+  if (pCharacteristic == nullptr)
+  {
+    return;
+  }
+
+  // two attach messages in one notification
+  uint8_t attachMessages[30] = {0x0F, 0x00, 0x04, 0x00, 0x01, 0x2E, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10,
+                                0x0F, 0x00, 0x04, 0x01, 0x01, 0x2E, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10};
+  pCharacteristic->notify(attachMessages, sizeof(attachMessages));
+  CHECK(hub.getDeviceIndexForPortNumber(0) >= 0 && hub.getDeviceIndexForPortNumber(1) >= 0);
+
+  valueCalls = 0;
+  hub.activatePortDevice(0, tachoMotorCallback);
+  hub.activatePortDevice(1, tachoMotorCallback);
+  uint8_t valueMessages[16] = {0x08, 0x00, 0x45, 0x00, 0x05, 0x00, 0x00, 0x00, 0x08, 0x00, 0x45, 0x01, 0x09, 0x00, 0x00, 0x00};
+  pCharacteristic->notify(valueMessages, sizeof(valueMessages));
+  CHECK(valueCalls == 2 && lastValue == 9);
+
+  // extended length header: the message is shifted by one byte and the buffer is not changed
+  uint8_t extendedMessage[9] = {0x89, 0x00, 0x00, 0x45, 0x00, 0x2A, 0x00, 0x00, 0x00};
+  pCharacteristic->notify(extendedMessage, sizeof(extendedMessage));
+  PortValue portValue;
+  CHECK(valueCalls == 3 && extendedMessage[1] == 0x00);
+  CHECK(hub.getPortValue(0, &portValue) && portValue.Values[0] == 42);
+
+  // truncated and too short messages are dropped
+  uint8_t truncatedMessage[6] = {0x08, 0x00, 0x45, 0x00, 0x01, 0x00};
+  pCharacteristic->notify(truncatedMessage, sizeof(truncatedMessage));
+  uint8_t shortMessage[4] = {0x04, 0x00, 0x45, 0x00};
+  pCharacteristic->notify(shortMessage, sizeof(shortMessage));
+  CHECK(valueCalls == 3);
+
+  // a broken frame after a valid message does not drop the valid message
+  uint8_t trailingMessage[10] = {0x08, 0x00, 0x45, 0x00, 0x0B, 0x00, 0x00, 0x00, 0x50, 0x00};
+  pCharacteristic->notify(trailingMessage, sizeof(trailingMessage));
+  CHECK(valueCalls == 4 && lastValue == 11);
+
+  // deferred dispatch: the messages are dispatched by poll()
+  hub.setDeferredDispatch(true);
+  pCharacteristic->notify(valueMessages, sizeof(valueMessages));
+  CHECK(valueCalls == 4);
+  CHECK(hub.poll() == 2 && valueCalls == 6);
+  hub.setDeferredDispatch(false);
+  disconnectHub(address);
+}
+
+static int decoderCalls = 0;
+static int lastDecodedValue = 0;
+static Version lastVersion;
+
+static void customDeviceDecoder(void *hub, byte portNumber, DeviceType deviceType, uint8_t *pData)
+{
+  decoderCalls++;
+  lastDecodedValue = pData[4];
+}
+
+static void versionDecoder(void *hub, HubPropertyReference hubProperty, uint8_t *pData)
+{
+  lastVersion = ((Lpf2Hub *)hub)->parseVersion(pData);
+}
+
+static void testDispatchTables()
+{
+  const char *address = "90:84:2b:00:01:02";
+  Lpf2Hub::registerDeviceType(0x70, 3, customDeviceDecoder);
+  Lpf2Hub::registerHubProperty(HubPropertyReference::FW_VERSION, versionDecoder);
+
+  Lpf2Hub hub;
+  NimBLERemoteCharacteristic *pCharacteristic = connectHub(hub, address);
+  CHECK(pCharacteristic != nullptr);
+  if (pCharacteristic == nullptr)
+  {
+    return;
+  }
+
+  // the registered update mode is used for the activation
+  attachDevice(pCharacteristic, 0x07, 0x70);
+  hub.activatePortDevice(0x07);
+  const uint8_t *pWritten = pCharacteristic->getLastWrittenValue();
+  CHECK(pWritten[2] == (byte)MessageType::PORT_INPUT_FORMAT_SETUP_SINGLE && pWritten[3] == 0x07 && pWritten[4] == 3);
+
+  // the registered decoder is called for value updates without a port callback
+  uint8_t valueMessage[5] = {0x05, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, 0x07, 0x2A};
+  pCharacteristic->notify(valueMessage, sizeof(valueMessage));
+  CHECK(decoderCalls == 1 && lastDecodedValue == 42);
+  PortValue portValue;
+  CHECK(hub.getPortValue(0x07, &portValue) && portValue.Values[0] == 42);
+
+  // the value slot is released with the device, a full slot table is counted
+  uint8_t detachMessage[5] = {0x05, 0x00, (byte)MessageType::HUB_ATTACHED_IO, 0x07, (byte)Event::DETACHED_IO};
+  pCharacteristic->notify(detachMessage, sizeof(detachMessage));
+  CHECK(!hub.getPortValue(0x07, &portValue) && hub.getPortValueSequence(0x07) == 0);
+  for (byte port = 0x10; port < 0x10 + LPF2_MAX_PORT_VALUES + 1; port++)
+  {
+    attachDevice(pCharacteristic, port, 0x70);
+    valueMessage[3] = port;
+    pCharacteristic->notify(valueMessage, sizeof(valueMessage));
+  }
+  CHECK(hub.getHubStatistics().PortValueOverflows == 1 && hub.getPortValueSequence(0x10) == 1);
+  detachMessage[3] = 0x10;
+  pCharacteristic->notify(detachMessage, sizeof(detachMessage));
+  pCharacteristic->notify(valueMessage, sizeof(valueMessage));
+  CHECK(hub.getPortValueSequence(valueMessage[3]) == 1 && hub.getHubStatistics().PortValueOverflows == 1);
+
+  uint8_t versionMessage[9] = {0x09, 0x00, (byte)MessageType::HUB_PROPERTIES, (byte)HubPropertyReference::FW_VERSION, 0x06, 0x34, 0x12, 0x05, 0x17};
+  pCharacteristic->notify(versionMessage, sizeof(versionMessage));
+  CHECK(lastVersion.Major == 1 && lastVersion.Build == 0x1234);
+
+  Lpf2Hub::registerHubProperty(HubPropertyReference::FW_VERSION, nullptr);
+  disconnectHub(address);
+}
+
+static int doneCalls = 0;
+static CommandState lastDoneState = CommandState::UNKNOWN;
+
+static void commandDoneCallback(void *hub, byte portNumber, CommandState state)
+{
+  doneCalls++;
+  lastDoneState = state;
+}
+
+static void testCommandHandles()
+{
+  const char *address = "90:84:2b:00:01:03";
+  Lpf2Hub hub;
+  NimBLERemoteCharacteristic *pCharacteristic = connectHub(hub, address);
+  CHECK(pCharacteristic != nullptr);
+  if (pCharacteristic == nullptr)
+  {
+    return;
+  }
+  attachDevice(pCharacteristic, 0x00, (byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR);
+
+  Lpf2CommandHandle invalidHandle;
+  CHECK(!invalidHandle.isValid() && invalidHandle.getState() == CommandState::UNKNOWN);
+
+  doneCalls = 0;
+  Lpf2CommandHandle first = hub.setTachoMotorSpeedForDegrees(0, 50, 360);
+  Lpf2CommandHandle second = hub.setTachoMotorSpeedForTime(0, 50, 1000);
+  second.onDone(commandDoneCallback);
+  CHECK(first.isValid() && !first.isDone() && hub.getPortCommandsInFlight(0) == 2);
+
+  // discarded and replaced by the second command
+  notifyFeedback(pCharacteristic, 0x00, 0x05);
+  CHECK(first.getState() == CommandState::DISCARDED && !second.isDone() && doneCalls == 0);
+  notifyFeedback(pCharacteristic, 0x00, 0x0A);
+  CHECK(second.isCompleted() && doneCalls == 1 && lastDoneState == CommandState::COMPLETED);
+  CHECK(hub.isPortIdle(0) && hub.getPortCommandsInFlight(0) == 0);
+
+  Lpf2CommandHandle timed = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  timed.setTimeout(10);
+  timed.onDone(commandDoneCallback);
+  delay(15);
+  hub.poll();
+  CHECK(doneCalls == 2 && lastDoneState == CommandState::TIMED_OUT);
+  notifyFeedback(pCharacteristic, 0x00, 0x08);
+
+  // the feedback is received before the callback is registered: the callback is called on registration
+  Lpf2CommandHandle early = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  notifyFeedback(pCharacteristic, 0x00, 0x0A);
+  early.onDone(commandDoneCallback);
+  CHECK(doneCalls == 3 && lastDoneState == CommandState::COMPLETED);
+
+  // a connection loss resolves the sent commands
+  Lpf2CommandHandle lost = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  lost.onDone(commandDoneCallback);
+  disconnectHub(address);
+  hub.poll();
+  CHECK(doneCalls == 4 && lastDoneState == CommandState::DISCONNECTED);
+  CHECK(hub.isPortIdle(0) && hub.getPortCommandFeedback(0) == 0);
+}
+
+static void testCommandQueueing()
+{
+  const char *address = "90:84:2b:00:01:04";
+  Lpf2Hub hub;
+  NimBLERemoteCharacteristic *pCharacteristic = connectHub(hub, address);
+  CHECK(pCharacteristic != nullptr);
+  if (pCharacteristic == nullptr)
+  {
+    return;
+  }
+  attachDevice(pCharacteristic, 0x00, (byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR);
+  const uint8_t *pWritten = pCharacteristic->getLastWrittenValue();
+
+  hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  CHECK(pWritten[4] == LPF2_STARTUP_IMMEDIATE_WITH_FEEDBACK);
+  hub.setCommandBuffering(true);
+  hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  CHECK(pWritten[4] == LPF2_STARTUP_BUFFERED_WITH_FEEDBACK);
+  hub.setCommandBuffering(false);
+  notifyFeedback(pCharacteristic, 0x00, 0x08);
+
+  // two commands are sent, the following ones wait in the client side queue
+  hub.setCommandQueueing(true);
+  uint32_t writeCount = pCharacteristic->getWriteCount();
+  Lpf2CommandHandle first = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  Lpf2CommandHandle second = hub.setTachoMotorSpeedForDegrees(0, 50, 180);
+  Lpf2CommandHandle third = hub.setTachoMotorSpeedForDegrees(0, 50, 270);
+  CHECK(pCharacteristic->getWriteCount() == writeCount + 2 && hub.getQueuedCommandCount(0) == 1);
+  Lpf2CommandHandle high = hub.queuePortCommand(Lpf2Hub::encodeTachoMotorSpeed(0, 10), CommandPriority::HIGH);
+  CHECK(hub.getQueuedCommandCount(0) == 2);
+
+  // the HIGH command is sent first after the completion of the first command
+  notifyFeedback(pCharacteristic, 0x00, 0x03);
+  hub.poll();
+  CHECK(first.isCompleted() && pCharacteristic->getWriteCount() == writeCount + 3);
+  CHECK(pWritten[5] == 0x01 && hub.getQueuedCommandCount(0) == 1);
+
+  hub.emergencyStop(0);
+  CHECK(pWritten[4] == LPF2_STARTUP_IMMEDIATE_WITH_FEEDBACK && hub.getQueuedCommandCount(0) == 0);
+  CHECK(second.getState() == CommandState::DISCARDED && high.getState() == CommandState::DISCARDED && third.getState() == CommandState::DISCARDED);
+  CHECK(!hub.queuePortCommand(Lpf2HubMessage(MessageType::HUB_ACTIONS)).isValid());
+  notifyFeedback(pCharacteristic, 0x00, 0x08);
+
+  // a connection loss flushes the queue, the queue is not stalled after the reconnect
+  Lpf2CommandHandle sent = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  Lpf2CommandHandle queued = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  CHECK(hub.getQueuedCommandCount(0) == 1);
+  disconnectHub(address);
+  hub.poll();
+  CHECK(sent.getState() == CommandState::DISCONNECTED && queued.getState() == CommandState::DISCONNECTED);
+  CHECK(hub.getQueuedCommandCount(0) == 0);
+  CHECK(hub.connectHub());
+  attachDevice(pCharacteristic, 0x00, (byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR);
+  writeCount = pCharacteristic->getWriteCount();
+  Lpf2CommandHandle afterReconnect = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  CHECK(pCharacteristic->getWriteCount() == writeCount + 1 && !afterReconnect.isDone());
+  notifyFeedback(pCharacteristic, 0x00, 0x08);
+  CHECK(afterReconnect.isCompleted());
+
+  // without a poll() the state of the lost connection is cleaned up by the next connect
+  Lpf2CommandHandle beforeLoss = hub.setTachoMotorSpeedForDegrees(0, 50, 90);
+  disconnectHub(address);
+  CHECK(hub.connectHub());
+  CHECK(beforeLoss.getState() == CommandState::DISCONNECTED && hub.isPortIdle(0));
+  hub.setCommandQueueing(false);
+  disconnectHub(address);
+}
+
+static void putFloat(uint8_t *pData, float value)
+{
+  memcpy(pData, &value, sizeof(value));
+}
+
+// reply of the emulated hub to a PORT_INFORMATION_REQUEST or PORT_MODE_INFORMATION_REQUEST.
+// The device has 2 input modes, mode 0 with 2 x INT16 and mode 1 with 1 x FLOAT values
+static bool replyDiscoveryRequest(Lpf2Hub &hub, NimBLERemoteCharacteristic *pCharacteristic)
+{
+  uint32_t messagesOut = hub.getHubStatistics().MessagesOut;
+  hub.poll();
+  if (hub.getHubStatistics().MessagesOut == messagesOut)
+  {
+    return false;
+  }
+  const uint8_t *pRequest = pCharacteristic->getLastWrittenValue();
+  byte port = pRequest[3];
+  if (pRequest[2] == (byte)MessageType::PORT_INFORMATION_REQUEST)
+  {
+    uint8_t reply[11] = {0x0B, 0x00, (byte)MessageType::PORT_INFORMATION, port, 0x01, 0x06, 0x02, 0x03, 0x00, 0x00, 0x00};
+    pCharacteristic->notify(reply, sizeof(reply));
+  }
+  else if (pRequest[2] == (byte)MessageType::PORT_MODE_INFORMATION_REQUEST)
+  {
+    byte mode = pRequest[4];
+    byte informationType = pRequest[5];
+    if (informationType == (byte)ModeInformationType::RAW || informationType == (byte)ModeInformationType::SI)
+    {
+      uint8_t reply[14] = {0x0E, 0x00, (byte)MessageType::PORT_MODE_INFORMATION, port, mode, informationType};
+      putFloat(&reply[6], -100);
+      putFloat(&reply[10], informationType == (byte)ModeInformationType::RAW ? 100 : 1000);
+      pCharacteristic->notify(reply, sizeof(reply));
+    }
+    else if (informationType == (byte)ModeInformationType::VALUE_FORMAT)
+    {
+      uint8_t reply[10] = {0x0A, 0x00, (byte)MessageType::PORT_MODE_INFORMATION, port, mode, informationType, (byte)(mode == 0 ? 2 : 1), (byte)(mode == 0 ? DatasetType::INT16 : DatasetType::FLOAT), 0x04, 0x01};
+      pCharacteristic->notify(reply, sizeof(reply));
+    }
+  }
+  return true;
+}
+
+static void testPortDiscovery()
+{
+  const char *address = "90:84:2b:00:01:05";
+  Lpf2HubCapabilityCache::clear(true);
+  Lpf2Hub hub;
+  NimBLERemoteCharacteristic *pCharacteristic = connectHub(hub, address);
+  CHECK(pCharacteristic != nullptr);
+  if (pCharacteristic == nullptr)
+  {
+    return;
+  }
+  hub.setPortDiscovery(true);
+  attachDevice(pCharacteristic, 0x05, 0x77);
+  CHECK(!hub.isPortDiscoveryComplete());
+
+  // port information and 3 mode information requests for each of the 2 modes
+  int requests = 0;
+  uint32_t start = millis();
+  while (!hub.isPortDiscoveryComplete() && millis() - start < 5000)
+  {
+    requests += replyDiscoveryRequest(hub, pCharacteristic) ? 1 : 0;
+  }
+  CHECK(hub.isPortDiscoveryComplete() && requests == 1 + 2 * 3);
+
+  const DeviceCapabilities *pCapabilities = hub.getPortCapabilities(0x05);
+  CHECK(pCapabilities != nullptr);
+  if (pCapabilities != nullptr)
+  {
+    CHECK(pCapabilities->ModeCount == 2 && pCapabilities->InputModes == 0x03 && pCapabilities->SoftwareVersion == 0x10000000);
+    CHECK(pCapabilities->Modes[0].Datasets == 2 && pCapabilities->Modes[0].Type == DatasetType::INT16);
+    CHECK(pCapabilities->Modes[1].Type == DatasetType::FLOAT && pCapabilities->Modes[1].SiMax == 1000);
+  }
+
+  // the values are decoded with the discovered format
+  hub.activatePortDevice(0x05);
+  uint8_t valueMessage[8] = {0x08, 0x00, (byte)MessageType::PORT_VALUE_SINGLE, 0x05, 0x10, 0x00, 0xFE, 0xFF};
+  pCharacteristic->notify(valueMessage, sizeof(valueMessage));
+  PortValue portValue;
+  CHECK(hub.getPortValue(0x05, &portValue) && portValue.NumberOfValues == 2 && portValue.Values[0] == 16 && portValue.Values[1] == -2);
+
+  // warm start: the stored cache is loaded and the device is not discovered again
+  Lpf2HubCapabilityCache::clear();
+  CHECK(Lpf2HubCapabilityCache::load() && Lpf2HubCapabilityCache::getNumberOfEntries() == 1);
+  const char *warmAddress = "90:84:2b:00:01:06";
+  Lpf2Hub warmHub;
+  NimBLERemoteCharacteristic *pWarmCharacteristic = connectHub(warmHub, warmAddress);
+  CHECK(pWarmCharacteristic != nullptr);
+  if (pWarmCharacteristic != nullptr)
+  {
+    warmHub.setPortDiscovery(true);
+    attachDevice(pWarmCharacteristic, 0x01, 0x77);
+    uint32_t messagesOut = warmHub.getHubStatistics().MessagesOut;
+    warmHub.poll();
+    CHECK(warmHub.getHubStatistics().MessagesOut == messagesOut && warmHub.isPortDiscoveryComplete());
+    CHECK(warmHub.getPortCapabilities(0x01) != nullptr);
+    disconnectHub(warmAddress);
+  }
+  // the entries in use are not replaced by a load
+  CHECK(!Lpf2HubCapabilityCache::load() && Lpf2HubCapabilityCache::getNumberOfEntries() == 1);
+
+  // the entry of the firmware of a device is used, another firmware only if the firmware is not discovered
+  pCapabilities = hub.getPortCapabilities(0x05);
+  CHECK(pCapabilities != nullptr);
+  if (pCapabilities == nullptr)
+  {
+    return;
+  }
+  DeviceCapabilities otherFirmware = *pCapabilities;
+  otherFirmware.SoftwareVersion = 0x20000000;
+  otherFirmware.Modes[0].Datasets = 1;
+  Lpf2HubCapabilityCache::add(otherFirmware);
+  DatasetType datasetType;
+  CHECK(hub.getDatasetsForDeviceMode(0x77, 0, &datasetType, 0x10000000) == 2);
+  CHECK(hub.getDatasetsForDeviceMode(0x77, 0, &datasetType, 0x20000000) == 1);
+  CHECK(hub.getDatasetsForDeviceMode(0x77, 0, &datasetType, 0x30000000) == 1);
+  pCharacteristic->notify(valueMessage, sizeof(valueMessage));
+  CHECK(hub.getPortValue(0x05, &portValue) && portValue.NumberOfValues == 2);
+
+  Lpf2HubCapabilityCache::clear(true);
+  disconnectHub(address);
+}
+
+static void testDestructor()
+{
+  const char *address = "90:84:2b:00:01:07";
+  NimBLERemoteCharacteristic *pCharacteristic = nullptr;
+  {
+    Lpf2Hub hub;
+    pCharacteristic = connectHub(hub, address);
+    hub.setDeferredDispatch(true);
+  }
+  CHECK(pCharacteristic != nullptr);
+  if (pCharacteristic == nullptr)
+  {
+    return;
+  }
+
+  // the deleted hub is unsubscribed and disconnected, a late notification is not dispatched to it
+  uint8_t attachMessage[15] = {0x0F, 0x00, (byte)MessageType::HUB_ATTACHED_IO, 0x00, (byte)Event::ATTACHED_IO, (byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10};
+  pCharacteristic->notify(attachMessage, sizeof(attachMessage));
+  CHECK(!NimBLEDevice::getClientByPeerAddress(NimBLEAddress(address))->isConnected());
+}
+
+int main()
+{
+  testMessageViews();
+  testFraming();
+  testDispatchTables();
+  testCommandHandles();
+  testCommandQueueing();
+  testPortDiscovery();
+  testDestructor();
+
+  printf("%d checks, %d failures\n", checks, failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -8,7 +8,7 @@
  * 
 */
 
-#if defined(ESP32)
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
 
 #include "Boost.h"
 
@@ -17,8 +17,9 @@ Boost::Boost(){};
 /**
  * @brief Move forward (Port AB) with the default speed and stop after the number of steps
  * @param [in] steps Number of steps (Boost grid)
+ * @return handle which is resolved if the movement is done
  */
-void Boost::moveForward(int steps)
+Lpf2CommandHandle Boost::moveForward(int steps)
 {
     byte port = (byte)MoveHubPort::AB;
     byte portA = (byte)MoveHubPort::A;
@@ -26,85 +27,91 @@ void Boost::moveForward(int steps)
 
     setDecelerationProfile(portA, 1000);
     setDecelerationProfile(portB, 1000);
-    setTachoMotorSpeedForDegrees(port, 50, steps * 360 * 2);
+    return setTachoMotorSpeedForDegrees(port, 50, steps * 360 * 2);
 }
 
 /**
  * @brief Move back (Port AB) with the default speed and stop after the number of steps
  * @param [in] steps Number of steps (Boost grid)
+ * @return handle which is resolved if the movement is done
  */
-void Boost::moveBack(int steps)
+Lpf2CommandHandle Boost::moveBack(int steps)
 {
     byte port = (byte)MoveHubPort::AB;
-    setTachoMotorSpeedForDegrees(port, -50, steps * 360 * 2);
+    return setTachoMotorSpeedForDegrees(port, -50, steps * 360 * 2);
 }
 
 /**
  * @brief rotate (Port AB) with the default speed and stop after the degrees
  * @param [in] degrees (negative: left, positive: right)
+ * @return handle which is resolved if the movement is done
  */
-void Boost::rotate(int degrees)
+Lpf2CommandHandle Boost::rotate(int degrees)
 {
     if (degrees > 0)
     {
         // right
-        setTachoMotorSpeedsForDegrees(-50, 50, degrees * 4.5);
+        return setTachoMotorSpeedsForDegrees(-50, 50, degrees * 4.5);
     }
     else
     {
         // left
-        setTachoMotorSpeedsForDegrees(50, -50, degrees * 4.5);
+        return setTachoMotorSpeedsForDegrees(50, -50, degrees * 4.5);
     }
 }
 
 /**
  * @brief rotate left (Port AB) with the default speed and stop after degrees (default 90)
  * @param [in] degrees (default 90)
+ * @return handle which is resolved if the movement is done
  */
-void Boost::rotateLeft(int degrees = 90)
+Lpf2CommandHandle Boost::rotateLeft(int degrees = 90)
 {
-    rotate(-degrees);
+    return rotate(-degrees);
 }
 
 /**
  * @brief rotate right (Port AB) with the default speed and stop after degrees (default 90)
  * @param [in] degrees (default 90)
+ * @return handle which is resolved if the movement is done
  */
-void Boost::rotateRight(int degrees = 90)
+Lpf2CommandHandle Boost::rotateRight(int degrees = 90)
 {
-    rotate(degrees);
+    return rotate(degrees);
 }
 
 /**
  * @brief move an arc (Port AB) with the default speed and stop after degrees
  * @param [in] degrees (negative: left, positive: right)
+ * @return handle which is resolved if the movement is done
  */
-void Boost::moveArc(int degrees)
+Lpf2CommandHandle Boost::moveArc(int degrees)
 {
     if (degrees > 0)
     {
         // right
-        setTachoMotorSpeedsForDegrees(60, 20, degrees * 12);
+        return setTachoMotorSpeedsForDegrees(60, 20, degrees * 12);
     }
     else
     {
         // left
-        setTachoMotorSpeedsForDegrees(20, 60, degrees * 12);
+        return setTachoMotorSpeedsForDegrees(20, 60, degrees * 12);
     }
 }
 
 /**
  * @brief move an arc left (Port AB) with the default speed and stop after degrees (default 90)
  * @param [in] degrees (default 90)
+ * @return handle which is resolved if the movement is done
  */
-void Boost::moveArcLeft(int degrees = 90)
+Lpf2CommandHandle Boost::moveArcLeft(int degrees = 90)
 {
-    moveArc(-degrees);
+    return moveArc(-degrees);
 }
 
-void Boost::moveArcRight(int degrees = 90)
+Lpf2CommandHandle Boost::moveArcRight(int degrees = 90)
 {
-    moveArc(degrees);
+    return moveArc(degrees);
 }
 
-#endif // ESP32
+#endif // ESP32 || LEGOINO_NATIVE
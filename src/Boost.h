@@ -8,7 +8,7 @@
  * 
 */
 
-#if defined(ESP32)
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
 
 #ifndef Boost_h
 #define Boost_h
@@ -22,16 +22,16 @@ public:
   Boost();
 
   //Basic Move/Rotate methods
-  void moveForward(int steps);
-  void moveBack(int steps);
-  void rotate(int degrees);
-  void rotateLeft(int degrees);
-  void rotateRight(int degrees);
-  void moveArc(int degrees);
-  void moveArcLeft(int degrees);
-  void moveArcRight(int degrees);
+  Lpf2CommandHandle moveForward(int steps);
+  Lpf2CommandHandle moveBack(int steps);
+  Lpf2CommandHandle rotate(int degrees);
+  Lpf2CommandHandle rotateLeft(int degrees);
+  Lpf2CommandHandle rotateRight(int degrees);
+  Lpf2CommandHandle moveArc(int degrees);
+  Lpf2CommandHandle moveArcLeft(int degrees);
+  Lpf2CommandHandle moveArcRight(int degrees);
 };
 
 #endif // Boost_h
 
-#endif // ESP32
+#endif // ESP32 || LEGOINO_NATIVE
@@ -6,7 +6,7 @@
  *
 */
 
-#if defined(ESP32)
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
 
 #include "LegoinoCommon.h"
 
@@ -56,22 +56,67 @@ std::string LegoinoCommon::ColorStringFromColor(int color)
     }
 }
 
-byte *LegoinoCommon::Int16ToByteArray(int16_t x)
+// red, green, blue component of each 60 degree hue sector as index into the levels v, q, p, t of HsvToRgb
+static const uint8_t hsvSectorComponents[6][3] = {
+    {0, 3, 2},
+    {1, 0, 2},
+    {2, 0, 3},
+    {2, 1, 0},
+    {3, 2, 0},
+    {0, 2, 1}};
+
+/**
+ * @brief Convert a HSV color to RGB with integer arithmetic. The hue sector selects the
+ * order of the components from a lookup table instead of branching on each sector
+ * @param [in] hue 0..360 (values outside are wrapped)
+ * @param [in] saturation 0..255
+ * @param [in] value 0..255
+ * @param [out] rgb byte array of the caller with red, green, blue (0..255)
+ */
+void LegoinoCommon::HsvToRgb(int hue, uint8_t saturation, uint8_t value, uint8_t rgb[3])
+{
+    hue = hue % 360;
+    if (hue < 0)
+    {
+        hue += 360;
+    }
+    int sector = hue / 60;
+    int fract = hue - sector * 60;
+
+    uint8_t levels[4];
+    levels[0] = value;
+    levels[1] = value * (255 * 60 - saturation * fract) / (255 * 60);
+    levels[2] = value * (255 - saturation) / 255;
+    levels[3] = value * (255 * 60 - saturation * (60 - fract)) / (255 * 60);
+
+    const uint8_t *components = hsvSectorComponents[sector];
+    rgb[0] = levels[components[0]];
+    rgb[1] = levels[components[1]];
+    rgb[2] = levels[components[2]];
+}
+
+/**
+ * @brief Convert a 16 bit value to a little endian byte array
+ * @param [in] x value
+ * @param [out] y byte array of the caller with at least 2 elements
+ */
+void LegoinoCommon::Int16ToByteArray(int16_t x, byte y[2])
 {
-    static byte y[2];
     y[0] = (byte)(x & 0xff);
     y[1] = (byte)((x >> 8) & 0xff);
-    return y;
 }
 
-byte *LegoinoCommon::Int32ToByteArray(int32_t x)
+/**
+ * @brief Convert a 32 bit value to a little endian byte array
+ * @param [in] x value
+ * @param [out] y byte array of the caller with at least 4 elements
+ */
+void LegoinoCommon::Int32ToByteArray(int32_t x, byte y[4])
 {
-    static byte y[4];
     y[0] = (byte)(x & 0xff);
     y[1] = (byte)((x >> 8) & 0xff);
     y[2] = (byte)((x >> 16) & 0xff);
     y[3] = (byte)((x >> 24) & 0xff);
-    return y;
 }
 
 uint8_t LegoinoCommon::ReadUInt8(uint8_t *data, int offset = 0)
@@ -110,4 +155,4 @@ int32_t LegoinoCommon::ReadInt32LE(uint8_t *data, int offset = 0)
     return value;
 }
 
-#endif // ESP32
\ No newline at end of file
+#endif // ESP32 || LEGOINO_NATIVE
\ No newline at end of file
@@ -6,7 +6,7 @@
  *
 */
 
-#if defined(ESP32)
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
 
 #ifndef LegoinoCommon_h
 #define LegoinoCommon_h
@@ -18,8 +18,8 @@ class LegoinoCommon
 {
 public:
   static byte MapSpeed(int speed);
-  static byte *Int16ToByteArray(int16_t x);
-  static byte *Int32ToByteArray(int32_t x);
+  static void Int16ToByteArray(int16_t x, byte y[2]);
+  static void Int32ToByteArray(int32_t x, byte y[4]);
   static unsigned char ReadUInt8(uint8_t *data, int offset);
   static signed char ReadInt8(uint8_t *data, int offset);
   static unsigned short ReadUInt16LE(uint8_t *data, int offset);
@@ -28,8 +28,9 @@ public:
   static signed int ReadInt32LE(uint8_t *data, int offset);
   static std::string ColorStringFromColor(Color color);
   static std::string ColorStringFromColor(int color);
+  static void HsvToRgb(int hue, uint8_t saturation, uint8_t value, uint8_t rgb[3]);
 };
 
 #endif // LegoinoCommon_h
 
-#endif // ESP32
+#endif // ESP32 || LEGOINO_NATIVE
@@ -6,7 +6,7 @@
  * 
 */
 
-#if defined(ESP32)
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
 
 #include "Lpf2Hub.h"
 
@@ -47,8 +47,18 @@ public:
     {
         _lpf2Hub->_isConnecting = false;
         _lpf2Hub->_isConnected = false;
+        _lpf2Hub->_connectionState.store(HubConnectionState::IDLE, std::memory_order_release);
+        _lpf2Hub->_disconnectTime = millis();
+        // the port state is cleaned up in the user loop (see handleConnectionLoss)
+        _lpf2Hub->_isConnectionLossPending.store(true, std::memory_order_release);
+        _lpf2Hub->_isDisconnectPending.store(true, std::memory_order_release);
         log_d("disconnected client");
     }
+
+    bool onConnParamsUpdateRequest(NimBLEClient *pClient, const ble_gap_upd_params *params)
+    {
+        return _lpf2Hub->acceptConnectionParameters(params);
+    }
 };
 
 /**
@@ -69,51 +79,280 @@ public:
         //Found a device, check if the service is contained and optional if address fits requested address
         log_d("advertised device: %s", advertisedDevice->toString().c_str());
 
-        if (advertisedDevice->haveServiceUUID() && advertisedDevice->getServiceUUID().equals(_lpf2Hub->_bleUuid) && (_lpf2Hub->_requestedDeviceAddress == nullptr || (_lpf2Hub->_requestedDeviceAddress && advertisedDevice->getAddress().equals(*_lpf2Hub->_requestedDeviceAddress))))
+        if (_lpf2Hub->matchesAdvertisedDevice(advertisedDevice, Lpf2Hub::getHubTypeForAdvertisedDevice(advertisedDevice)))
         {
             advertisedDevice->getScan()->stop();
-            _lpf2Hub->_pServerAddress = new BLEAddress(advertisedDevice->getAddress());
-            _lpf2Hub->_hubName = advertisedDevice->getName();
-
-            if (advertisedDevice->haveManufacturerData())
-            {
-                uint8_t *manufacturerData = (uint8_t *)advertisedDevice->getManufacturerData().data();
-                uint8_t manufacturerDataLength = advertisedDevice->getManufacturerData().length();
-                if (manufacturerDataLength >= 3)
-                {
-                    log_d("manufacturer data hub type: %x", manufacturerData[3]);
-                    //check device type ID
-                    switch (manufacturerData[3])
-                    {
-                    case DUPLO_TRAIN_HUB_ID:
-                        _lpf2Hub->_hubType = HubType::DUPLO_TRAIN_HUB;
-                        break;
-                    case BOOST_MOVE_HUB_ID:
-                        _lpf2Hub->_hubType = HubType::BOOST_MOVE_HUB;
-                        break;
-                    case POWERED_UP_HUB_ID:
-                        _lpf2Hub->_hubType = HubType::POWERED_UP_HUB;
-                        break;
-                    case POWERED_UP_REMOTE_ID:
-                        _lpf2Hub->_hubType = HubType::POWERED_UP_REMOTE;
-                        break;
-                    case CONTROL_PLUS_HUB_ID:
-                        _lpf2Hub->_hubType = HubType::CONTROL_PLUS_HUB;
-                        break;
-                    case MARIO_HUB_ID:
-                        _lpf2Hub->_hubType = HubType::MARIO_HUB;
-                        break;
-                    default:
-                        _lpf2Hub->_hubType = HubType::UNKNOWNHUB;
-                        break;
-                    }
-                }
-            }
-            _lpf2Hub->_isConnecting = true;
+            _lpf2Hub->applyAdvertisedDevice(advertisedDevice);
         }
     }
 };
 
+typedef void (Lpf2Hub::*MessageHandler)(uint8_t *pData, size_t length);
+
+/**
+ * Value format of the modes of known devices. This is needed to split up the values of
+ * combined mode notifications which contain the values of several modes without any size information
+ */
+struct DeviceModeFormat
+{
+  byte DeviceType;
+  byte Mode;
+  byte Datasets;
+  DatasetType Type;
+};
+
+static const DeviceModeFormat deviceModeFormats[] = {
+    // tacho and absolute motors: power, speed, position, absolute position
+    {(byte)DeviceType::MEDIUM_LINEAR_MOTOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::MEDIUM_LINEAR_MOTOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::MEDIUM_LINEAR_MOTOR, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::MOVE_HUB_MEDIUM_LINEAR_MOTOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::MOVE_HUB_MEDIUM_LINEAR_MOTOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::MOVE_HUB_MEDIUM_LINEAR_MOTOR, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR, 0x03, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR, 0x03, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR, 0x03, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR, 0x03, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR_GREY, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR_GREY, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR_GREY, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR_GREY, 0x03, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR_GREY, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR_GREY, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR_GREY, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR_GREY, 0x03, 1, DatasetType::INT16},
+    // color distance sensor: color, proximity, count, reflection, ambient, rgb, spec
+    {(byte)DeviceType::COLOR_DISTANCE_SENSOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::COLOR_DISTANCE_SENSOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::COLOR_DISTANCE_SENSOR, 0x02, 1, DatasetType::INT32},
+    {(byte)DeviceType::COLOR_DISTANCE_SENSOR, 0x03, 1, DatasetType::INT8},
+    {(byte)DeviceType::COLOR_DISTANCE_SENSOR, 0x04, 1, DatasetType::INT8},
+    {(byte)DeviceType::COLOR_DISTANCE_SENSOR, 0x06, 3, DatasetType::INT16},
+    {(byte)DeviceType::COLOR_DISTANCE_SENSOR, 0x08, 4, DatasetType::INT8},
+    // duplo train base color sensor and speedometer
+    {(byte)DeviceType::DUPLO_TRAIN_BASE_COLOR_SENSOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::DUPLO_TRAIN_BASE_COLOR_SENSOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::DUPLO_TRAIN_BASE_COLOR_SENSOR, 0x02, 1, DatasetType::INT8},
+    {(byte)DeviceType::DUPLO_TRAIN_BASE_COLOR_SENSOR, 0x03, 3, DatasetType::INT16},
+    {(byte)DeviceType::DUPLO_TRAIN_BASE_SPEEDOMETER, 0x00, 1, DatasetType::INT16},
+    {(byte)DeviceType::DUPLO_TRAIN_BASE_SPEEDOMETER, 0x01, 1, DatasetType::INT32},
+    // spike prime color, distance and force sensor
+    {(byte)DeviceType::TECHNIC_COLOR_SENSOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_COLOR_SENSOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_COLOR_SENSOR, 0x02, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_COLOR_SENSOR, 0x05, 4, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_COLOR_SENSOR, 0x06, 3, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_DISTANCE_SENSOR, 0x00, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_DISTANCE_SENSOR, 0x01, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_DISTANCE_SENSOR, 0x02, 1, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_FORCE_SENSOR, 0x00, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_FORCE_SENSOR, 0x01, 1, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_FORCE_SENSOR, 0x02, 1, DatasetType::INT8},
+    // hub internal sensors
+    {(byte)DeviceType::VOLTAGE_SENSOR, 0x00, 1, DatasetType::INT16},
+    {(byte)DeviceType::VOLTAGE_SENSOR, 0x01, 1, DatasetType::INT16},
+    {(byte)DeviceType::CURRENT_SENSOR, 0x00, 1, DatasetType::INT16},
+    {(byte)DeviceType::CURRENT_SENSOR, 0x01, 1, DatasetType::INT16},
+    {(byte)DeviceType::MOVE_HUB_TILT_SENSOR, 0x00, 2, DatasetType::INT8},
+    {(byte)DeviceType::TECHNIC_MEDIUM_HUB_ACCELEROMETER, 0x00, 3, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_MEDIUM_HUB_GYRO_SENSOR, 0x00, 3, DatasetType::INT16},
+    {(byte)DeviceType::TECHNIC_MEDIUM_HUB_TILT_SENSOR, 0x00, 3, DatasetType::INT16},
+};
+
+/**
+ * Dispatch tables for the incoming notifications. The message handlers are indexed by the
+ * message type, the decoders by the device type or hub property. The tables are shared by
+ * all hub instances and filled with the built-in decoders on the first use.
+ */
+static MessageHandler messageHandlers[256];
+// min. length of a message (incl. common header) which is needed by the handler of the message type
+static byte messageMinLengths[256];
+// message type -> index in the per message type counters of a hub (0: counter of all other message types)
+static byte messageTypeCounterIndex[256];
+static PortValueChangeCallback deviceTypeDecoders[256];
+static byte deviceTypeModes[256];
+// true if the update mode of the device type is built-in or registered (otherwise a discovered input mode is used)
+static bool deviceTypeHasMode[256];
+static HubPropertyChangeCallback hubPropertyDecoders[LPF2_MAX_HUB_PROPERTIES];
+
+/**
+ * Decoders of the cached port values of device types with a unit conversion in the default mode. The
+ * decoders return the number of decoded values (0 if the message is too short)
+ */
+typedef byte (*PortValueDecoder)(Lpf2Hub *hub, uint8_t *pData, size_t length, int32_t *values);
+static PortValueDecoder deviceTypeValueDecoders[256];
+
+static byte decodeCurrentSensorValue(Lpf2Hub *hub, uint8_t *pData, size_t length, int32_t *values)
+{
+    if (PortValueMessageView(pData, length).valueLength() < 2)
+    {
+        return 0;
+    }
+    values[0] = hub->parseCurrentSensorMilliAmps(pData);
+    return 1;
+}
+
+static byte decodeVoltageSensorValue(Lpf2Hub *hub, uint8_t *pData, size_t length, int32_t *values)
+{
+    if (PortValueMessageView(pData, length).valueLength() < 2)
+    {
+        return 0;
+    }
+    values[0] = hub->parseVoltageSensorMilliVolts(pData);
+    return 1;
+}
+
+static byte decodeColorDistanceValue(Lpf2Hub *hub, uint8_t *pData, size_t length, int32_t *values)
+{
+    if (PortValueMessageView(pData, length).valueLength() < 4)
+    {
+        return 0;
+    }
+    values[0] = hub->parseColor(pData);
+    values[1] = hub->parseDistanceMillimeters(pData);
+    return 2;
+}
+
+static byte decodeMarioBarcodeValue(Lpf2Hub *hub, uint8_t *pData, size_t length, int32_t *values)
+{
+    if (PortValueMessageView(pData, length).valueLength() < 4)
+    {
+        return 0;
+    }
+    values[0] = (int32_t)hub->parseMarioBarcode(pData);
+    values[1] = (int32_t)hub->parseMarioColor(pData);
+    return 2;
+}
+
+static void decodeAdvertisingName(void *hub, HubPropertyReference hubProperty, uint8_t *pData)
+{
+    ((Lpf2Hub *)hub)->parseHubAdvertisingName(pData);
+}
+
+static void decodeHubButton(void *hub, HubPropertyReference hubProperty, uint8_t *pData)
+{
+    ((Lpf2Hub *)hub)->parseHubButton(pData);
+}
+
+static void decodeRssi(void *hub, HubPropertyReference hubProperty, uint8_t *pData)
+{
+    ((Lpf2Hub *)hub)->parseRssi(pData);
+}
+
+static void decodeBatteryLevel(void *hub, HubPropertyReference hubProperty, uint8_t *pData)
+{
+    ((Lpf2Hub *)hub)->parseBatteryLevel(pData);
+}
+
+static void decodeBatteryType(void *hub, HubPropertyReference hubProperty, uint8_t *pData)
+{
+    ((Lpf2Hub *)hub)->parseBatteryType(pData);
+}
+
+/**
+ * @brief Fill the dispatch tables with the built-in message handlers, update modes and decoders
+ */
+void Lpf2Hub::initDispatchTables()
+{
+    static bool isInitialized = false;
+    if (isInitialized)
+    {
+        return;
+    }
+    isInitialized = true;
+
+    messageHandlers[(byte)MessageType::HUB_PROPERTIES] = &Lpf2Hub::parseDeviceInfo;
+    messageHandlers[(byte)MessageType::HUB_ATTACHED_IO] = &Lpf2Hub::parsePortMessage;
+    messageHandlers[(byte)MessageType::PORT_VALUE_SINGLE] = &Lpf2Hub::parseSensorMessage;
+    messageHandlers[(byte)MessageType::PORT_INPUT_FORMAT_SINGLE] = &Lpf2Hub::parsePortInputFormat;
+    messageHandlers[(byte)MessageType::PORT_VALUE_COMBINEDMODE] = &Lpf2Hub::parseCombinedSensorMessage;
+    messageHandlers[(byte)MessageType::PORT_OUTPUT_COMMAND_FEEDBACK] = &Lpf2Hub::parsePortAction;
+    messageHandlers[(byte)MessageType::PORT_INFORMATION] = &Lpf2Hub::parsePortInformation;
+    messageHandlers[(byte)MessageType::PORT_MODE_INFORMATION] = &Lpf2Hub::parsePortModeInformation;
+
+    messageMinLengths[(byte)MessageType::HUB_PROPERTIES] = 5;
+    messageMinLengths[(byte)MessageType::HUB_ATTACHED_IO] = 5;
+    messageMinLengths[(byte)MessageType::PORT_VALUE_SINGLE] = 5;
+    messageMinLengths[(byte)MessageType::PORT_INPUT_FORMAT_SINGLE] = 10;
+    messageMinLengths[(byte)MessageType::PORT_VALUE_COMBINEDMODE] = 6;
+    messageMinLengths[(byte)MessageType::PORT_OUTPUT_COMMAND_FEEDBACK] = 5;
+    messageMinLengths[(byte)MessageType::PORT_INFORMATION] = 5;
+    messageMinLengths[(byte)MessageType::PORT_MODE_INFORMATION] = 6;
+
+    static const MessageType countedMessageTypes[] = {
+        MessageType::HUB_PROPERTIES,
+        MessageType::HUB_ACTIONS,
+        MessageType::HUB_ALERTS,
+        MessageType::HUB_ATTACHED_IO,
+        MessageType::GENERIC_ERROR_MESSAGES,
+        MessageType::HW_NETWORK_COMMANDS,
+        MessageType::FW_LOCK_STATUS,
+        MessageType::PORT_INFORMATION,
+        MessageType::PORT_MODE_INFORMATION,
+        MessageType::PORT_VALUE_SINGLE,
+        MessageType::PORT_VALUE_COMBINEDMODE,
+        MessageType::PORT_INPUT_FORMAT_SINGLE,
+        MessageType::PORT_INPUT_FORMAT_COMBINEDMODE,
+        MessageType::PORT_OUTPUT_COMMAND_FEEDBACK};
+    for (size_t idx = 0; idx < sizeof(countedMessageTypes) / sizeof(countedMessageTypes[0]); idx++)
+    {
+        messageTypeCounterIndex[(byte)countedMessageTypes[idx]] = idx + 1;
+    }
+
+    deviceTypeModes[(byte)DeviceType::SIMPLE_MEDIUM_LINEAR_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::TRAIN_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::MEDIUM_LINEAR_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::MOVE_HUB_MEDIUM_LINEAR_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::COLOR_DISTANCE_SENSOR] = 0x08;
+    deviceTypeModes[(byte)DeviceType::MOVE_HUB_TILT_SENSOR] = 0x00;
+    deviceTypeModes[(byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR] = (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
+    deviceTypeModes[(byte)DeviceType::MARIO_HUB_GESTURE_SENSOR] = 0x01;
+    static const DeviceType deviceTypesWithMode[] = {
+        DeviceType::SIMPLE_MEDIUM_LINEAR_MOTOR,
+        DeviceType::TRAIN_MOTOR,
+        DeviceType::MEDIUM_LINEAR_MOTOR,
+        DeviceType::MOVE_HUB_MEDIUM_LINEAR_MOTOR,
+        DeviceType::COLOR_DISTANCE_SENSOR,
+        DeviceType::MOVE_HUB_TILT_SENSOR,
+        DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR,
+        DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR,
+        DeviceType::TECHNIC_LARGE_LINEAR_MOTOR,
+        DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR,
+        DeviceType::MARIO_HUB_GESTURE_SENSOR};
+    for (size_t idx = 0; idx < sizeof(deviceTypesWithMode) / sizeof(deviceTypesWithMode[0]); idx++)
+    {
+        deviceTypeHasMode[(byte)deviceTypesWithMode[idx]] = true;
+    }
+
+    deviceTypeValueDecoders[(byte)DeviceType::CURRENT_SENSOR] = &decodeCurrentSensorValue;
+    deviceTypeValueDecoders[(byte)DeviceType::VOLTAGE_SENSOR] = &decodeVoltageSensorValue;
+    deviceTypeValueDecoders[(byte)DeviceType::COLOR_DISTANCE_SENSOR] = &decodeColorDistanceValue;
+    deviceTypeValueDecoders[(byte)DeviceType::MARIO_HUB_BARCODE_SENSOR] = &decodeMarioBarcodeValue;
+
+    hubPropertyDecoders[(byte)HubPropertyReference::ADVERTISING_NAME] = &decodeAdvertisingName;
+    hubPropertyDecoders[(byte)HubPropertyReference::BUTTON] = &decodeHubButton;
+    hubPropertyDecoders[(byte)HubPropertyReference::RSSI] = &decodeRssi;
+    hubPropertyDecoders[(byte)HubPropertyReference::BATTERY_VOLTAGE] = &decodeBatteryLevel;
+    hubPropertyDecoders[(byte)HubPropertyReference::BATTERY_TYPE] = &decodeBatteryType;
+    // the versions and the system type id have no built-in decoder, they are decoded with parseVersion() and
+    // parseSystemTypeId() in a registered decoder or hub property callback
+}
+
 /**
  * @brief Write value to the remote characteristic
  * @param [in] command byte array which contains the ble command
@@ -121,15 +360,70 @@ public:
  */
 void Lpf2Hub::WriteValue(byte command[], int size)
 {
-    byte commandWithCommonHeader[size + 2] = {(byte)(size + 2), 0x00};
-    memcpy(commandWithCommonHeader + 2, command, size);
-    _pRemoteCharacteristic->writeValue(commandWithCommonHeader, sizeof(commandWithCommonHeader), false);
+    if (size < 1)
+    {
+        return;
+    }
+    Lpf2HubMessage message((MessageType)command[0]);
+    message.writeBytes(command + 1, size - 1);
+    WriteValue(message);
+}
+
+/**
+ * @brief Write a message which already contains the common header to the remote characteristic
+ * @param [in] message message which contains the ble command including the common header
+ */
+void Lpf2Hub::WriteValue(const Lpf2HubMessage &message)
+{
+    if (!message.isValid())
+    {
+        log_e("message exceeds the max length of %d bytes", LPF2_MAX_MESSAGE_LENGTH);
+        return;
+    }
+    writeCharacteristic(message.data(), message.length());
+    trackPortOutputCommand(message.data(), message.length());
+}
+
+/**
+ * @brief Write the input format (mode, delta interval, notification) of a port. The last
+ * written input format is stored for each registered port and the message is only sent
+ * if the input format differs from the stored one
+ * @param [in] portNumber number of the port
+ * @param [in] mode mode of the device which should be used for value updates
+ * @param [in] deltaInterval min change of the value which will trigger a notification
+ * @param [in] notificationEnabled enable or disable the notifications
+ */
+void Lpf2Hub::writePortInputFormatSetup(byte portNumber, byte mode, uint32_t deltaInterval, bool notificationEnabled)
+{
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+    {
+        Device *device = &connectedDevices[deviceIndex];
+        if (device->HasInputFormat && device->Mode == mode && device->DeltaInterval == deltaInterval && device->NotificationEnabled == notificationEnabled)
+        {
+            portEXIT_CRITICAL(&_stateLock);
+            return;
+        }
+        device->HasInputFormat = true;
+        device->Mode = mode;
+        device->DeltaInterval = deltaInterval;
+        device->NotificationEnabled = notificationEnabled;
+    }
+    portEXIT_CRITICAL(&_stateLock);
+
+    Lpf2HubMessage message(MessageType::PORT_INPUT_FORMAT_SETUP_SINGLE);
+    message.writeUInt8(portNumber);
+    message.writeUInt8(mode);
+    message.writeInt32LE((int32_t)deltaInterval);
+    message.writeUInt8(notificationEnabled ? 0x01 : 0x00);
+    WriteValue(message);
 }
 
 /**
  * @brief Register a device on a defined port. This will store the device
- * in the connectedDevices array. This method will be called if a port connection
- * event is triggered by the hub
+ * in the connectedDevices array and update the port and device type index tables.
+ * This method will be called if a port connection event is triggered by the hub
  * 
  * @param [in] port number where the device is connected
  * @param [in] device type of the connected device
@@ -137,39 +431,176 @@ void Lpf2Hub::WriteValue(byte command[], int size)
 void Lpf2Hub::registerPortDevice(byte portNumber, byte deviceType)
 {
     log_d("port: %x, device type: %x", portNumber, deviceType);
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+    {
+        // port is already registered (no detach event received before), replace the device
+        removePortDevice(portNumber);
+    }
+
+    if (numberOfConnectedDevices >= LPF2_MAX_CONNECTED_DEVICES)
+    {
+        portEXIT_CRITICAL(&_stateLock);
+        log_w("max number of connected devices reached, ignore device on port %x", portNumber);
+        return;
+    }
+
+    deviceIndex = numberOfConnectedDevices;
     Device newDevice = {portNumber, deviceType, nullptr};
-    connectedDevices[numberOfConnectedDevices] = newDevice;
+    connectedDevices[deviceIndex] = newDevice;
     numberOfConnectedDevices++;
+
+    _portDeviceIndex[portNumber] = deviceIndex;
+    resetPortCommandFeedback(portNumber);
+    if (_deviceTypePort[deviceType] == LPF2_NO_PORT)
+    {
+        _deviceTypePort[deviceType] = portNumber;
+    }
+    portEXIT_CRITICAL(&_stateLock);
 }
 
 /**
- * @brief Remove a device from the connectedDevices array. This method
- * will be called if a port disconnection event is triggered by the hub
+ * @brief Remove a device from the connectedDevices array and the port and device type
+ * index tables. This method will be called if a port disconnection event is triggered by the hub
  * 
  * @param [in] port number where the device is connected
  */
 void Lpf2Hub::deregisterPortDevice(byte portNumber)
 {
     log_d("port: %x", portNumber);
+    portENTER_CRITICAL(&_stateLock);
+    removePortDevice(portNumber);
+    portEXIT_CRITICAL(&_stateLock);
+}
+
+/**
+ * @brief Remove a device from the connectedDevices array and the index tables. The state lock has to be
+ * held by the caller
+ * @param [in] portNumber number of the port
+ */
+void Lpf2Hub::removePortDevice(byte portNumber)
+{
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    if (deviceIndex == LPF2_NO_DEVICE_INDEX)
+    {
+        return;
+    }
+
+    byte deviceType = connectedDevices[deviceIndex].DeviceType;
+    _portDeviceIndex[portNumber] = LPF2_NO_DEVICE_INDEX;
+    releasePortValueSlot(portNumber);
 
-    bool hasReachedRemovedIndex = false;
-    for (int i = 0; i < numberOfConnectedDevices; i++)
+    // move the last device into the gap to keep the array dense
+    int lastDeviceIndex = numberOfConnectedDevices - 1;
+    if (deviceIndex != lastDeviceIndex)
     {
-        if (hasReachedRemovedIndex)
+        connectedDevices[deviceIndex] = connectedDevices[lastDeviceIndex];
+        _portDeviceIndex[connectedDevices[deviceIndex].PortNumber] = deviceIndex;
+    }
+    numberOfConnectedDevices--;
+
+    // point the device type to another port with the same device type if available
+    if (_deviceTypePort[deviceType] == portNumber)
+    {
+        _deviceTypePort[deviceType] = LPF2_NO_PORT;
+        for (int idx = 0; idx < numberOfConnectedDevices; idx++)
         {
-            connectedDevices[i - 1] = connectedDevices[i];
+            if (connectedDevices[idx].DeviceType == deviceType)
+            {
+                _deviceTypePort[deviceType] = connectedDevices[idx].PortNumber;
+                break;
+            }
         }
-        if (!hasReachedRemovedIndex && connectedDevices[i].PortNumber == portNumber)
+    }
+}
+
+/**
+ * @brief Invalidate the stored input formats of all ports. This method will be called if the
+ * hub is disconnected, because the hub will reset the input formats on a new connection
+ */
+void Lpf2Hub::invalidatePortInputFormats()
+{
+    portENTER_CRITICAL(&_stateLock);
+    for (int idx = 0; idx < numberOfConnectedDevices; idx++)
+    {
+        connectedDevices[idx].HasInputFormat = false;
+    }
+    portEXIT_CRITICAL(&_stateLock);
+}
+
+/**
+ * @brief Remove all devices from the connectedDevices array and the index tables. This method will be
+ * called on a connection loss if the automatic reconnect is enabled, because the hub reports all
+ * attached devices again after the reconnect and the replay of the port state waits for these events
+ */
+void Lpf2Hub::clearPortDevices()
+{
+    portENTER_CRITICAL(&_stateLock);
+    for (int idx = 0; idx < numberOfConnectedDevices; idx++)
+    {
+        releasePortValueSlot(connectedDevices[idx].PortNumber);
+    }
+    numberOfConnectedDevices = 0;
+    memset(_portDeviceIndex, LPF2_NO_DEVICE_INDEX, sizeof(_portDeviceIndex));
+    memset(_deviceTypePort, LPF2_NO_PORT, sizeof(_deviceTypePort));
+    portEXIT_CRITICAL(&_stateLock);
+    for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
+    {
+        _virtualPorts[idx].PortNumber = LPF2_NO_PORT;
+    }
+}
+
+/**
+ * @brief Store the port number of a virtual port (created by createVirtualPort) which is reported by the hub
+ * @param [in] portNumber number of the virtual port
+ * @param [in] portA first physical port of the virtual port
+ * @param [in] portB second physical port of the virtual port
+ */
+void Lpf2Hub::attachVirtualPort(byte portNumber, byte portA, byte portB)
+{
+    for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
+    {
+        if (_virtualPorts[idx].PortA == portA && _virtualPorts[idx].PortB == portB)
         {
-            hasReachedRemovedIndex = true;
+            _virtualPorts[idx].PortNumber = portNumber;
+            return;
         }
     }
-    if (numberOfConnectedDevices > 0)
+    // virtual ports which are not created by createVirtualPort (e.g. port AB of the Boost hub) are not stored
+}
+
+/**
+ * @brief Reset the port number of a virtual port which is detached. The port pair is kept
+ * to create the virtual port again after a reconnect
+ * @param [in] portNumber number of the virtual port
+ */
+void Lpf2Hub::detachVirtualPort(byte portNumber)
+{
+    for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
     {
-        numberOfConnectedDevices--;
+        if (_virtualPorts[idx].PortNumber == portNumber)
+        {
+            _virtualPorts[idx].PortNumber = LPF2_NO_PORT;
+            return;
+        }
     }
 }
 
+/**
+ * @brief Write the virtual port setup command which connects two physical ports
+ * @param [in] portA first physical port
+ * @param [in] portB second physical port
+ */
+void Lpf2Hub::writeVirtualPortSetup(byte portA, byte portB)
+{
+    Lpf2HubMessage virtualPortSetup(MessageType::VIRTUAL_PORT_SETUP);
+    virtualPortSetup.writeUInt8(0x01); // connect
+    virtualPortSetup.writeUInt8(portA);
+    virtualPortSetup.writeUInt8(portB);
+    WriteValue(virtualPortSetup);
+}
+
 /**
  * @brief Activate device for receiving updates. E.g. activate a color/distance sensor to
  * write updates on the characteristic if a value has changed. An optional callback could be
@@ -196,16 +627,103 @@ void Lpf2Hub::activatePortDevice(byte portNumber, PortValueChangeCallback portVa
  */
 void Lpf2Hub::activatePortDevice(byte portNumber, byte deviceType, PortValueChangeCallback portValueChangeCallback)
 {
-    byte mode = getModeForDeviceType(deviceType);
+    byte mode = getModeForDeviceType(deviceType, getPortSoftwareVersion(portNumber));
     log_d("port: %x, device type: %x, callback: %x, mode: %x", portNumber, deviceType, portValueChangeCallback, mode);
-    int deviceIndex = getDeviceIndexForPortNumber(portNumber);
-    if (deviceIndex < 0)
+    activatePortDevice(portNumber, mode, 1, portValueChangeCallback);
+}
+
+/**
+ * @brief Activate device for receiving updates with a defined mode and delta interval. The hub
+ * will only send an update if the value has changed at least by the delta interval. E.g. a delta
+ * interval of 10 for the position mode of a tacho motor will send an update every 10 degrees instead
+ * of every degree. The built-in decoders are made for the default mode of a device, so if another mode
+ * is used, a callback should be registered to parse the values.
+ * 
+ * @param [in] portNumber number of the port where the device is connected
+ * @param [in] mode mode of the device which should be used for updates
+ * @param [in] deltaInterval min change of the value which will trigger an update
+ * @param [in] portValueChangeCallback function which will be called on an update event (could be nullptr)
+ */
+void Lpf2Hub::activatePortDevice(byte portNumber, byte mode, uint32_t deltaInterval, PortValueChangeCallback portValueChangeCallback)
+{
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+    {
+        connectedDevices[deviceIndex].Callback = portValueChangeCallback;
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    if (deviceIndex == LPF2_NO_DEVICE_INDEX)
+    {
+        countUnknownPort(portNumber);
+        return;
+    }
+    writePortInputFormatSetup(portNumber, mode, deltaInterval, true);
+
+    PortSubscription *subscription = getPortSubscription(portNumber, true);
+    if (subscription != nullptr)
+    {
+        subscription->IsCombinedMode = false;
+        subscription->Mode = mode;
+        subscription->DeltaInterval = deltaInterval;
+        subscription->Callback = portValueChangeCallback;
+    }
+}
+
+/**
+ * @brief Change the delta interval of an activated device at runtime. The mode and the 
+ * notification state of the port are kept.
+ * 
+ * @param [in] portNumber number of the port where the device is connected
+ * @param [in] deltaInterval min change of the value which will trigger an update
+ */
+void Lpf2Hub::setPortUpdateDelta(byte portNumber, uint32_t deltaInterval)
+{
+    Device portDevice;
+    if (!getPortDevice(portNumber, &portDevice))
+    {
+        countUnknownPort(portNumber);
+        return;
+    }
+    const Device *device = &portDevice;
+    byte mode = device->HasInputFormat ? device->Mode : getModeForDeviceType(device->DeviceType, device->SoftwareVersion);
+    bool notificationEnabled = device->HasInputFormat ? device->NotificationEnabled : true;
+    writePortInputFormatSetup(portNumber, mode, deltaInterval, notificationEnabled);
+
+    PortSubscription *subscription = getPortSubscription(portNumber, false);
+    if (subscription != nullptr && !subscription->IsCombinedMode)
+    {
+        subscription->Mode = mode;
+        subscription->DeltaInterval = deltaInterval;
+    }
+}
+
+/**
+ * @brief Change the mode of an activated device at runtime. The delta interval and the 
+ * notification state of the port are kept.
+ * 
+ * @param [in] portNumber number of the port where the device is connected
+ * @param [in] mode mode of the device which should be used for updates
+ */
+void Lpf2Hub::setPortMode(byte portNumber, byte mode)
+{
+    Device portDevice;
+    if (!getPortDevice(portNumber, &portDevice))
     {
+        countUnknownPort(portNumber);
         return;
     }
-    connectedDevices[deviceIndex].Callback = portValueChangeCallback;
-    byte activatePortDeviceMessage[8] = {0x41, portNumber, mode, 0x01, 0x00, 0x00, 0x00, 0x01};
-    WriteValue(activatePortDeviceMessage, 8);
+    const Device *device = &portDevice;
+    uint32_t deltaInterval = device->HasInputFormat ? device->DeltaInterval : 1;
+    bool notificationEnabled = device->HasInputFormat ? device->NotificationEnabled : true;
+    writePortInputFormatSetup(portNumber, mode, deltaInterval, notificationEnabled);
+
+    PortSubscription *subscription = getPortSubscription(portNumber, false);
+    if (subscription != nullptr && !subscription->IsCombinedMode)
+    {
+        subscription->Mode = mode;
+        subscription->DeltaInterval = deltaInterval;
+    }
 }
 
 /**
@@ -227,944 +745,3377 @@ void Lpf2Hub::deactivatePortDevice(byte portNumber)
  */
 void Lpf2Hub::deactivatePortDevice(byte portNumber, byte deviceType)
 {
-    byte mode = getModeForDeviceType(deviceType);
-    byte deactivatePortDeviceMessage[8] = {0x41, portNumber, mode, 0x01, 0x00, 0x00, 0x00, 0x00};
-    WriteValue(deactivatePortDeviceMessage, 8);
+    byte mode = getModeForDeviceType(deviceType, getPortSoftwareVersion(portNumber));
+    uint32_t deltaInterval = 1;
+    Device device;
+    if (getPortDevice(portNumber, &device) && device.HasInputFormat)
+    {
+        // keep the mode which was activated
+        mode = device.Mode;
+        deltaInterval = device.DeltaInterval;
+    }
+    writePortInputFormatSetup(portNumber, mode, deltaInterval, false);
+    removePortSubscription(portNumber);
 }
 
 /**
- * @brief Parse the incoming characteristic notification for a Device Info Message
- * @param [in] pData The pointer to the received data
+ * @brief Get the number of datasets and the dataset type of a mode of a device. A value format which
+ * was discovered by the port discovery is used before the built-in value format
+ * @param [in] deviceType type of the device
+ * @param [in] mode of the device
+ * @param [out] datasetType type of the datasets
+ * @param [in] softwareVersion firmware of the device or LPF2_ANY_SOFTWARE_VERSION
+ * @return number of datasets of the mode or 0 if the mode is not known
  */
-void Lpf2Hub::parseDeviceInfo(uint8_t *pData)
+byte Lpf2Hub::getDatasetsForDeviceMode(byte deviceType, byte mode, DatasetType *datasetType, uint32_t softwareVersion)
 {
-    if (_hubPropertyChangeCallback != nullptr)
-    {
-        _hubPropertyChangeCallback(this, (HubPropertyReference)pData[3], pData);
-        return;
-    }
-
-    if (pData[3] == (byte)HubPropertyReference::ADVERTISING_NAME)
+    const DeviceCapabilities *capabilities = findDeviceCapabilities(deviceType, softwareVersion);
+    if (capabilities != nullptr && mode < capabilities->ModeCount && mode < LPF2_MAX_DISCOVERED_MODES && capabilities->Modes[mode].Datasets > 0)
     {
-        log_d("advertising name: %s", parseHubAdvertisingName(pData).c_str());
-        return;
+        *datasetType = capabilities->Modes[mode].Type;
+        return capabilities->Modes[mode].Datasets;
     }
-    else if (pData[3] == (byte)HubPropertyReference::BUTTON)
+    for (size_t idx = 0; idx < sizeof(deviceModeFormats) / sizeof(deviceModeFormats[0]); idx++)
     {
-        log_d("hub button state: %x", parseHubButton(pData));
-        return;
+        if (deviceModeFormats[idx].DeviceType == deviceType && deviceModeFormats[idx].Mode == mode)
+        {
+            *datasetType = deviceModeFormats[idx].Type;
+            return deviceModeFormats[idx].Datasets;
+        }
     }
-    else if (pData[3] == (byte)HubPropertyReference::FW_VERSION)
+    return 0;
+}
+
+/**
+ * @brief Get the latest value of a port. The value is read with a sequence lock, so it is a consistent
+ * snapshot even if a notification is dispatched at the same time (no callback or request is needed)
+ * @param [in] portNumber number of the port
+ * @param [out] portValue latest value, timestamp and sequence number of the port
+ * @return true if a value of the port was received, otherwise false
+ */
+bool Lpf2Hub::getPortValue(byte portNumber, PortValue *portValue)
+{
+    byte slotIndex = _portValueIndex[portNumber].load(std::memory_order_acquire);
+    if (slotIndex == LPF2_NO_PORT_VALUE)
     {
-        Version version = parseVersion(pData);
-        log_d("version: %d-%d-%d (%d)", version.Major, version.Minor, version.Bugfix, version.Build);
-        return;
+        return false;
     }
-    else if (pData[3] == (byte)HubPropertyReference::HW_VERSION)
+    PortValueSlot *slot = &_portValues[slotIndex];
+    uint32_t lockBefore;
+    uint32_t lockAfter;
+    byte slotPortNumber;
+    do
     {
-        Version version = parseVersion(pData);
-        log_d("version: %d-%d-%d (%d)", version.Major, version.Minor, version.Bugfix, version.Build);
-        return;
-    }
-    else if (pData[3] == (byte)HubPropertyReference::RSSI)
+        lockBefore = slot->Lock.load(std::memory_order_acquire);
+        // the slot could be released and assigned to another port since the index was read
+        slotPortNumber = slot->PortNumber;
+        memcpy(portValue, &slot->Value, sizeof(PortValue));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        lockAfter = slot->Lock.load(std::memory_order_relaxed);
+    } while ((lockBefore & 1) || lockBefore != lockAfter);
+    return slotPortNumber == portNumber && portValue->Sequence > 0;
+}
+
+/**
+ * @brief Get the sequence number of the latest value of a port. It could be compared with the
+ * sequence number of the last read value to check for a new value
+ * @param [in] portNumber number of the port
+ * @return number of received updates of the port
+ */
+uint32_t Lpf2Hub::getPortValueSequence(byte portNumber)
+{
+    PortValue portValue;
+    return getPortValue(portNumber, &portValue) ? portValue.Sequence : 0;
+}
+
+/**
+ * @brief Get the value slot of a port. A free slot is assigned on the first value of a port, the slot is
+ * released when the device of the port is removed. Called by the dispatch of the notifications
+ * @param [in] portNumber number of the port
+ * @return pointer to the slot or nullptr if all slots are assigned to other ports (counted in the hub statistics)
+ */
+PortValueSlot *Lpf2Hub::getPortValueSlot(byte portNumber)
+{
+    byte slotIndex = _portValueIndex[portNumber].load(std::memory_order_relaxed);
+    if (slotIndex != LPF2_NO_PORT_VALUE)
     {
-        log_d("rssi: ", parseRssi(pData));
-        return;
+        return &_portValues[slotIndex];
     }
-    else if (pData[3] == (byte)HubPropertyReference::BATTERY_VOLTAGE)
+    for (slotIndex = 0; slotIndex < LPF2_MAX_PORT_VALUES; slotIndex++)
     {
-        log_d("battery level: %d %", parseBatteryLevel(pData));
-        return;
+        if (_portValues[slotIndex].PortNumber == LPF2_NO_PORT)
+        {
+            break;
+        }
     }
-    else if (pData[3] == (byte)HubPropertyReference::BATTERY_TYPE)
+    if (slotIndex >= LPF2_MAX_PORT_VALUES)
     {
-        log_d("battery type: %d", parseBatteryType(pData));
-        return;
+        log_hot_w("max number of cached port values reached: %d", LPF2_MAX_PORT_VALUES);
+        _hubStatistics.PortValueOverflows++;
+        return nullptr;
     }
-    else if (pData[3] == (byte)HubPropertyReference::SYSTEM_TYPE_ID)
+    PortValueSlot *slot = &_portValues[slotIndex];
+    uint32_t lock = slot->Lock.load(std::memory_order_relaxed);
+    slot->Lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->PortNumber = portNumber;
+    slot->FormatDeviceType = (byte)DeviceType::UNKNOWNDEVICE;
+    slot->FormatMode = LPF2_COMBINED_MODE;
+    slot->FormatIsFloat = false;
+    memset(&slot->Value, 0, sizeof(PortValue));
+    slot->Lock.store(lock + 2, std::memory_order_release);
+    // published after the slot is initialised
+    _portValueIndex[portNumber].store(slotIndex, std::memory_order_release);
+    return slot;
+}
+
+/**
+ * @brief Release the value slot of a port (device detached or removed after a connection loss)
+ * @param [in] portNumber number of the port
+ */
+void Lpf2Hub::releasePortValueSlot(byte portNumber)
+{
+    byte slotIndex = _portValueIndex[portNumber].load(std::memory_order_relaxed);
+    if (slotIndex == LPF2_NO_PORT_VALUE)
     {
-        log_d("system type id: %x", parseSystemTypeId(pData));
         return;
     }
+    _portValueIndex[portNumber].store(LPF2_NO_PORT_VALUE, std::memory_order_release);
+    // a reader which has read the index before checks the port number of the slot
+    PortValueSlot *slot = &_portValues[slotIndex];
+    uint32_t lock = slot->Lock.load(std::memory_order_relaxed);
+    slot->Lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->PortNumber = LPF2_NO_PORT;
+    slot->Lock.store(lock + 2, std::memory_order_release);
 }
 
 /**
- * @brief Parse the incoming characteristic notification for a Port Message
+ * @brief Decode the datasets of a single mode value update with the value format of the mode. The
+ * format is looked up once per device type and mode (and again after a change of the capability cache)
+ * and kept in the slot. FLOAT datasets are rounded to integer values
+ * @param [in] slot value slot of the port
+ * @param [in] device connected device of the port
+ * @param [in] mode mode of the update
  * @param [in] pData The pointer to the received data
+ * @param [in] length The length of the message (0: taken from the length header)
+ * @param [out] values decoded values (max LPF2_MAX_PORT_VALUE_DATASETS)
+ * @return number of decoded values
  */
-void Lpf2Hub::parsePortMessage(uint8_t *pData)
+byte Lpf2Hub::decodePortValueDatasets(PortValueSlot *slot, const Device *device, byte mode, uint8_t *pData, size_t length, int32_t *values)
 {
-    byte port = pData[3];
-    bool isConnected = (pData[4] == 1 || pData[4] == 2) ? true : false;
-    if (isConnected)
+    byte deviceType = device->DeviceType;
+    uint32_t capabilityGeneration = Lpf2HubCapabilityCache::getGeneration();
+    if (slot->FormatDeviceType != deviceType || slot->FormatMode != mode || slot->FormatCapabilityGeneration != capabilityGeneration)
     {
-        log_d("port %x is connected with device %x", port, pData[5]);
-        registerPortDevice(port, pData[5]);
+        DatasetType datasetType = DatasetType::INT8;
+        slot->FormatDeviceType = deviceType;
+        slot->FormatMode = mode;
+        slot->FormatDatasets = getDatasetsForDeviceMode(deviceType, mode, &datasetType, device->SoftwareVersion);
+        slot->FormatValueSize = datasetType == DatasetType::INT8 ? 1 : (datasetType == DatasetType::INT16 ? 2 : 4);
+        slot->FormatIsFloat = slot->FormatDatasets > 0 && datasetType == DatasetType::FLOAT;
+        slot->FormatCapabilityGeneration = capabilityGeneration;
     }
-    else
+
+    PortValueMessageView message(pData, length);
+    byte datasets = slot->FormatDatasets;
+    byte valueSize = slot->FormatValueSize;
+    if (datasets == 0)
     {
-        log_d("port %x is disconnected", port);
-        deregisterPortDevice(port);
+        // unknown format: one value with the size of the message
+        size_t valueLength = message.valueLength();
+        datasets = 1;
+        valueSize = valueLength >= 4 ? 4 : (valueLength >= 2 ? 2 : 1);
     }
+
+    byte numberOfValues = 0;
+    for (byte dataset = 0; dataset < datasets && dataset < LPF2_MAX_PORT_VALUE_DATASETS; dataset++)
+    {
+        size_t offset = dataset * valueSize;
+        if (offset + valueSize > message.valueLength())
+        {
+            break;
+        }
+        if (valueSize == 1)
+        {
+            values[dataset] = message.valueInt8(offset);
+        }
+        else if (valueSize == 2)
+        {
+            values[dataset] = message.valueInt16LE(offset);
+        }
+        else if (slot->FormatIsFloat)
+        {
+            uint32_t bits = (uint32_t)message.valueInt32LE(offset);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            values[dataset] = (int32_t)(value < 0 ? value - 0.5f : value + 0.5f);
+        }
+        else
+        {
+            values[dataset] = message.valueInt32LE(offset);
+        }
+        numberOfValues++;
+    }
+    return numberOfValues;
 }
 
 /**
- * @brief Parse Mario pant sensor 
+ * @brief Decode a single mode value update and store it as latest value of the port. Device types with a
+ * value decoder are decoded with the unit conversion of the parse methods if the default mode is active
+ * @param [in] device connected device of the port
  * @param [in] pData The pointer to the received data
- * @return Pant type
+ * @param [in] length The length of the message (0: taken from the length header)
  */
-MarioPant Lpf2Hub::parseMarioPant(uint8_t *pData)
+void Lpf2Hub::storePortValue(const Device *device, uint8_t *pData, size_t length)
 {
-    int value = LegoinoCommon::ReadInt8(pData, 4);
-    log_d("Mario Pant: %d", value);
-    return (MarioPant)value;
+    PortValueSlot *slot = getPortValueSlot(device->PortNumber);
+    if (slot == nullptr)
+    {
+        return;
+    }
+    byte deviceType = device->DeviceType;
+    byte mode = device->HasInputFormat ? device->Mode : getModeForDeviceType(deviceType, device->SoftwareVersion);
+
+    int32_t values[LPF2_MAX_PORT_VALUE_DATASETS] = {0};
+    byte numberOfValues;
+    PortValueDecoder decoder = deviceTypeValueDecoders[deviceType];
+    if (decoder != nullptr && mode == deviceTypeModes[deviceType])
+    {
+        numberOfValues = decoder(this, pData, length, values);
+    }
+    else
+    {
+        numberOfValues = decodePortValueDatasets(slot, device, mode, pData, length, values);
+    }
+    if (numberOfValues == 0)
+    {
+        return;
+    }
+    writePortValue(slot, deviceType, mode, values, numberOfValues);
 }
 
 /**
- * @brief Parse Mario gesture sensor 
- * @param [in] pData The pointer to the received data
- * @return Gesture
+ * @brief Write the latest value of a port with the sequence lock of the slot
+ * @param [in] slot value slot of the port
+ * @param [in] deviceType type of the device
+ * @param [in] mode mode of the update or LPF2_COMBINED_MODE
+ * @param [in] values array of LPF2_MAX_PORT_VALUE_DATASETS values
+ * @param [in] numberOfValues number of decoded values
  */
-MarioGesture Lpf2Hub::parseMarioGesture(uint8_t *pData)
+void Lpf2Hub::writePortValue(PortValueSlot *slot, byte deviceType, byte mode, const int32_t *values, byte numberOfValues)
 {
-    int value = LegoinoCommon::ReadInt16LE(pData, 4);
-    log_d("Mario Gesture: %d", value);
-    return (MarioGesture)value;
+    uint32_t lock = slot->Lock.load(std::memory_order_relaxed);
+    slot->Lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->Value.Sequence++;
+    slot->Value.Timestamp = (uint32_t)millis();
+    slot->Value.DeviceType = deviceType;
+    slot->Value.Mode = mode;
+    slot->Value.NumberOfValues = numberOfValues;
+    // fixed size copy, the values after numberOfValues are not valid
+    memcpy(slot->Value.Values, values, sizeof(slot->Value.Values));
+    slot->Lock.store(lock + 2, std::memory_order_release);
 }
 
 /**
- * @brief Parse Mario barcode  sensor 
- * @param [in] pData The pointer to the received data
- * @return MarioBarcode
+ * @brief Enable or disable the port discovery. If enabled, the modes, ranges and value formats of each attached
+ * device are requested once per device type and firmware in poll() and added to the shared Lpf2HubCapabilityCache.
+ * The stored cache is loaded on the first enable, so known devices are not requested again after a restart
+ * @param [in] enabled true to discover the capabilities of attached devices
  */
-MarioBarcode Lpf2Hub::parseMarioBarcode(uint8_t *pData)
+void Lpf2Hub::setPortDiscovery(bool enabled)
 {
-    int value = LegoinoCommon::ReadInt16LE(pData, 4);
-    log_d("Mario Barcode: %d", value);
-    return MarioBarcode(value);
+    if (enabled && !Lpf2HubCapabilityCache::isLoaded())
+    {
+        Lpf2HubCapabilityCache::load();
+    }
+    if (!enabled && _discoveryPort != LPF2_NO_PORT)
+    {
+        finishPortDiscovery(false);
+    }
+    _isPortDiscoveryEnabled = enabled;
 }
 
 /**
- * @brief Parse Mario color sensor 
- * @param [in] pData The pointer to the received data
- * @return MarioColor
+ * @brief Get the state of the port discovery
+ * @return true if no discovery is running and no attached device waits for the discovery
  */
-MarioColor Lpf2Hub::parseMarioColor(uint8_t *pData)
+bool Lpf2Hub::isPortDiscoveryComplete()
 {
-    int value = LegoinoCommon::ReadInt16LE(pData, 6);
-    log_d("Mario Color: %d", value);
-    return (MarioColor)value;
+    if (_discoveryPort != LPF2_NO_PORT)
+    {
+        return false;
+    }
+    bool isComplete = true;
+    portENTER_CRITICAL(&_stateLock);
+    for (int idx = 0; idx < numberOfConnectedDevices && isComplete; idx++)
+    {
+        isComplete = !connectedDevices[idx].IsDiscoveryPending || Lpf2HubCapabilityCache::find(connectedDevices[idx].DeviceType, connectedDevices[idx].SoftwareVersion) != nullptr;
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    return isComplete;
 }
 
 /**
- * @brief Parse boost hub tilt sensor message (x axis)
- * @param [in] pData The pointer to the received data
- * @return Degrees of rotation/tilt around the x axis
+ * @brief Find the capabilities of a device type with its firmware. The entry of another firmware of the
+ * device type is only used if the firmware is not discovered
+ * @param [in] deviceType type of the device
+ * @param [in] softwareVersion firmware of the device or LPF2_ANY_SOFTWARE_VERSION
+ * @return pointer to the capabilities or nullptr if the device type is not discovered
  */
-int Lpf2Hub::parseBoostTiltSensorX(uint8_t *pData)
+const DeviceCapabilities *Lpf2Hub::findDeviceCapabilities(byte deviceType, uint32_t softwareVersion)
 {
-    int value = LegoinoCommon::ReadInt8(pData, 4);
-    log_d("tilt x: %d", value);
-    return value;
+    const DeviceCapabilities *capabilities = nullptr;
+    if (softwareVersion != LPF2_ANY_SOFTWARE_VERSION)
+    {
+        capabilities = Lpf2HubCapabilityCache::find(deviceType, softwareVersion);
+    }
+    return capabilities != nullptr ? capabilities : Lpf2HubCapabilityCache::find(deviceType);
 }
 
 /**
- * @brief Parse boost hub tilt sensor message (y axis)
- * @param [in] pData The pointer to the received data
- * @return Degrees of rotation/tilt around the y axis
+ * @brief Get the firmware of the device which is attached to a port
+ * @param [in] portNumber number of the port
+ * @return software version of the attached io message or LPF2_ANY_SOFTWARE_VERSION if no device is registered
  */
-int Lpf2Hub::parseBoostTiltSensorY(uint8_t *pData)
+uint32_t Lpf2Hub::getPortSoftwareVersion(byte portNumber)
 {
-    int value = LegoinoCommon::ReadInt8(pData, 5);
-    log_d("tilt y: %d", value);
-    return value;
+    Device device;
+    return getPortDevice(portNumber, &device) ? device.SoftwareVersion : LPF2_ANY_SOFTWARE_VERSION;
 }
 
 /**
- * @brief Parse control plus hub tilt sensor message (x axis)
- * @param [in] pData The pointer to the received data
- * @return Degrees of rotation/tilt around the x axis
+ * @brief Get the discovered (or stored) capabilities of the device which is attached to a port
+ * @param [in] portNumber number of the port
+ * @return pointer to the capabilities or nullptr if the device type/firmware of the port is not discovered
  */
-int Lpf2Hub::parseControlPlusHubTiltSensorX(uint8_t *pData)
+const DeviceCapabilities *Lpf2Hub::getPortCapabilities(byte portNumber)
 {
-    int value = LegoinoCommon::ReadInt16LE(pData, 4);
-    log_d("tilt x: %d", value);
-    return value;
+    Device device;
+    if (!getPortDevice(portNumber, &device))
+    {
+        return nullptr;
+    }
+    return Lpf2HubCapabilityCache::find(device.DeviceType, device.SoftwareVersion);
 }
 
 /**
- * @brief Parse control plus hub tilt sensor message (y axis)
- * @param [in] pData The pointer to the received data
- * @return Degrees of rotation/tilt around the y axis
+ * @brief Drive the port discovery (called by poll). Only one request is outstanding, the next request is sent
+ * after the reply of the previous one or a timeout. For each port the mode info is requested and for each mode
+ * the raw range, the SI range and the value format
  */
-int Lpf2Hub::parseControlPlusHubTiltSensorY(uint8_t *pData)
+void Lpf2Hub::stepPortDiscovery()
 {
-    int value = LegoinoCommon::ReadInt16LE(pData, 6);
-    log_d("tilt y: %d", value);
-    return value;
+    if (!_isPortDiscoveryEnabled)
+    {
+        return;
+    }
+    if (!_isConnected)
+    {
+        if (_discoveryPort != LPF2_NO_PORT)
+        {
+            // the requests are lost with the connection, the device is discovered again after the reconnect
+            portENTER_CRITICAL(&_stateLock);
+            byte deviceIndex = _portDeviceIndex[_discoveryPort];
+            if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+            {
+                connectedDevices[deviceIndex].IsDiscoveryPending = true;
+            }
+            portEXIT_CRITICAL(&_stateLock);
+            finishPortDiscovery(false);
+        }
+        return;
+    }
+
+    if (_discoveryPort == LPF2_NO_PORT)
+    {
+        // the first pending device which is not in the cache yet is taken from the device table
+        Device device;
+        bool isFound = false;
+        portENTER_CRITICAL(&_stateLock);
+        for (int idx = 0; idx < numberOfConnectedDevices && !isFound; idx++)
+        {
+            if (!connectedDevices[idx].IsDiscoveryPending)
+            {
+                continue;
+            }
+            connectedDevices[idx].IsDiscoveryPending = false;
+            device = connectedDevices[idx];
+            isFound = Lpf2HubCapabilityCache::find(device.DeviceType, device.SoftwareVersion) == nullptr;
+        }
+        portEXIT_CRITICAL(&_stateLock);
+        if (isFound)
+        {
+            log_d("discover device type %x on port %x", device.DeviceType, device.PortNumber);
+            memset(&_discovery, 0, sizeof(_discovery));
+            _discovery.DeviceType = device.DeviceType;
+            _discovery.SoftwareVersion = device.SoftwareVersion;
+            _discoveryPort = device.PortNumber;
+            _discoveryMode = 0;
+            _discoveryInformationType = LPF2_DISCOVERY_PORT_INFORMATION;
+            _discoveryRetries = 0;
+            _isDiscoveryReplyReceived.store(false, std::memory_order_relaxed);
+            writeDiscoveryRequest();
+        }
+        return;
+    }
+
+    Device device;
+    if (!getPortDevice(_discoveryPort, &device) || device.DeviceType != _discovery.DeviceType)
+    {
+        log_d("port %x was detached during the discovery", _discoveryPort);
+        finishPortDiscovery(false);
+        return;
+    }
+
+    if (!_isDiscoveryReplyReceived.load(std::memory_order_acquire))
+    {
+        if ((uint32_t)millis() - _discoveryRequestTime < LPF2_DISCOVERY_REQUEST_TIMEOUT)
+        {
+            return;
+        }
+        if (_discoveryRetries >= LPF2_DISCOVERY_REQUEST_RETRIES)
+        {
+            log_w("no reply of port %x for mode %x information %x, skip discovery", _discoveryPort, _discoveryMode, _discoveryInformationType);
+            finishPortDiscovery(false);
+            return;
+        }
+        _discoveryRetries++;
+        writeDiscoveryRequest();
+        return;
+    }
+
+    // next request: mode info -> (raw range, SI range, value format) of each mode
+    _isDiscoveryReplyReceived.store(false, std::memory_order_relaxed);
+    _discoveryRetries = 0;
+    byte modeCount = min(_discovery.ModeCount, (byte)LPF2_MAX_DISCOVERED_MODES);
+    if (_discoveryInformationType == LPF2_DISCOVERY_PORT_INFORMATION)
+    {
+        _discoveryMode = 0;
+        _discoveryInformationType = (byte)ModeInformationType::RAW;
+    }
+    else if (_discoveryInformationType == (byte)ModeInformationType::RAW)
+    {
+        _discoveryInformationType = (byte)ModeInformationType::SI;
+    }
+    else if (_discoveryInformationType == (byte)ModeInformationType::SI)
+    {
+        _discoveryInformationType = (byte)ModeInformationType::VALUE_FORMAT;
+    }
+    else
+    {
+        _discoveryMode++;
+        _discoveryInformationType = (byte)ModeInformationType::RAW;
+    }
+    if (_discoveryMode >= modeCount)
+    {
+        finishPortDiscovery(true);
+        return;
+    }
+    writeDiscoveryRequest();
 }
 
 /**
- * @brief Parse control plus hub tilt sensor message (z axis)
- * @param [in] pData The pointer to the received data
- * @return Degrees of rotation/tilt around the z axis
+ * @brief Write the outstanding request of the port discovery
  */
-int Lpf2Hub::parseControlPlusHubTiltSensorZ(uint8_t *pData)
+void Lpf2Hub::writeDiscoveryRequest()
 {
-    int value = LegoinoCommon::ReadInt16LE(pData, 8);
-    log_d("tilt z: %d", value);
-    return value;
+    _discoveryRequestTime = (uint32_t)millis();
+    if (_discoveryInformationType == LPF2_DISCOVERY_PORT_INFORMATION)
+    {
+        Lpf2HubMessage message(MessageType::PORT_INFORMATION_REQUEST);
+        message.writeUInt8(_discoveryPort);
+        message.writeUInt8((byte)PortInformationType::MODE_INFO);
+        WriteValue(message);
+        return;
+    }
+    Lpf2HubMessage message(MessageType::PORT_MODE_INFORMATION_REQUEST);
+    message.writeUInt8(_discoveryPort);
+    message.writeUInt8(_discoveryMode);
+    message.writeUInt8(_discoveryInformationType);
+    WriteValue(message);
 }
 
 /**
- * @brief Parse current value [mA] of a current sensor message
- * @param [in] pData The pointer to the received data
- * @return current value in unit mA
+ * @brief End the discovery of the current port
+ * @param [in] isComplete true to add the discovered capabilities to the capability cache
  */
-double Lpf2Hub::parseCurrentSensor(uint8_t *pData)
+void Lpf2Hub::finishPortDiscovery(bool isComplete)
 {
-    int currentRaw = LegoinoCommon::ReadUInt16LE(pData, 4);
-    double current = (double)currentRaw * LPF2_CURRENT_MAX / LPF2_CURRENT_MAX_RAW;
-    log_d("current value: %.2f [mA]", current);
-    return current;
+    if (isComplete)
+    {
+        log_d("discovered %d modes of device type %x on port %x", _discovery.ModeCount, _discovery.DeviceType, _discoveryPort);
+        Lpf2HubCapabilityCache::add(_discovery);
+    }
+    _discoveryPort = LPF2_NO_PORT;
+    _isDiscoveryReplyReceived.store(false, std::memory_order_relaxed);
 }
 
 /**
- * @brief Parse Voltage value [V] of a voltage sensor message
- * @param [in] pData The pointer to the received data
- * @return voltage in unit volt
+ * @brief Write a port input format setup message for combined modes
+ * @param [in] portNumber number of the port
+ * @param [in] subCommand combined mode sub command
  */
-double Lpf2Hub::parseVoltageSensor(uint8_t *pData)
+void Lpf2Hub::writeCombinedModeSetup(byte portNumber, CombinedModeSubCommand subCommand)
 {
-    int voltageRaw = LegoinoCommon::ReadUInt16LE(pData, 4);
-    double voltage = (double)voltageRaw * LPF2_VOLTAGE_MAX / LPF2_VOLTAGE_MAX_RAW;
-    log_d("voltage value: %.2f [V]", voltage);
-    return voltage;
+    Lpf2HubMessage message(MessageType::PORT_INPUT_FORMAT_SETUP_COMBINEDMODE);
+    message.writeUInt8(portNumber);
+    message.writeUInt8((byte)subCommand);
+    WriteValue(message);
 }
 
 /**
- * @brief Parse rotation value [degrees] of a tacho motor
- * @param [in] pData The pointer to the received data
- * @return rotaton in unit degrees (+/-)
+ * @brief Activate several modes of a device for receiving updates in a single combined notification.
+ * E.g. speed and position of a tacho motor or color and distance of a color/distance sensor. All
+ * datasets of the given modes are added to the combination (max 8 datasets).
+ * 
+ * @param [in] portNumber number of the port where the device is connected
+ * @param [in] modes array of the modes which should be combined
+ * @param [in] numberOfModes number of elements in the modes array
+ * @param [in] portCombinedValueChangeCallback function which will be called for each value of an update event
+ * @param [in] deltaInterval min change of the values which will trigger an update
+ * @return true if the combination could be set up, false if the device or a mode is not known
  */
-int Lpf2Hub::parseTachoMotor(uint8_t *pData)
+bool Lpf2Hub::activatePortDeviceCombinedMode(byte portNumber, byte modes[], byte numberOfModes, PortCombinedValueChangeCallback portCombinedValueChangeCallback, uint32_t deltaInterval)
 {
-    int value = LegoinoCommon::ReadInt32LE(pData, 4);
-    log_d("rotation value: %d [degrees]", value);
-    return value;
+    Device portDevice;
+    if (!getPortDevice(portNumber, &portDevice))
+    {
+        countUnknownPort(portNumber);
+        return false;
+    }
+    const Device *device = &portDevice;
+
+    byte datasetCount = 0;
+    byte combinedModeDatasets[LPF2_MAX_COMBINED_MODE_DATASETS];
+    byte combinedModeValueSizes[LPF2_MAX_COMBINED_MODE_DATASETS];
+    for (int modeIdx = 0; modeIdx < numberOfModes; modeIdx++)
+    {
+        DatasetType datasetType;
+        byte datasets = getDatasetsForDeviceMode(device->DeviceType, modes[modeIdx], &datasetType, device->SoftwareVersion);
+        if (datasets == 0 || datasetCount + datasets > LPF2_MAX_COMBINED_MODE_DATASETS)
+        {
+            log_w("mode %x of device type %x could not be combined", modes[modeIdx], device->DeviceType);
+            return false;
+        }
+        byte valueSize = datasetType == DatasetType::INT8 ? 1 : (datasetType == DatasetType::INT16 ? 2 : 4);
+        for (int dataset = 0; dataset < datasets; dataset++)
+        {
+            combinedModeDatasets[datasetCount] = (modes[modeIdx] << 4) | dataset;
+            combinedModeValueSizes[datasetCount] = valueSize;
+            datasetCount++;
+        }
+    }
+
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+    {
+        Device *registeredDevice = &connectedDevices[deviceIndex];
+        registeredDevice->CombinedModeDatasetCount = datasetCount;
+        memcpy(registeredDevice->CombinedModeDatasets, combinedModeDatasets, datasetCount);
+        memcpy(registeredDevice->CombinedModeValueSizes, combinedModeValueSizes, datasetCount);
+        registeredDevice->CombinedCallback = portCombinedValueChangeCallback;
+        // the single mode input format is overwritten by the combined mode setup
+        registeredDevice->HasInputFormat = false;
+    }
+    portEXIT_CRITICAL(&_stateLock);
+
+    writeCombinedModeSetup(portNumber, CombinedModeSubCommand::LOCK_DEVICE_FOR_SETUP);
+    for (int modeIdx = 0; modeIdx < numberOfModes; modeIdx++)
+    {
+        Lpf2HubMessage modeSetup(MessageType::PORT_INPUT_FORMAT_SETUP_SINGLE);
+        modeSetup.writeUInt8(portNumber);
+        modeSetup.writeUInt8(modes[modeIdx]);
+        modeSetup.writeInt32LE((int32_t)deltaInterval);
+        modeSetup.writeUInt8(0x01);
+        WriteValue(modeSetup);
+    }
+
+    Lpf2HubMessage combinationSetup(MessageType::PORT_INPUT_FORMAT_SETUP_COMBINEDMODE);
+    combinationSetup.writeUInt8(portNumber);
+    combinationSetup.writeUInt8((byte)CombinedModeSubCommand::SET_MODE_DATASET_COMBINATIONS);
+    combinationSetup.writeUInt8(0x00); // combination index
+    combinationSetup.writeBytes(combinedModeDatasets, datasetCount);
+    WriteValue(combinationSetup);
+
+    writeCombinedModeSetup(portNumber, CombinedModeSubCommand::UNLOCK_AND_START_MULTI_UPDATE_ENABLED);
+
+    PortSubscription *subscription = getPortSubscription(portNumber, true);
+    if (subscription != nullptr && numberOfModes <= LPF2_MAX_COMBINED_MODE_DATASETS)
+    {
+        subscription->IsCombinedMode = true;
+        subscription->DeltaInterval = deltaInterval;
+        subscription->NumberOfModes = numberOfModes;
+        memcpy(subscription->Modes, modes, numberOfModes);
+        subscription->CombinedCallback = portCombinedValueChangeCallback;
+    }
+    return true;
 }
 
 /**
- * @brief Parse speed value of a duplo train hub
- * @param [in] pData The pointer to the received data
- * @return speed value
+ * @brief Deactivate the combined mode updates of a device
+ * @param [in] portNumber number of the port where the device is connected
  */
-int Lpf2Hub::parseSpeedometer(uint8_t *pData)
+void Lpf2Hub::deactivatePortDeviceCombinedMode(byte portNumber)
 {
-    int value = LegoinoCommon::ReadInt16LE(pData, 4);
-    log_d("speedometer value: %d ", value);
-    return value;
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+    {
+        connectedDevices[deviceIndex].CombinedModeDatasetCount = 0;
+        connectedDevices[deviceIndex].CombinedCallback = nullptr;
+        connectedDevices[deviceIndex].HasInputFormat = false;
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    writeCombinedModeSetup(portNumber, CombinedModeSubCommand::LOCK_DEVICE_FOR_SETUP);
+    writeCombinedModeSetup(portNumber, CombinedModeSubCommand::UNLOCK_AND_START_MULTI_UPDATE_DISABLED);
+    removePortSubscription(portNumber);
 }
 
 /**
- * @brief Parse distance value [millimeters] of a distance sensor
+ * @brief Parse the incoming characteristic notification for a Combined Mode Sensor Message. The
+ * values are split up by the mode/dataset combination of the port and the callback is called for each value
  * @param [in] pData The pointer to the received data
- * @return distance in unit millimeters
+ * @param [in] length The length of the message (0: taken from the length header)
  */
-double Lpf2Hub::parseDistance(uint8_t *pData)
+void Lpf2Hub::parseCombinedSensorMessage(uint8_t *pData, size_t length)
 {
-    int partial = pData[7];
-    double distance = (double)pData[5];
-    if (partial > 0)
+    CombinedValueMessageView message(pData, length);
+    byte portNumber = message.portNumber();
+    Device portDevice;
+    if (!getPortDevice(portNumber, &portDevice))
     {
-        distance += 1.0 / partial;
+        countUnknownPort(portNumber);
+        return;
+    }
+    const Device *device = &portDevice;
+
+    // bit n of the pointer is set if the value of the n-th mode/dataset entry is contained
+    uint16_t datasetPointer = message.datasetPointer();
+    size_t offset = message.valueOffset();
+    PortValueSlot *slot = getPortValueSlot(portNumber);
+    int32_t values[LPF2_MAX_PORT_VALUE_DATASETS] = {0};
+    if (slot != nullptr && slot->Value.Mode == LPF2_COMBINED_MODE)
+    {
+        // datasets which are not part of the update keep their last value
+        memcpy(values, slot->Value.Values, sizeof(values));
+    }
+    for (int idx = 0; idx < device->CombinedModeDatasetCount; idx++)
+    {
+        if (!(datasetPointer & (1 << idx)))
+        {
+            continue;
+        }
+        byte valueSize = device->CombinedModeValueSizes[idx];
+        if (!message.contains(offset, valueSize))
+        {
+            log_hot_w("combined value message of port %x is too short", portNumber);
+            _hubStatistics.Drops++;
+            return;
+        }
+
+        int32_t value;
+        if (valueSize == 1)
+        {
+            value = message.readInt8(offset);
+        }
+        else if (valueSize == 2)
+        {
+            value = message.readInt16LE(offset);
+        }
+        else
+        {
+            value = message.readInt32LE(offset);
+        }
+        offset += valueSize;
+        if (idx < LPF2_MAX_PORT_VALUE_DATASETS)
+        {
+            values[idx] = value;
+        }
+
+        byte mode = device->CombinedModeDatasets[idx] >> 4;
+        byte dataset = device->CombinedModeDatasets[idx] & 0x0F;
+        if (device->CombinedCallback != nullptr)
+        {
+            device->CombinedCallback(this, portNumber, (DeviceType)device->DeviceType, mode, dataset, value);
+        }
+        else
+        {
+            log_hot_d("port %x mode %x dataset %d value: %d", portNumber, mode, dataset, value);
+        }
+    }
+
+    if (slot != nullptr)
+    {
+        writePortValue(slot, device->DeviceType, LPF2_COMBINED_MODE, values, min(device->CombinedModeDatasetCount, (byte)LPF2_MAX_PORT_VALUE_DATASETS));
     }
-    distance = floor(distance * 25.4) - 20.0;
-    log_d("distance : %d", distance);
-    return distance;
 }
 
 /**
- * @brief Parse detected color value of a color sensor
+ * @brief Parse the incoming characteristic notification for a Device Info Message. If a callback
+ * is registered, the callback is called, otherwise the decoder of the hub property is used
  * @param [in] pData The pointer to the received data
- * @return detected color (Encoded in Color enum of lego definition)
+ * @param [in] length The length of the message (0: taken from the length header)
  */
-int Lpf2Hub::parseColor(uint8_t *pData)
+void Lpf2Hub::parseDeviceInfo(uint8_t *pData, size_t length)
 {
-    int color = pData[4];
-    // fix mapping of sensor color data to lego color data
-    // this is only needed for green and purple
-    if (pData[4] == 1 || pData[4] == 5)
+    byte hubProperty = HubPropertyMessageView(pData, length).property();
+    if (_hubPropertyChangeCallback != nullptr)
     {
-        color = color + 1;
+        _hubPropertyChangeCallback(this, (HubPropertyReference)hubProperty, pData);
+        return;
+    }
+
+    if (hubProperty < LPF2_MAX_HUB_PROPERTIES && hubPropertyDecoders[hubProperty] != nullptr)
+    {
+        hubPropertyDecoders[hubProperty](this, (HubPropertyReference)hubProperty, pData);
     }
-    log_d("color: %s (%d)", LegoinoCommon::ColorStringFromColor(color).c_str(), color);
-    return color;
 }
 
 /**
- * @brief Parse detected reflectivity value of a duplo train hub color sensor
+ * @brief Parse the incoming characteristic notification for a Port Message
  * @param [in] pData The pointer to the received data
- * @return reflectivity [%]
+ * @param [in] length The length of the message (0: taken from the length header)
  */
-int Lpf2Hub::parseReflectivity(uint8_t *pData)
+void Lpf2Hub::parsePortMessage(uint8_t *pData, size_t length)
 {
-    int reflectivity = pData[4];
-    log_d("reflectivity: %d [%]", reflectivity);
-    return reflectivity;
+    AttachedIoMessageView message(pData, length);
+    byte port = message.portNumber();
+    bool isConnected = (message.event() == 1 || message.event() == 2) ? true : false;
+    if (isConnected && !message.hasDeviceType())
+    {
+        log_w("attached io message of port %x without device type", port);
+        return;
+    }
+    if (isConnected)
+    {
+        log_d("port %x is connected with device %x", port, message.deviceType());
+        registerPortDevice(port, message.deviceType());
+        portENTER_CRITICAL(&_stateLock);
+        byte deviceIndex = _portDeviceIndex[port];
+        if (message.event() == Event::ATTACHED_IO && deviceIndex != LPF2_NO_DEVICE_INDEX)
+        {
+            // the capabilities of a device depend on its firmware, virtual ports are not discovered
+            connectedDevices[deviceIndex].SoftwareVersion = message.softwareVersion();
+            connectedDevices[deviceIndex].IsDiscoveryPending = true;
+        }
+        portEXIT_CRITICAL(&_stateLock);
+        if (message.event() == Event::ATTACHED_VIRTUAL_IO && message.contains(8, 1))
+        {
+            attachVirtualPort(port, message.virtualPortA(), message.virtualPortB());
+        }
+    }
+    else
+    {
+        log_d("port %x is disconnected", port);
+        deregisterPortDevice(port);
+        detachVirtualPort(port);
+    }
 }
 
 /**
- * @brief Parse button state value of a button sensor
+ * @brief Parse the incoming characteristic notification for a Port Input Format Message. This
+ * message is the acknowledge of the hub for a port input format setup and contains the
+ * input format which is currently active on the port
  * @param [in] pData The pointer to the received data
- * @return button state
+ * @param [in] length The length of the message (0: taken from the length header)
  */
-ButtonState Lpf2Hub::parseRemoteButton(uint8_t *pData)
+void Lpf2Hub::parsePortInputFormat(uint8_t *pData, size_t length)
 {
-    int buttonState = pData[4];
-    log_d("remote button state: %x", buttonState);
-    return (ButtonState)buttonState;
+    PortInputFormatMessageView message(pData, length);
+    if (!message.contains(9, 1))
+    {
+        return;
+    }
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[message.portNumber()];
+    if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+    {
+        Device *device = &connectedDevices[deviceIndex];
+        device->HasInputFormat = true;
+        device->Mode = message.mode();
+        device->DeltaInterval = message.deltaInterval();
+        device->NotificationEnabled = message.notificationEnabled();
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    if (deviceIndex == LPF2_NO_DEVICE_INDEX)
+    {
+        _hubStatistics.UnknownPorts++;
+    }
 }
 
 /**
- * @brief Parse advertising name of hub
+ * @brief Parse the incoming characteristic notification for a Port Information Message. The mode info
+ * is stored in the capabilities of the port discovery if it is the reply of the outstanding request
  * @param [in] pData The pointer to the received data
- * @return advertising name
+ * @param [in] length The length of the message (0: taken from the length header)
  */
-std::string Lpf2Hub::parseHubAdvertisingName(uint8_t *pData)
+void Lpf2Hub::parsePortInformation(uint8_t *pData, size_t length)
 {
-    int charArrayLength = min(pData[0] - 5, 14);
-    char name[charArrayLength + 1];
-    for (int i = 0; i < charArrayLength; i++)
+    PortInformationMessageView message(pData, length);
+    if (message.portNumber() != _discoveryPort || _discoveryInformationType != LPF2_DISCOVERY_PORT_INFORMATION ||
+        message.informationType() != (byte)PortInformationType::MODE_INFO || !message.contains(9, 2) ||
+        _isDiscoveryReplyReceived.load(std::memory_order_acquire))
     {
-        name[i] = pData[5 + i];
+        return;
     }
-    name[charArrayLength + 1] = 0;
-    log_d("advertising name: %s", name);
-    return std::string(name);
+    _discovery.Capabilities = message.capabilities();
+    _discovery.ModeCount = message.modeCount();
+    _discovery.InputModes = message.inputModes();
+    _discovery.OutputModes = message.outputModes();
+    _isDiscoveryReplyReceived.store(true, std::memory_order_release);
 }
 
 /**
- * @brief Parse button state of hub button
+ * @brief Parse the incoming characteristic notification for a Port Mode Information Message. The raw range,
+ * SI range or value format is stored in the capabilities of the port discovery if it is the reply of the
+ * outstanding request
  * @param [in] pData The pointer to the received data
- * @return button state
+ * @param [in] length The length of the message (0: taken from the length header)
  */
-ButtonState Lpf2Hub::parseHubButton(uint8_t *pData)
+void Lpf2Hub::parsePortModeInformation(uint8_t *pData, size_t length)
 {
-    int buttonState = pData[5];
-    log_d("hub button state: %x", buttonState);
-    return (ButtonState)buttonState;
-}
-
-/**
- * @brief Parse sw or hw version
+    PortModeInformationMessageView message(pData, length);
+    if (message.portNumber() != _discoveryPort || message.mode() != _discoveryMode ||
+        message.informationType() != _discoveryInformationType || message.mode() >= LPF2_MAX_DISCOVERED_MODES ||
+        _isDiscoveryReplyReceived.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    ModeCapabilities *mode = &_discovery.Modes[message.mode()];
+    switch ((ModeInformationType)message.informationType())
+    {
+    case ModeInformationType::RAW:
+    case ModeInformationType::SI:
+        if (!message.contains(6, 8))
+        {
+            return;
+        }
+        if (message.informationType() == (byte)ModeInformationType::RAW)
+        {
+            mode->RawMin = message.rangeMin();
+            mode->RawMax = message.rangeMax();
+        }
+        else
+        {
+            mode->SiMin = message.rangeMin();
+            mode->SiMax = message.rangeMax();
+        }
+        break;
+    case ModeInformationType::VALUE_FORMAT:
+        if (!message.contains(6, 4) || message.datasetType() > (byte)DatasetType::FLOAT)
+        {
+            return;
+        }
+        mode->Datasets = message.datasets();
+        mode->Type = (DatasetType)message.datasetType();
+        mode->Figures = message.figures();
+        mode->Decimals = message.decimals();
+        break;
+    default:
+        return;
+    }
+    _isDiscoveryReplyReceived.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Parse Mario pant sensor 
  * @param [in] pData The pointer to the received data
- * @return version structure (Major-Minor-Bugfix, Build)
+ * @return Pant type
  */
-Version Lpf2Hub::parseVersion(uint8_t *pData)
+MarioPant Lpf2Hub::parseMarioPant(uint8_t *pData)
 {
-    Version version;
-    version.Build = LegoinoCommon::ReadUInt16LE(pData, 5);
-    version.Major = LegoinoCommon::ReadUInt8(pData, 8) >> 4;
-    version.Minor = LegoinoCommon::ReadUInt8(pData, 8) & 0xf;
-    version.Bugfix = LegoinoCommon::ReadUInt8(pData, 7);
-
-    return version;
+    int value = PortValueMessageView(pData).valueInt8();
+    log_hot_d("Mario Pant: %d", value);
+    return (MarioPant)value;
 }
 
 /**
- * @brief Parse RSSI value
+ * @brief Parse Mario gesture sensor 
  * @param [in] pData The pointer to the received data
- * @return RSSI value in dB
+ * @return Gesture
  */
-int Lpf2Hub::parseRssi(uint8_t *pData)
+MarioGesture Lpf2Hub::parseMarioGesture(uint8_t *pData)
 {
-    int rssi = LegoinoCommon::ReadInt8(pData, 5);
-    log_d("rssi: %d", rssi);
-    return rssi;
+    int value = PortValueMessageView(pData).valueInt16LE();
+    log_hot_d("Mario Gesture: %d", value);
+    return (MarioGesture)value;
 }
 
 /**
- * @brief Parse battery level of hub
+ * @brief Parse Mario barcode  sensor 
  * @param [in] pData The pointer to the received data
- * @return battery level in [%]
+ * @return MarioBarcode
  */
-uint8_t Lpf2Hub::parseBatteryLevel(uint8_t *pData)
+MarioBarcode Lpf2Hub::parseMarioBarcode(uint8_t *pData)
 {
-    uint8_t batteryLevel = LegoinoCommon::ReadUInt8(pData, 5);
-    log_d("battery level: %d", batteryLevel);
-    return batteryLevel;
+    int value = PortValueMessageView(pData).valueInt16LE();
+    log_hot_d("Mario Barcode: %d", value);
+    return MarioBarcode(value);
 }
 
 /**
- * @brief Parse battery type of hub
+ * @brief Parse Mario color sensor 
  * @param [in] pData The pointer to the received data
- * @return battery type (0=normal, 1=recharchable)
+ * @return MarioColor
  */
-byte Lpf2Hub::parseBatteryType(uint8_t *pData)
+MarioColor Lpf2Hub::parseMarioColor(uint8_t *pData)
 {
-    byte batteryType = pData[5];
-    log_d("battery type: %x", batteryType);
-    return batteryType;
+    int value = PortValueMessageView(pData).valueInt16LE(2);
+    log_hot_d("Mario Color: %d", value);
+    return (MarioColor)value;
 }
 
 /**
- * @brief Parse system type id of hub
+ * @brief Parse boost hub tilt sensor message (x axis)
  * @param [in] pData The pointer to the received data
- * @return system type id
+ * @return Degrees of rotation/tilt around the x axis
  */
-uint8_t Lpf2Hub::parseSystemTypeId(uint8_t *pData)
+int Lpf2Hub::parseBoostTiltSensorX(uint8_t *pData)
 {
-    uint8_t systemTypeId = LegoinoCommon::ReadUInt8(pData, 5);
-    return systemTypeId;
+    int value = PortValueMessageView(pData).valueInt8();
+    log_hot_d("tilt x: %d", value);
+    return value;
 }
 
 /**
- * @brief Get the update mode dependent on the device type
+ * @brief Parse boost hub tilt sensor message (y axis)
  * @param [in] pData The pointer to the received data
- * @return Update mode
+ * @return Degrees of rotation/tilt around the y axis
  */
-byte Lpf2Hub::getModeForDeviceType(byte deviceType)
-{
-    switch (deviceType)
-    {
-    case (byte)DeviceType::SIMPLE_MEDIUM_LINEAR_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::TRAIN_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::MEDIUM_LINEAR_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::MOVE_HUB_MEDIUM_LINEAR_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::COLOR_DISTANCE_SENSOR:
-        return 0x08;
-    case (byte)DeviceType::MOVE_HUB_TILT_SENSOR:
-        return 0x00;
-    case (byte)DeviceType::TECHNIC_MEDIUM_ANGULAR_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::TECHNIC_LARGE_ANGULAR_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::TECHNIC_LARGE_LINEAR_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::TECHNIC_XLARGE_LINEAR_MOTOR:
-        return (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM;
-    case (byte)DeviceType::MARIO_HUB_GESTURE_SENSOR:
-        return 0x01;
-    default:
-        return 0x00;
-    }
+int Lpf2Hub::parseBoostTiltSensorY(uint8_t *pData)
+{
+    int value = PortValueMessageView(pData).valueInt8(1);
+    log_hot_d("tilt y: %d", value);
+    return value;
 }
 
 /**
- * @brief Parse the incoming characteristic notification for a Sensor Message if a callback 
- * is registered, the callback of that connected device is called with the received data
+ * @brief Parse control plus hub tilt sensor message (x axis)
  * @param [in] pData The pointer to the received data
+ * @return Degrees of rotation/tilt around the x axis
  */
-void Lpf2Hub::parseSensorMessage(uint8_t *pData)
+int Lpf2Hub::parseControlPlusHubTiltSensorX(uint8_t *pData)
 {
-    int deviceIndex = getDeviceIndexForPortNumber(pData[3]);
-    if (deviceIndex < 0)
-    {
-        return;
-    }
-
-    byte deviceType = connectedDevices[deviceIndex].DeviceType;
-
-    if (connectedDevices[deviceIndex].Callback != nullptr)
-    {
-        connectedDevices[deviceIndex].Callback(this, pData[3], (DeviceType)deviceType, pData);
-        return;
-    }
-
-    if (deviceType == (byte)DeviceType::CURRENT_SENSOR)
-    {
-        parseCurrentSensor(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::VOLTAGE_SENSOR)
-    {
-        parseVoltageSensor(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::MEDIUM_LINEAR_MOTOR || deviceType == (byte)DeviceType::MOVE_HUB_MEDIUM_LINEAR_MOTOR)
-    {
-        parseTachoMotor(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::DUPLO_TRAIN_BASE_SPEEDOMETER)
-    {
-        parseSpeedometer(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::DUPLO_TRAIN_BASE_COLOR_SENSOR)
-    {
-        parseColor(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::COLOR_DISTANCE_SENSOR)
-    {
-        parseDistance(pData);
-        parseColor(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::MOVE_HUB_TILT_SENSOR)
-    {
-        parseBoostTiltSensorX(pData);
-        parseBoostTiltSensorY(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::TECHNIC_MEDIUM_HUB_TILT_SENSOR)
-    {
-        parseControlPlusHubTiltSensorX(pData);
-        parseControlPlusHubTiltSensorY(pData);
-        parseControlPlusHubTiltSensorZ(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::REMOTE_CONTROL_BUTTON)
-    {
-        int port = pData[3];
-        parseRemoteButton(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::MARIO_HUB_GESTURE_SENSOR)
-    {
-        int port = pData[3];
-        parseMarioGesture(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::MARIO_HUB_BARCODE_SENSOR)
-    {
-        int port = pData[3];
-        parseMarioBarcode(pData);
-        parseMarioColor(pData);
-        return;
-    }
-    else if (deviceType == (byte)DeviceType::MARIO_HUB_PANT_SENSOR)
-    {
-        int port = pData[3];
-        parseMarioPant(pData);
-        return;
-    }
+    int value = PortValueMessageView(pData).valueInt16LE();
+    log_hot_d("tilt x: %d", value);
+    return value;
 }
 
 /**
- * @brief Parse the incoming characteristic notification for a Port Action Message
+ * @brief Parse control plus hub tilt sensor message (y axis)
  * @param [in] pData The pointer to the received data
+ * @return Degrees of rotation/tilt around the y axis
  */
-void Lpf2Hub::parsePortAction(uint8_t *pData)
+int Lpf2Hub::parseControlPlusHubTiltSensorY(uint8_t *pData)
 {
-    log_d("parsePortAction");
+    int value = PortValueMessageView(pData).valueInt16LE(2);
+    log_hot_d("tilt y: %d", value);
+    return value;
 }
 
 /**
- * @brief Callback function for notifications of a specific characteristic
- * @param [in] pBLERemoteCharacteristic The pointer to the characteristic
+ * @brief Parse control plus hub tilt sensor message (z axis)
  * @param [in] pData The pointer to the received data
- * @param [in] length The length of the data array
- * @param [in] isNotify 
+ * @return Degrees of rotation/tilt around the z axis
  */
-void Lpf2Hub::notifyCallback(
-    NimBLERemoteCharacteristic *pBLERemoteCharacteristic,
-    uint8_t *pData,
-    size_t length,
-    bool isNotify)
+int Lpf2Hub::parseControlPlusHubTiltSensorZ(uint8_t *pData)
 {
-    log_d("notify callback for characteristic %s", pBLERemoteCharacteristic->getUUID().toString().c_str());
-
-    switch (pData[2])
-    {
-    case (byte)MessageType::HUB_PROPERTIES:
-    {
-        parseDeviceInfo(pData);
-        break;
-    }
-    case (byte)MessageType::HUB_ATTACHED_IO:
-    {
-        parsePortMessage(pData);
-        break;
-    }
-    case (byte)MessageType::PORT_VALUE_SINGLE:
-    {
-        parseSensorMessage(pData);
-        break;
-    }
-    case (byte)MessageType::PORT_OUTPUT_COMMAND_FEEDBACK:
-    {
-        parsePortAction(pData);
-        break;
-    }
-    }
+    int value = PortValueMessageView(pData).valueInt16LE(4);
+    log_hot_d("tilt z: %d", value);
+    return value;
 }
 
 /**
- * @brief Constructor
+ * @brief Parse current value [mA] of a current sensor message
+ * @param [in] pData The pointer to the received data
+ * @return current value in unit mA
  */
-Lpf2Hub::Lpf2Hub(){};
+double Lpf2Hub::parseCurrentSensor(uint8_t *pData)
+{
+    int currentRaw = PortValueMessageView(pData).valueUInt16LE();
+    double current = (double)currentRaw * LPF2_CURRENT_MAX / LPF2_CURRENT_MAX_RAW;
+    log_hot_d("current value: %.2f [mA]", current);
+    return current;
+}
 
 /**
- * @brief Init function set the UUIDs and scan for the Hub
+ * @brief Parse Voltage value [V] of a voltage sensor message
+ * @param [in] pData The pointer to the received data
+ * @return voltage in unit volt
  */
-void Lpf2Hub::init()
+double Lpf2Hub::parseVoltageSensor(uint8_t *pData)
 {
-    _isConnected = false;
-    _isConnecting = false;
-    _bleUuid = BLEUUID(LPF2_UUID);
-    _charachteristicUuid = BLEUUID(LPF2_CHARACHTERISTIC);
-    _hubType = HubType::UNKNOWNHUB;
-
-    BLEDevice::init("");
-    pBLEScan = BLEDevice::getScan();
-
-    pBLEScan->setAdvertisedDeviceCallbacks(new Lpf2HubAdvertisedDeviceCallbacks(this));
-
-    pBLEScan->setActiveScan(true);
-    // start method with callback function to enforce the non blocking scan. If no callback function is used,
-    // the scan starts in a blocking manner
-    pBLEScan->start(_scanDuration, scanEndedCallback);
+    int voltageRaw = PortValueMessageView(pData).valueUInt16LE();
+    double voltage = (double)voltageRaw * LPF2_VOLTAGE_MAX / LPF2_VOLTAGE_MAX_RAW;
+    log_hot_d("voltage value: %.2f [V]", voltage);
+    return voltage;
 }
 
 /**
- * @brief Init function set the UUIDs and scan for the Hub
- * @param [in] deviceAddress to which the arduino should connect represented by a hex string of the format: 00:00:00:00:00:00
+ * @brief Parse current value [mA] of a current sensor message with integer math (fixed point scaling)
+ * @param [in] pData The pointer to the received data
+ * @return current value in unit mA
  */
-void Lpf2Hub::init(std::string deviceAddress)
+int Lpf2Hub::parseCurrentSensorMilliAmps(uint8_t *pData)
 {
-    _requestedDeviceAddress = new BLEAddress(deviceAddress);
-    init();
+    uint32_t currentRaw = PortValueMessageView(pData).valueUInt16LE();
+    int current = (int)((currentRaw * LPF2_CURRENT_SCALE_Q16 + 0x8000) >> 16);
+    log_hot_d("current value: %d [mA]", current);
+    return current;
 }
 
 /**
- * @brief Init function set the BLE scan duration (default value 5s)
- * @param [in] BLE scan durtation in unit seconds
+ * @brief Parse Voltage value [mV] of a voltage sensor message with integer math (fixed point scaling)
+ * @param [in] pData The pointer to the received data
+ * @return voltage in unit millivolt
  */
-void Lpf2Hub::init(uint32_t scanDuration)
+int Lpf2Hub::parseVoltageSensorMilliVolts(uint8_t *pData)
 {
-    _scanDuration = scanDuration;
-    init();
+    uint32_t voltageRaw = PortValueMessageView(pData).valueUInt16LE();
+    // 64 bit product, the scaling factor exceeds 16 bit
+    int voltage = (int)(((uint64_t)voltageRaw * LPF2_VOLTAGE_SCALE_Q16 + 0x8000) >> 16);
+    log_hot_d("voltage value: %d [mV]", voltage);
+    return voltage;
 }
 
 /**
- * @brief Init function set the BLE scan duration (default value 5s)
- * @param [in] deviceAddress to which the arduino should connect represented by a hex string of the format: 00:00:00:00:00:00
- * @param [in] BLE scan durtation in unit seconds
+ * @brief Parse rotation value [degrees] of a tacho motor
+ * @param [in] pData The pointer to the received data
+ * @return rotaton in unit degrees (+/-)
  */
-void Lpf2Hub::init(std::string deviceAddress, uint32_t scanDuration)
+int Lpf2Hub::parseTachoMotor(uint8_t *pData)
 {
-    _requestedDeviceAddress = new BLEAddress(deviceAddress);
-    _scanDuration = scanDuration;
-    init();
+    int value = PortValueMessageView(pData).valueInt32LE();
+    log_hot_d("rotation value: %d [degrees]", value);
+    return value;
 }
 
 /**
- * @brief Get the address of the HUB (server address)
- * @return HUB Address
+ * @brief Parse speed value of a duplo train hub
+ * @param [in] pData The pointer to the received data
+ * @return speed value
  */
-NimBLEAddress Lpf2Hub::getHubAddress()
+int Lpf2Hub::parseSpeedometer(uint8_t *pData)
 {
-    NimBLEAddress pAddress = *_pServerAddress;
-    return pAddress;
+    int value = PortValueMessageView(pData).valueInt16LE();
+    log_hot_d("speedometer value: %d ", value);
+    return value;
 }
 
 /**
- * @brief Get the array index of a specific connected device on a defined port in the connectedDevices array
- * @param [in] port number
- * @return array index of the connected device
+ * @brief Parse distance value [millimeters] of a distance sensor
+ * @param [in] pData The pointer to the received data
+ * @return distance in unit millimeters
  */
-int Lpf2Hub::getDeviceIndexForPortNumber(byte portNumber)
+double Lpf2Hub::parseDistance(uint8_t *pData)
 {
-    log_d("Number of connected devices: %d", numberOfConnectedDevices);
-    for (int idx = 0; idx < numberOfConnectedDevices; idx++)
+    PortValueMessageView message(pData);
+    int partial = message.valueUInt8(3);
+    double distance = (double)message.valueUInt8(1);
+    if (partial > 0)
     {
-        log_v("device %d, port number: %x, device type: %x, callback address: %x", idx, connectedDevices[idx].PortNumber, connectedDevices[idx].DeviceType, connectedDevices[idx].Callback);
-        if (connectedDevices[idx].PortNumber == portNumber)
-        {
-            log_d("device on port %x has index %d", portNumber, idx);
-            return idx;
-        }
+        distance += 1.0 / partial;
     }
-    log_w("no device found for port number %x", portNumber);
-    return -1;
+    distance = floor(distance * 25.4) - 20.0;
+    log_hot_d("distance : %.2f", distance);
+    return distance;
 }
 
 /**
- * @brief Get the device type of a specific connected device on a defined port in the connectedDevices array
- * @param [in] port number
- * @return device type of the connected device
+ * @brief Parse distance value [millimeters] of a distance sensor with integer math (same result as parseDistance)
+ * @param [in] pData The pointer to the received data
+ * @return distance in unit millimeters
  */
-byte Lpf2Hub::getDeviceTypeForPortNumber(byte portNumber)
+int Lpf2Hub::parseDistanceMillimeters(uint8_t *pData)
 {
-    log_d("Number of connected devices: %d", numberOfConnectedDevices);
-    for (int idx = 0; idx < numberOfConnectedDevices; idx++)
+    PortValueMessageView message(pData);
+    int partial = message.valueUInt8(3);
+    int distance = message.valueUInt8(1);
+    // (distance + 1 / partial) inch in unit 0.1 mm, rounded down to mm
+    if (partial > 0)
     {
-        log_v("device %d, port number: %x, device type: %x, callback address: %x", idx, connectedDevices[idx].PortNumber, connectedDevices[idx].DeviceType, connectedDevices[idx].Callback);
-        if (connectedDevices[idx].PortNumber == portNumber)
-        {
-            log_d("device on port %x has type %x", portNumber, connectedDevices[idx].DeviceType);
-            return connectedDevices[idx].DeviceType;
-        }
+        distance = ((distance * partial + 1) * 254) / (10 * partial);
+    }
+    else
+    {
+        distance = (distance * 254) / 10;
     }
-    log_w("no device found for port number %x", portNumber);
-    return (byte)DeviceType::UNKNOWNDEVICE;
+    distance -= 20;
+    log_hot_d("distance : %d", distance);
+    return distance;
 }
 
 /**
- * @brief Get the port where a specific device is connected
- * @param [in] device type
- * @return port number if device type is found or 255
+ * @brief Parse detected color value of a color sensor
+ * @param [in] pData The pointer to the received data
+ * @return detected color (Encoded in Color enum of lego definition)
+ */
+int Lpf2Hub::parseColor(uint8_t *pData)
+{
+    int color = PortValueMessageView(pData).valueUInt8();
+    // fix mapping of sensor color data to lego color data
+    // this is only needed for green and purple
+    if (color == 1 || color == 5)
+    {
+        color = color + 1;
+    }
+    log_hot_d("color: %s (%d)", LegoinoCommon::ColorStringFromColor(color).c_str(), color);
+    return color;
+}
+
+/**
+ * @brief Parse detected reflectivity value of a duplo train hub color sensor
+ * @param [in] pData The pointer to the received data
+ * @return reflectivity [%]
+ */
+int Lpf2Hub::parseReflectivity(uint8_t *pData)
+{
+    int reflectivity = PortValueMessageView(pData).valueUInt8();
+    log_hot_d("reflectivity: %d [%%]", reflectivity);
+    return reflectivity;
+}
+
+/**
+ * @brief Parse button state value of a button sensor
+ * @param [in] pData The pointer to the received data
+ * @return button state
+ */
+ButtonState Lpf2Hub::parseRemoteButton(uint8_t *pData)
+{
+    int buttonState = PortValueMessageView(pData).valueUInt8();
+    log_hot_d("remote button state: %x", buttonState);
+    return (ButtonState)buttonState;
+}
+
+/**
+ * @brief Parse advertising name of hub
+ * @param [in] pData The pointer to the received data
+ * @return advertising name
+ */
+std::string Lpf2Hub::parseHubAdvertisingName(uint8_t *pData)
+{
+    HubPropertyMessageView message(pData);
+    // the name is not zero terminated and has a max. length of 14 characters
+    std::string name((const char *)message.payload(), min(message.payloadLength(), (size_t)14));
+    log_hot_d("advertising name: %s", name.c_str());
+    return name;
+}
+
+/**
+ * @brief Parse button state of hub button
+ * @param [in] pData The pointer to the received data
+ * @return button state
+ */
+ButtonState Lpf2Hub::parseHubButton(uint8_t *pData)
+{
+    int buttonState = HubPropertyMessageView(pData).readUInt8(5);
+    log_hot_d("hub button state: %x", buttonState);
+    return (ButtonState)buttonState;
+}
+
+/**
+ * @brief Parse sw or hw version
+ * @param [in] pData The pointer to the received data
+ * @return version structure (Major-Minor-Bugfix, Build)
+ */
+Version Lpf2Hub::parseVersion(uint8_t *pData)
+{
+    HubPropertyMessageView message(pData);
+    Version version;
+    version.Build = message.readUInt16LE(5);
+    version.Major = message.readUInt8(8) >> 4;
+    version.Minor = message.readUInt8(8) & 0xf;
+    version.Bugfix = message.readUInt8(7);
+
+    return version;
+}
+
+/**
+ * @brief Parse RSSI value
+ * @param [in] pData The pointer to the received data
+ * @return RSSI value in dB
+ */
+int Lpf2Hub::parseRssi(uint8_t *pData)
+{
+    int rssi = HubPropertyMessageView(pData).readInt8(5);
+    log_hot_d("rssi: %d", rssi);
+    return rssi;
+}
+
+/**
+ * @brief Parse battery level of hub
+ * @param [in] pData The pointer to the received data
+ * @return battery level in [%]
+ */
+uint8_t Lpf2Hub::parseBatteryLevel(uint8_t *pData)
+{
+    uint8_t batteryLevel = HubPropertyMessageView(pData).readUInt8(5);
+    log_hot_d("battery level: %d", batteryLevel);
+    return batteryLevel;
+}
+
+/**
+ * @brief Parse battery type of hub
+ * @param [in] pData The pointer to the received data
+ * @return battery type (0=normal, 1=recharchable)
+ */
+byte Lpf2Hub::parseBatteryType(uint8_t *pData)
+{
+    byte batteryType = HubPropertyMessageView(pData).readUInt8(5);
+    log_hot_d("battery type: %x", batteryType);
+    return batteryType;
+}
+
+/**
+ * @brief Parse system type id of hub
+ * @param [in] pData The pointer to the received data
+ * @return system type id
+ */
+uint8_t Lpf2Hub::parseSystemTypeId(uint8_t *pData)
+{
+    uint8_t systemTypeId = HubPropertyMessageView(pData).readUInt8(5);
+    return systemTypeId;
+}
+
+/**
+ * @brief Get the update mode dependent on the device type. Device types without a built-in or registered
+ * mode use the first input mode which was discovered by the port discovery
+ * @param [in] deviceType type of the device
+ * @param [in] softwareVersion firmware of the device or LPF2_ANY_SOFTWARE_VERSION
+ * @return Update mode
+ */
+byte Lpf2Hub::getModeForDeviceType(byte deviceType, uint32_t softwareVersion)
+{
+    if (deviceTypeHasMode[deviceType])
+    {
+        return deviceTypeModes[deviceType];
+    }
+    const DeviceCapabilities *capabilities = findDeviceCapabilities(deviceType, softwareVersion);
+    if (capabilities != nullptr && capabilities->InputModes != 0)
+    {
+        byte mode = 0;
+        while (!(capabilities->InputModes & (1 << mode)))
+        {
+            mode++;
+        }
+        return mode;
+    }
+    return deviceTypeModes[deviceType];
+}
+
+/**
+ * @brief Parse the incoming characteristic notification for a Sensor Message if a callback 
+ * is registered, the callback of that connected device is called with the received data
+ * @param [in] pData The pointer to the received data
+ * @param [in] length The length of the message (0: taken from the length header)
+ */
+void Lpf2Hub::parseSensorMessage(uint8_t *pData, size_t length)
+{
+    byte portNumber = PortValueMessageView(pData, length).portNumber();
+    Device device;
+    if (!getPortDevice(portNumber, &device))
+    {
+        countUnknownPort(portNumber);
+        return;
+    }
+
+    byte deviceType = device.DeviceType;
+    storePortValue(&device, pData, length);
+
+    if (device.Callback != nullptr)
+    {
+        device.Callback(this, portNumber, (DeviceType)deviceType, pData);
+        return;
+    }
+
+    PortValueChangeCallback decoder = deviceTypeDecoders[deviceType];
+    if (decoder != nullptr)
+    {
+        decoder(this, portNumber, (DeviceType)deviceType, pData);
+    }
+}
+
+/**
+ * @brief Parse the incoming characteristic notification for a Port Output Command Feedback Message.
+ * The feedback of each port is stored and the number of commands in flight is reduced for completed
+ * or discarded commands (reset if the port is idle)
+ * @param [in] pData The pointer to the received data
+ * @param [in] length The length of the message (0: taken from the length header)
+ */
+void Lpf2Hub::parsePortAction(uint8_t *pData, size_t length)
+{
+    CommandFeedbackMessageView message(pData, length);
+    for (size_t idx = 0; idx < message.numberOfPorts(); idx++)
+    {
+        byte portNumber = message.portNumber(idx);
+        byte feedback = message.feedback(idx);
+        log_hot_d("port %x feedback %x", portNumber, feedback);
+        if (isPortDeviceRegistered(portNumber))
+        {
+            _portCommandFeedback[portNumber].store(feedback, std::memory_order_relaxed);
+            std::atomic<uint8_t> *commandsInFlight = &_portCommandsInFlight[portNumber];
+            if (feedback & (byte)CommandFeedback::IDLE)
+            {
+                commandsInFlight->store(0, std::memory_order_relaxed);
+            }
+            else if (feedback & ((byte)CommandFeedback::BUFFER_EMPTY_COMMAND_COMPLETED | (byte)CommandFeedback::COMMAND_DISCARDED))
+            {
+                uint8_t count = commandsInFlight->load(std::memory_order_relaxed);
+                while (count > 0 && !commandsInFlight->compare_exchange_weak(count, count - 1, std::memory_order_relaxed))
+                {
+                }
+            }
+        }
+        resolveTrackedCommands(portNumber, feedback);
+        if (_portCommandFeedbackCallback != nullptr)
+        {
+            _portCommandFeedbackCallback(this, portNumber, feedback);
+        }
+    }
+}
+
+/**
+ * @brief Count a port output command which requests a feedback as command in flight of the port
+ * @param [in] pData encoded message including the common header
+ * @param [in] length length of the message
+ */
+void Lpf2Hub::trackPortOutputCommand(const uint8_t *pData, size_t length)
+{
+    // header, port, startup and completion information (bit 0: command feedback)
+    if (length < 5 || pData[(byte)MessageHeader::MESSAGE_TYPE] != (byte)MessageType::PORT_OUTPUT_COMMAND || !(pData[4] & 0x01))
+    {
+        return;
+    }
+    if (!isPortDeviceRegistered(pData[3]))
+    {
+        return;
+    }
+    // the feedback of the BLE task could decrement the counter at the same time
+    std::atomic<uint8_t> *commandsInFlight = &_portCommandsInFlight[pData[3]];
+    uint8_t count = commandsInFlight->load(std::memory_order_relaxed);
+    while (count < 255 && !commandsInFlight->compare_exchange_weak(count, count + 1, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * @brief Reset the command feedback and the commands in flight of a port (new device or connection loss)
+ * @param [in] portNumber port number
+ */
+void Lpf2Hub::resetPortCommandFeedback(byte portNumber)
+{
+    _portCommandFeedback[portNumber].store(0, std::memory_order_relaxed);
+    _portCommandsInFlight[portNumber].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Reset the command feedback and the commands in flight of all ports. This method will be called if the
+ * hub is disconnected, because the hub drops the running and buffered commands and sends no feedback for them
+ */
+void Lpf2Hub::resetPortCommandFeedbacks()
+{
+    for (int port = 0; port < 256; port++)
+    {
+        resetPortCommandFeedback(port);
+    }
+}
+
+/**
+ * @brief Start the tracking of a command which was just written to a port
+ * @param [in] portNumber port number of the command
+ * @return handle of the command (not valid if all tracking slots are pending)
+ */
+Lpf2CommandHandle Lpf2Hub::trackCommand(byte portNumber)
+{
+    uint16_t id = 0;
+    portENTER_CRITICAL(&_stateLock);
+    byte slot = allocateTrackedCommand(portNumber);
+    if (slot != LPF2_NO_TRACKED_COMMAND)
+    {
+        markTrackedCommandSent(slot);
+        id = _trackedCommands[slot].Id;
+    }
+    portEXIT_CRITICAL(&_stateLock);
+
+    if (slot == LPF2_NO_TRACKED_COMMAND)
+    {
+        log_w("max number of tracked commands reached: %d", LPF2_MAX_TRACKED_COMMANDS);
+        return Lpf2CommandHandle();
+    }
+    return Lpf2CommandHandle(this, slot, id);
+}
+
+/**
+ * @brief Allocate a tracking slot for a command which is not sent yet. The state lock has to be held by the caller
+ * @param [in] portNumber port number of the command
+ * @return tracking slot or LPF2_NO_TRACKED_COMMAND if all slots are pending
+ */
+byte Lpf2Hub::allocateTrackedCommand(byte portNumber)
+{
+    for (int count = 0; count < LPF2_MAX_TRACKED_COMMANDS; count++)
+    {
+        byte slot = _nextTrackedCommandSlot;
+        _nextTrackedCommandSlot = (_nextTrackedCommandSlot + 1) % LPF2_MAX_TRACKED_COMMANDS;
+        TrackedCommand *command = &_trackedCommands[slot];
+        if (command->Id != 0 && command->State == CommandState::PENDING)
+        {
+            continue;
+        }
+        uint16_t id = _nextTrackedCommandId++;
+        if (_nextTrackedCommandId == 0)
+        {
+            // id 0 marks an unused slot
+            _nextTrackedCommandId = 1;
+        }
+        *command = {id, portNumber, CommandState::PENDING, false, 0, 0, 0, nullptr};
+        return slot;
+    }
+    return LPF2_NO_TRACKED_COMMAND;
+}
+
+/**
+ * @brief Mark a tracked command as sent. The send order is used to resolve the commands with the feedback.
+ * The state lock has to be held by the caller
+ * @param [in] slot tracking slot of the command
+ */
+void Lpf2Hub::markTrackedCommandSent(byte slot)
+{
+    TrackedCommand *command = &_trackedCommands[slot];
+    command->IsSent = true;
+    command->Sequence = _nextTrackedCommandSequence++;
+    command->StartTime = millis();
+}
+
+/**
+ * @brief Get the number of sent commands of a port which are not done. Sent commands without a tracking slot
+ * are only counted by the commands in flight of the port device. The state lock has to be held by the caller
+ * @param [in] portNumber port number
+ * @return number of pending sent commands
+ */
+int Lpf2Hub::getSentCommandCount(byte portNumber)
+{
+    int count = 0;
+    for (int slot = 0; slot < LPF2_MAX_TRACKED_COMMANDS; slot++)
+    {
+        TrackedCommand *command = &_trackedCommands[slot];
+        if (command->Id != 0 && command->State == CommandState::PENDING && command->IsSent && command->PortNumber == portNumber)
+        {
+            count++;
+        }
+    }
+    return max(count, (int)_portCommandsInFlight[portNumber].load(std::memory_order_relaxed));
+}
+
+/**
+ * @brief Write a motor command directly or put it into the client side queue of the port (if the queueing is enabled).
+ * For direct writes the startup information is set according to the buffering option
+ * @param [in] message encoded port output command
+ * @param [in] isTracked true to track the completion of a directly written command
+ * @return handle of the command (not valid for untracked commands)
+ */
+Lpf2CommandHandle Lpf2Hub::writePortCommand(Lpf2HubMessage &message, bool isTracked)
+{
+    if (_isCommandQueueing)
+    {
+        return queuePortCommand(message, CommandPriority::NORMAL);
+    }
+    message.setStartupAndCompletion(_isCommandBuffering ? LPF2_STARTUP_BUFFERED_WITH_FEEDBACK : LPF2_STARTUP_IMMEDIATE_WITH_FEEDBACK);
+    WriteValue(message);
+    return isTracked ? trackCommand(message.data()[3]) : Lpf2CommandHandle();
+}
+
+/**
+ * @brief Enable or disable the buffering of motor commands on the hub. By default a new command is executed
+ * immediately and replaces a running command. With buffering, a new command is executed after the running
+ * command is completed
+ * @param [in] enabled true to buffer the commands on the hub
+ */
+void Lpf2Hub::setCommandBuffering(bool enabled)
+{
+    _isCommandBuffering = enabled;
+}
+
+/**
+ * @brief Enable or disable the client side queueing of motor commands. If enabled, the motor commands are put
+ * into a queue of the port with the priority NORMAL. The commands of a queue are sent with buffering, so one
+ * command is executed while the next one waits in the buffer of the hub and the commands follow each other
+ * without gaps. poll() has to be called in the loop to send the queued commands
+ * @param [in] enabled true to queue the motor commands
+ */
+void Lpf2Hub::setCommandQueueing(bool enabled)
+{
+    _isCommandQueueing = enabled;
+}
+
+/**
+ * @brief Put a port output command into the client side queue of its port.
+ * EMERGENCY: the queue of the port is flushed, running and buffered commands are discarded and the command is sent immediately.
+ * HIGH: the command is inserted before all commands with priority NORMAL.
+ * NORMAL: the command is appended to the queue.
+ * @param [in] message encoded port output command
+ * @param [in] priority priority class of the command
+ * @return handle of the command (not valid if the queue is full or all tracking slots are pending)
+ */
+Lpf2CommandHandle Lpf2Hub::queuePortCommand(Lpf2HubMessage message, CommandPriority priority)
+{
+    if (!message.isValid() || message.length() < 5 || message.data()[(byte)MessageHeader::MESSAGE_TYPE] != (byte)MessageType::PORT_OUTPUT_COMMAND)
+    {
+        log_w("only port output commands could be queued");
+        return Lpf2CommandHandle();
+    }
+    byte portNumber = message.data()[3];
+
+    if (priority == CommandPriority::EMERGENCY)
+    {
+        // the queued, the running and the buffered commands of the port are replaced by the immediate command
+        CommandCompletion completions[LPF2_MAX_TRACKED_COMMANDS];
+        int numberOfCompletions = 0;
+        portENTER_CRITICAL(&_stateLock);
+        PortCommandQueue *queue = getCommandQueue(portNumber, false);
+        if (queue != nullptr)
+        {
+            flushCommandQueue(queue, CommandState::DISCARDED, completions, &numberOfCompletions);
+        }
+        for (int slot = 0; slot < LPF2_MAX_TRACKED_COMMANDS; slot++)
+        {
+            TrackedCommand *command = &_trackedCommands[slot];
+            if (command->Id != 0 && command->State == CommandState::PENDING && command->IsSent && command->PortNumber == portNumber)
+            {
+                resolveTrackedCommand(command, CommandState::DISCARDED, completions, &numberOfCompletions);
+            }
+        }
+        portEXIT_CRITICAL(&_stateLock);
+        callCompletionCallbacks(completions, numberOfCompletions);
+        message.setStartupAndCompletion(LPF2_STARTUP_IMMEDIATE_WITH_FEEDBACK);
+        WriteValue(message);
+        return trackCommand(portNumber);
+    }
+
+    portENTER_CRITICAL(&_stateLock);
+    PortCommandQueue *queue = getCommandQueue(portNumber, true);
+    if (queue == nullptr || queue->Count >= LPF2_COMMAND_QUEUE_LENGTH)
+    {
+        portEXIT_CRITICAL(&_stateLock);
+        log_w("command queue of port %x is full", portNumber);
+        return Lpf2CommandHandle();
+    }
+    // without a free tracking slot the command is queued anyway, like a direct write without a handle
+    byte slot = allocateTrackedCommand(portNumber);
+    uint16_t id = slot != LPF2_NO_TRACKED_COMMAND ? _trackedCommands[slot].Id : 0;
+
+    int position = queue->Count;
+    if (priority == CommandPriority::HIGH)
+    {
+        position = 0;
+        while (position < queue->Count && queue->Commands[position].Priority == CommandPriority::HIGH)
+        {
+            position++;
+        }
+        memmove(&queue->Commands[position + 1], &queue->Commands[position], (queue->Count - position) * sizeof(QueuedCommand));
+    }
+    QueuedCommand *queuedCommand = &queue->Commands[position];
+    queuedCommand->TrackingSlot = slot;
+    queuedCommand->Priority = priority;
+    queuedCommand->Length = message.length();
+    memcpy(queuedCommand->Data, message.data(), message.length());
+    queuedCommand->Data[4] = LPF2_STARTUP_BUFFERED_WITH_FEEDBACK;
+    queue->Count++;
+    portEXIT_CRITICAL(&_stateLock);
+
+    // send the command without waiting for the next poll if the port could take it
+    serviceCommandQueue(queue);
+    if (slot == LPF2_NO_TRACKED_COMMAND)
+    {
+        log_w("max number of tracked commands reached: %d", LPF2_MAX_TRACKED_COMMANDS);
+        return Lpf2CommandHandle();
+    }
+    return Lpf2CommandHandle(this, slot, id);
+}
+
+/**
+ * @brief Stop a motor immediately. The queue of the port is flushed and all pending commands of the port are discarded
+ * @param [in] port port of the motor
+ */
+void Lpf2Hub::emergencyStop(byte port)
+{
+    queuePortCommand(encodeBasicMotorSpeed(port, 0), CommandPriority::EMERGENCY);
+}
+
+/**
+ * @brief Remove all commands from the client side queue of a port. The removed commands are resolved as DISCARDED
+ * @param [in] port port number
+ */
+void Lpf2Hub::flushCommandQueue(byte port)
+{
+    CommandCompletion completions[LPF2_MAX_TRACKED_COMMANDS];
+    int numberOfCompletions = 0;
+    portENTER_CRITICAL(&_stateLock);
+    PortCommandQueue *queue = getCommandQueue(port, false);
+    if (queue != nullptr)
+    {
+        flushCommandQueue(queue, CommandState::DISCARDED, completions, &numberOfCompletions);
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    callCompletionCallbacks(completions, numberOfCompletions);
+}
+
+/**
+ * @brief Remove all commands from a client side queue and resolve the tracked ones. The state lock has to be
+ * held by the caller
+ * @param [in] queue command queue of a port
+ * @param [in] state final state of the removed commands
+ * @param [in] completions receives the callbacks of the resolved commands
+ * @param [in] numberOfCompletions number of entries in completions
+ */
+void Lpf2Hub::flushCommandQueue(PortCommandQueue *queue, CommandState state, CommandCompletion *completions, int *numberOfCompletions)
+{
+    for (int idx = 0; idx < queue->Count; idx++)
+    {
+        byte slot = queue->Commands[idx].TrackingSlot;
+        if (slot == LPF2_NO_TRACKED_COMMAND)
+        {
+            continue;
+        }
+        TrackedCommand *command = &_trackedCommands[slot];
+        if (command->State == CommandState::PENDING)
+        {
+            resolveTrackedCommand(command, state, completions, numberOfCompletions);
+        }
+    }
+    queue->Count = 0;
+}
+
+/**
+ * @brief Get the number of commands in the client side queue of a port (not sent to the hub yet)
+ * @param [in] port port number
+ * @return number of queued commands
+ */
+int Lpf2Hub::getQueuedCommandCount(byte port)
+{
+    portENTER_CRITICAL(&_stateLock);
+    PortCommandQueue *queue = getCommandQueue(port, false);
+    int count = queue != nullptr ? queue->Count : 0;
+    portEXIT_CRITICAL(&_stateLock);
+    return count;
+}
+
+/**
+ * @brief Get the client side command queue of a port. The state lock has to be held by the caller
+ * @param [in] portNumber port number
+ * @param [in] create true to assign a free queue to the port if the port has no queue
+ * @return queue or nullptr if all queues are in use
+ */
+PortCommandQueue *Lpf2Hub::getCommandQueue(byte portNumber, bool create)
+{
+    for (int idx = 0; idx < _numberOfCommandQueues; idx++)
+    {
+        if (_commandQueues[idx].PortNumber == portNumber)
+        {
+            return &_commandQueues[idx];
+        }
+    }
+    if (!create)
+    {
+        return nullptr;
+    }
+    // reuse an empty queue of another port if all queues are assigned
+    for (int idx = 0; idx < _numberOfCommandQueues; idx++)
+    {
+        if (_commandQueues[idx].Count == 0)
+        {
+            _commandQueues[idx].PortNumber = portNumber;
+            return &_commandQueues[idx];
+        }
+    }
+    if (_numberOfCommandQueues >= LPF2_MAX_COMMAND_QUEUES)
+    {
+        return nullptr;
+    }
+    PortCommandQueue *queue = &_commandQueues[_numberOfCommandQueues++];
+    queue->PortNumber = portNumber;
+    queue->Count = 0;
+    return queue;
+}
+
+/**
+ * @brief Send the next commands of a queue as long as less than LPF2_MAX_BUFFERED_COMMANDS commands of the port
+ * are pending on the hub and the buffer of the port is not full
+ * @param [in] queue command queue of a port
+ */
+void Lpf2Hub::serviceCommandQueue(PortCommandQueue *queue)
+{
+    while (_isConnected)
+    {
+        // the command is taken from the queue under the lock and written after the lock is released
+        QueuedCommand queuedCommand;
+        portENTER_CRITICAL(&_stateLock);
+        bool isSendable = queue->Count > 0 && getSentCommandCount(queue->PortNumber) < LPF2_MAX_BUFFERED_COMMANDS;
+        if (isSendable)
+        {
+            queuedCommand = queue->Commands[0];
+            if (queuedCommand.TrackingSlot != LPF2_NO_TRACKED_COMMAND)
+            {
+                markTrackedCommandSent(queuedCommand.TrackingSlot);
+            }
+            queue->Count--;
+            memmove(&queue->Commands[0], &queue->Commands[1], queue->Count * sizeof(QueuedCommand));
+        }
+        portEXIT_CRITICAL(&_stateLock);
+        if (!isSendable)
+        {
+            return;
+        }
+        writeCharacteristic(queuedCommand.Data, queuedCommand.Length);
+        trackPortOutputCommand(queuedCommand.Data, queuedCommand.Length);
+    }
+}
+
+/**
+ * @brief Send the next commands of all client side queues. Called by poll()
+ */
+void Lpf2Hub::serviceCommandQueues()
+{
+    for (int idx = 0; idx < _numberOfCommandQueues; idx++)
+    {
+        serviceCommandQueue(&_commandQueues[idx]);
+    }
+}
+
+/**
+ * @brief Resolve the tracked commands of a port with a port output command feedback. The commands of a port
+ * are executed in the order they are sent, so completed or discarded feedback resolves the oldest pending command.
+ * If the port is idle, all pending commands of the port are done.
+ * @param [in] portNumber port number
+ * @param [in] feedback CommandFeedback bits
+ */
+void Lpf2Hub::resolveTrackedCommands(byte portNumber, byte feedback)
+{
+    CommandCompletion completions[LPF2_MAX_TRACKED_COMMANDS];
+    int numberOfCompletions = 0;
+    portENTER_CRITICAL(&_stateLock);
+    bool isDiscarded = feedback & (byte)CommandFeedback::COMMAND_DISCARDED;
+    bool isCompleted = feedback & (byte)CommandFeedback::BUFFER_EMPTY_COMMAND_COMPLETED;
+    bool isIdle = feedback & (byte)CommandFeedback::IDLE;
+    while (isDiscarded || isCompleted || isIdle)
+    {
+        TrackedCommand *oldestCommand = nullptr;
+        for (int slot = 0; slot < LPF2_MAX_TRACKED_COMMANDS; slot++)
+        {
+            TrackedCommand *command = &_trackedCommands[slot];
+            if (command->Id != 0 && command->State == CommandState::PENDING && command->IsSent && command->PortNumber == portNumber &&
+                (oldestCommand == nullptr || (int16_t)(command->Sequence - oldestCommand->Sequence) < 0))
+            {
+                oldestCommand = command;
+            }
+        }
+        if (oldestCommand == nullptr)
+        {
+            break;
+        }
+        // a discarded command is replaced by the following command, which is reported as completed
+        if (isDiscarded)
+        {
+            isDiscarded = false;
+            resolveTrackedCommand(oldestCommand, CommandState::DISCARDED, completions, &numberOfCompletions);
+        }
+        else if (isCompleted)
+        {
+            isCompleted = false;
+            resolveTrackedCommand(oldestCommand, CommandState::COMPLETED, completions, &numberOfCompletions);
+        }
+        else
+        {
+            resolveTrackedCommand(oldestCommand, CommandState::COMPLETED, completions, &numberOfCompletions);
+        }
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    callCompletionCallbacks(completions, numberOfCompletions);
+}
+
+/**
+ * @brief Set the final state of a tracked command. The registered callback is moved to the completions, which
+ * are called with callCompletionCallbacks after the state lock is released. The state lock has to be held by the caller
+ * @param [in] command tracked command
+ * @param [in] state final state
+ * @param [out] completions completions of the resolved commands (max LPF2_MAX_TRACKED_COMMANDS)
+ * @param [in,out] numberOfCompletions number of entries in completions
+ */
+void Lpf2Hub::resolveTrackedCommand(TrackedCommand *command, CommandState state, CommandCompletion *completions, int *numberOfCompletions)
+{
+    command->State = state;
+    if (command->Callback != nullptr)
+    {
+        completions[*numberOfCompletions] = {command->Callback, command->PortNumber, state};
+        (*numberOfCompletions)++;
+        command->Callback = nullptr;
+    }
+}
+
+/**
+ * @brief Call the callbacks of resolved commands. Every command is resolved once, so each callback is called once
+ * @param [in] completions completions of the resolved commands
+ * @param [in] numberOfCompletions number of entries in completions
+ */
+void Lpf2Hub::callCompletionCallbacks(const CommandCompletion *completions, int numberOfCompletions)
+{
+    for (int idx = 0; idx < numberOfCompletions; idx++)
+    {
+        completions[idx].Callback(this, completions[idx].PortNumber, completions[idx].State);
+    }
+}
+
+/**
+ * @brief Get the tracked command of a handle. The state lock has to be held by the caller
+ * @param [in] slot tracking slot of the handle
+ * @param [in] id id of the command
+ * @return tracked command or nullptr if the slot is already used by a newer command
+ */
+TrackedCommand *Lpf2Hub::getTrackedCommand(byte slot, uint16_t id)
+{
+    if (slot >= LPF2_MAX_TRACKED_COMMANDS || id == 0 || _trackedCommands[slot].Id != id)
+    {
+        return nullptr;
+    }
+    return &_trackedCommands[slot];
+}
+
+/**
+ * @brief Resolve the pending commands whose timeout is elapsed. Called by poll()
+ */
+void Lpf2Hub::expireTrackedCommands()
+{
+    CommandCompletion completions[LPF2_MAX_TRACKED_COMMANDS];
+    int numberOfCompletions = 0;
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_stateLock);
+    for (int slot = 0; slot < LPF2_MAX_TRACKED_COMMANDS; slot++)
+    {
+        TrackedCommand *command = &_trackedCommands[slot];
+        if (command->Id != 0 && command->State == CommandState::PENDING && command->IsSent && command->Timeout != 0 && now - command->StartTime >= command->Timeout)
+        {
+            resolveTrackedCommand(command, CommandState::TIMED_OUT, completions, &numberOfCompletions);
+        }
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    callCompletionCallbacks(completions, numberOfCompletions);
+}
+
+/**
+ * @brief Resolve the sent commands which are pending as DISCONNECTED. The hub drops the running and buffered
+ * commands with the connection, so no feedback will be received for them. The client side queues are flushed
+ * as well, because the moves would not continue the dropped ones. Called by poll() after a connection loss
+ */
+void Lpf2Hub::abortTrackedCommands()
+{
+    CommandCompletion completions[LPF2_MAX_TRACKED_COMMANDS];
+    int numberOfCompletions = 0;
+    portENTER_CRITICAL(&_stateLock);
+    for (int idx = 0; idx < _numberOfCommandQueues; idx++)
+    {
+        flushCommandQueue(&_commandQueues[idx], CommandState::DISCONNECTED, completions, &numberOfCompletions);
+    }
+    for (int slot = 0; slot < LPF2_MAX_TRACKED_COMMANDS; slot++)
+    {
+        TrackedCommand *command = &_trackedCommands[slot];
+        if (command->Id != 0 && command->State == CommandState::PENDING && command->IsSent)
+        {
+            resolveTrackedCommand(command, CommandState::DISCONNECTED, completions, &numberOfCompletions);
+        }
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    callCompletionCallbacks(completions, numberOfCompletions);
+}
+
+/**
+ * @brief Check if the handle refers to a tracked command
+ * @return false if the command could not be tracked (all tracking slots were pending)
+ */
+bool Lpf2CommandHandle::isValid() const
+{
+    return _hub != nullptr && _slot != LPF2_NO_TRACKED_COMMAND;
+}
+
+/**
+ * @brief Get the state of the command. A pending command whose timeout is elapsed is reported as TIMED_OUT,
+ * a sent command of a disconnected hub as DISCONNECTED
+ * @return state of the command (UNKNOWN if the handle is not valid or the tracking slot is reused by a newer command)
+ */
+CommandState Lpf2CommandHandle::getState() const
+{
+    if (!isValid())
+    {
+        return CommandState::UNKNOWN;
+    }
+    CommandCompletion completions[1];
+    int numberOfCompletions = 0;
+    CommandState state = CommandState::UNKNOWN;
+    portENTER_CRITICAL(&_hub->_stateLock);
+    TrackedCommand *command = _hub->getTrackedCommand(_slot, _id);
+    if (command != nullptr)
+    {
+        if (command->State == CommandState::PENDING && command->IsSent && command->Timeout != 0 && millis() - command->StartTime >= command->Timeout)
+        {
+            _hub->resolveTrackedCommand(command, CommandState::TIMED_OUT, completions, &numberOfCompletions);
+        }
+        else if (command->State == CommandState::PENDING && command->IsSent && !_hub->_isConnected)
+        {
+            _hub->resolveTrackedCommand(command, CommandState::DISCONNECTED, completions, &numberOfCompletions);
+        }
+        state = command->State;
+    }
+    portEXIT_CRITICAL(&_hub->_stateLock);
+    _hub->callCompletionCallbacks(completions, numberOfCompletions);
+    return state;
+}
+
+/**
+ * @brief Check if the command is not pending anymore (completed, discarded, timed out or unknown)
+ * @return true if the command is done
+ */
+bool Lpf2CommandHandle::isDone() const
+{
+    return getState() != CommandState::PENDING;
+}
+
+/**
+ * @brief Check if the command is reported as completed by the hub
+ * @return true if the command is completed
+ */
+bool Lpf2CommandHandle::isCompleted() const
+{
+    return getState() == CommandState::COMPLETED;
+}
+
+/**
+ * @brief Set a timeout for the command. If the hub does not report the completion within the timeout
+ * (measured from the send time, queued commands do not time out before they are sent), the command is resolved as TIMED_OUT
+ * @param [in] timeout timeout in unit milliseconds (0: no timeout)
+ */
+void Lpf2CommandHandle::setTimeout(uint32_t timeout)
+{
+    if (!isValid())
+    {
+        return;
+    }
+    portENTER_CRITICAL(&_hub->_stateLock);
+    TrackedCommand *command = _hub->getTrackedCommand(_slot, _id);
+    if (command != nullptr)
+    {
+        command->Timeout = timeout;
+    }
+    portEXIT_CRITICAL(&_hub->_stateLock);
+}
+
+/**
+ * @brief Register a callback which is called once if the command is done. If the command is already
+ * done, the callback is called immediately. The check and the registration are done under the state lock,
+ * so a feedback which is received at the same time either finds the callback or the callback is called here
+ * @param [in] callback callback function
+ */
+void Lpf2CommandHandle::onDone(CommandCompletionCallback callback)
+{
+    if (_hub == nullptr)
+    {
+        return;
+    }
+    byte portNumber = LPF2_NO_PORT;
+    CommandState state = CommandState::UNKNOWN;
+    if (isValid())
+    {
+        portENTER_CRITICAL(&_hub->_stateLock);
+        TrackedCommand *command = _hub->getTrackedCommand(_slot, _id);
+        if (command != nullptr)
+        {
+            portNumber = command->PortNumber;
+            state = command->State;
+            if (state == CommandState::PENDING)
+            {
+                command->Callback = callback;
+            }
+        }
+        portEXIT_CRITICAL(&_hub->_stateLock);
+    }
+    if (state != CommandState::PENDING && callback != nullptr)
+    {
+        callback(_hub, portNumber, state);
+    }
+}
+
+/**
+ * @brief Register a callback function which is called for each port of a port output command feedback message
+ * @param [in] portCommandFeedbackCallback callback function (feedback: CommandFeedback bits)
+ */
+void Lpf2Hub::setPortCommandFeedbackCallback(PortCommandFeedbackCallback portCommandFeedbackCallback)
+{
+    _portCommandFeedbackCallback = portCommandFeedbackCallback;
+}
+
+/**
+ * @brief Get the last port output command feedback of a port
+ * @param [in] port port number
+ * @return CommandFeedback bits (0 if no feedback was received or no device is attached)
+ */
+byte Lpf2Hub::getPortCommandFeedback(byte port)
+{
+    return isPortDeviceRegistered(port) ? _portCommandFeedback[port].load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief Get the number of commands of a port which are sent but not reported as completed or discarded
+ * @param [in] port port number
+ * @return number of commands in flight
+ */
+int Lpf2Hub::getPortCommandsInFlight(byte port)
+{
+    return isPortDeviceRegistered(port) ? _portCommandsInFlight[port].load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief Check if all commands of a port are completed (or discarded). Non blocking replacement of a delay
+ * after a timed or positional motor command
+ * @param [in] port port number
+ * @return true if no command is in flight
+ */
+bool Lpf2Hub::isPortIdle(byte port)
+{
+    return getPortCommandsInFlight(port) == 0;
+}
+
+/**
+ * @brief Check if the command buffer of a port is full
+ * @param [in] port port number
+ * @return true if the last feedback of the port reported busy/full
+ */
+bool Lpf2Hub::isPortBusy(byte port)
+{
+    return (getPortCommandFeedback(port) & (byte)CommandFeedback::BUSY_FULL) != 0;
+}
+
+/**
+ * @brief Callback function for notifications of a specific characteristic
+ * @param [in] pBLERemoteCharacteristic The pointer to the characteristic
+ * @param [in] pData The pointer to the received data
+ * @param [in] length The length of the data array
+ * @param [in] isNotify 
+ */
+void Lpf2Hub::notifyCallback(
+    NimBLERemoteCharacteristic *pBLERemoteCharacteristic,
+    uint8_t *pData,
+    size_t length,
+    bool isNotify)
+{
+    // counted, so the destructor could wait for a running notification
+    _activeNotifications.fetch_add(1, std::memory_order_acq_rel);
+    log_hot_d("notify callback for characteristic %s", pBLERemoteCharacteristic->getUUID().toString().c_str());
+    _hubStatistics.BytesIn += length;
+
+    dispatchFrames(pData, length);
+    _activeNotifications.fetch_sub(1, std::memory_order_release);
+}
+
+/**
+ * @brief Split up a notification into the contained messages by the length header of each message.
+ * A notification could contain several concatenated messages and the length header could use the 
+ * extended two byte encoding (bit 7 of the first byte set, bits 7..14 of the length in the second byte).
+ * The processing of the notification is stopped at the first message with an invalid length.
+ * @param [in] pData The pointer to the received data
+ * @param [in] length The length of the data array
+ */
+void Lpf2Hub::dispatchFrames(uint8_t *pData, size_t length)
+{
+    size_t offset = 0;
+    while (offset < length)
+    {
+        uint8_t *pFrame = pData + offset;
+        size_t remainingLength = length - offset;
+        size_t frameLength = pFrame[0];
+        // number of additional length bytes of the extended encoding
+        size_t headerShift = 0;
+        if (frameLength & 0x80)
+        {
+            if (remainingLength < 2)
+            {
+                log_hot_w("incomplete length header at offset %u", (unsigned int)offset);
+                _hubStatistics.Drops++;
+                return;
+            }
+            frameLength = (pFrame[0] & 0x7F) | ((size_t)pFrame[1] << 7);
+            headerShift = 1;
+        }
+        if (frameLength < 3 + headerShift || frameLength > remainingLength)
+        {
+            log_hot_w("invalid message length %u at offset %u of notification with length %u", (unsigned int)frameLength, (unsigned int)offset, (unsigned int)length);
+            _hubStatistics.Drops++;
+            return;
+        }
+
+        // the message is dispatched without the additional length byte, so that all messages share the same
+        // field offsets. The buffer of the BLE stack is not modified, the handlers and views use the explicit
+        // length (the first byte of a shifted message is the high byte of the length, not the length)
+        dispatchFrame(pFrame + headerShift, frameLength - headerShift);
+        offset += frameLength;
+    }
+}
+
+/**
+ * @brief Dispatch a single message or queue it, if the deferred dispatch is enabled
+ * @param [in] pData The pointer to the message
+ * @param [in] length The length of the message
+ */
+void Lpf2Hub::dispatchFrame(uint8_t *pData, size_t length)
+{
+    if (_isDeferredDispatch.load(std::memory_order_acquire))
+    {
+        if (!_eventQueue->push(pData, length))
+        {
+            log_hot_w("event queue overflow, notification dropped");
+            _hubStatistics.Drops++;
+        }
+        return;
+    }
+    dispatchMessage(pData, length);
+}
+
+/**
+ * @brief Call the handler of the message type of a received message
+ * @param [in] pData The pointer to the message
+ * @param [in] length The length of the message
+ */
+void Lpf2Hub::dispatchMessage(uint8_t *pData, size_t length)
+{
+    byte messageType = pData[(byte)MessageHeader::MESSAGE_TYPE];
+    _hubStatistics.MessagesIn++;
+    _messageTypeCounts[messageTypeCounterIndex[messageType]]++;
+    MessageHandler messageHandler = messageHandlers[messageType];
+    if (messageHandler == nullptr)
+    {
+        return;
+    }
+    if (length < messageMinLengths[messageType])
+    {
+        log_hot_w("message type %x is too short (%u bytes)", messageType, (unsigned int)length);
+        _hubStatistics.Drops++;
+        return;
+    }
+    (this->*messageHandler)(pData, length);
+}
+
+/**
+ * @brief Enable or disable the deferred dispatch of notifications. If enabled, the notifications
+ * are queued in the BLE task and the callbacks are called in poll(), which has to be called in the loop.
+ * Without the deferred dispatch, the callbacks are called directly in the BLE task.
+ * @param [in] enabled true to queue the notifications, false to dispatch them directly
+ * @param [in] policy ALL_EVENTS or LATEST_VALUE_PER_PORT to coalesce port value updates
+ */
+void Lpf2Hub::setDeferredDispatch(bool enabled, EventQueuePolicy policy)
+{
+    if (_eventQueue == nullptr)
+    {
+        _eventQueue = new Lpf2HubEventQueue(policy);
+    }
+    _eventQueue->setPolicy(policy);
+    _isDeferredDispatch.store(enabled, std::memory_order_release);
+}
+
+/**
+ * @brief Service function of the hub which has to be called in the loop. It drives the reconnect supervisor,
+ * replays the recorded state after a reconnect, resolves timed out command handles, sends the queued port commands,
+ * drives the port discovery and dispatches the queued notifications (deferred dispatch)
+ * @return number of dispatched notifications
+ */
+int Lpf2Hub::poll()
+{
+    superviseConnection();
+    replayState();
+    expireTrackedCommands();
+    serviceCommandQueues();
+    stepPortDiscovery();
+
+    if (_eventQueue == nullptr)
+    {
+        return 0;
+    }
+    uint8_t message[LPF2_EVENT_MAX_LENGTH];
+    size_t length;
+    int dispatched = 0;
+    // limit the number of dispatched messages to the queue size to avoid starving the loop
+    while (dispatched < LPF2_EVENT_QUEUE_SIZE && _eventQueue->pop(message, &length))
+    {
+        dispatchMessage(message, length);
+        dispatched++;
+    }
+    return dispatched;
+}
+
+/**
+ * @brief Get the counters of the event queue of the deferred dispatch
+ * @return counters of queued, dispatched, dropped and coalesced notifications
+ */
+EventQueueStatistics Lpf2Hub::getEventQueueStatistics()
+{
+    if (_eventQueue == nullptr)
+    {
+        EventQueueStatistics statistics = {0, 0, 0, 0};
+        return statistics;
+    }
+    return _eventQueue->getStatistics();
+}
+
+/**
+ * @brief Reset the counters of the event queue of the deferred dispatch
+ */
+void Lpf2Hub::resetEventQueueStatistics()
+{
+    if (_eventQueue != nullptr)
+    {
+        _eventQueue->resetStatistics();
+    }
+}
+
+/**
+ * @brief Get the counters of the received and sent messages. The counters are updated without
+ * synchronization, so the values read during a running notification could be off by one message
+ * @return counters of received and sent messages and bytes, unknown ports and dropped messages
+ */
+HubStatistics Lpf2Hub::getHubStatistics()
+{
+    return _hubStatistics;
+}
+
+/**
+ * @brief Get the number of received messages of a message type
+ * @param [in] messageType upstream message type, e.g. PORT_VALUE_SINGLE
+ * @return number of received messages of the message type or of all message types without an own counter
+ */
+uint32_t Lpf2Hub::getMessageCount(MessageType messageType)
+{
+    return _messageTypeCounts[messageTypeCounterIndex[(byte)messageType]];
+}
+
+/**
+ * @brief Reset the counters of the received and sent messages
+ */
+void Lpf2Hub::resetHubStatistics()
+{
+    memset(&_hubStatistics, 0, sizeof(_hubStatistics));
+    memset(_messageTypeCounts, 0, sizeof(_messageTypeCounts));
+}
+
+/**
+ * @brief Write a message to the remote characteristic (write without response) and count it
+ * @param [in] pData The pointer to the message including the common header
+ * @param [in] length The length of the message
+ */
+void Lpf2Hub::writeCharacteristic(const uint8_t *pData, size_t length)
+{
+    _pRemoteCharacteristic->writeValue(pData, length, false);
+    _hubStatistics.MessagesOut++;
+    _hubStatistics.BytesOut += length;
+}
+
+/**
+ * @brief Constructor
+ */
+Lpf2Hub::Lpf2Hub()
+{
+    // created once and reused for every connection, the client does not own it
+    _pClientCallbacks = new Lpf2HubClientCallback(this);
+    initDispatchTables();
+    memset(_portDeviceIndex, LPF2_NO_DEVICE_INDEX, sizeof(_portDeviceIndex));
+    memset(_deviceTypePort, LPF2_NO_PORT, sizeof(_deviceTypePort));
+    for (int port = 0; port < 256; port++)
+    {
+        _portValueIndex[port].store(LPF2_NO_PORT_VALUE, std::memory_order_relaxed);
+    }
+    for (int idx = 0; idx < LPF2_MAX_PORT_VALUES; idx++)
+    {
+        _portValues[idx].Lock.store(0, std::memory_order_relaxed);
+        _portValues[idx].PortNumber = LPF2_NO_PORT;
+    }
+    resetPortCommandFeedbacks();
+};
+
+/**
+ * @brief Destructor. The callbacks of the NimBLE host task are stopped and a running notification is waited for
+ * before the event queue and the client callbacks are deleted. A connected hub is disconnected
+ */
+Lpf2Hub::~Lpf2Hub()
+{
+    if (_pClient != nullptr)
+    {
+        _pClient->setClientCallbacks(nullptr, false);
+        if (_pClient->isConnected() && _pRemoteCharacteristic != nullptr)
+        {
+            // the descriptor write is answered in the host task, so a notification which is running is finished
+            _pRemoteCharacteristic->unsubscribe(true);
+            _pClient->disconnect();
+        }
+    }
+    _isDeferredDispatch.store(false, std::memory_order_release);
+    while (_activeNotifications.load(std::memory_order_acquire) > 0)
+    {
+        delay(1);
+    }
+    delete _eventQueue;
+    _eventQueue = nullptr;
+    delete _pClientCallbacks;
+}
+
+/**
+ * @brief Register the update mode and the decoder of a device type. The decoder is called for
+ * value updates of a port with that device type if no callback is registered for the port.
+ * With this, devices which are not known by the library could be added without changing the library.
+ * @param [in] deviceType type of the device
+ * @param [in] mode update mode which is used in activatePortDevice
+ * @param [in] decoder function which is called for value updates of the device (could be nullptr)
+ */
+void Lpf2Hub::registerDeviceType(byte deviceType, byte mode, PortValueChangeCallback decoder)
+{
+    initDispatchTables();
+    deviceTypeModes[deviceType] = mode;
+    deviceTypeHasMode[deviceType] = true;
+    deviceTypeDecoders[deviceType] = decoder;
+}
+
+/**
+ * @brief Register the decoder of a hub property. The decoder is called for hub property updates
+ * if no hub property callback is registered
+ * @param [in] hubProperty hub property reference
+ * @param [in] decoder function which is called for updates of the hub property (could be nullptr)
+ */
+void Lpf2Hub::registerHubProperty(HubPropertyReference hubProperty, HubPropertyChangeCallback decoder)
+{
+    initDispatchTables();
+    if ((byte)hubProperty < LPF2_MAX_HUB_PROPERTIES)
+    {
+        hubPropertyDecoders[(byte)hubProperty] = decoder;
+    }
+}
+
+/**
+ * @brief Init function set the UUIDs and scan for the Hub
+ */
+void Lpf2Hub::init()
+{
+    initWithoutScan();
+
+    pBLEScan->setAdvertisedDeviceCallbacks(new Lpf2HubAdvertisedDeviceCallbacks(this));
+
+    pBLEScan->setActiveScan(true);
+    // start method with callback function to enforce the non blocking scan. If no callback function is used,
+    // the scan starts in a blocking manner
+    pBLEScan->start(_scanDuration, scanEndedCallback);
+}
+
+/**
+ * @brief Set the UUIDs and the initial state without starting a scan. The scan is done by the 
+ * caller (e.g. Lpf2HubManager) which hands over a matching advertised device
+ */
+void Lpf2Hub::initWithoutScan()
+{
+    _isConnected = false;
+    _isConnecting = false;
+    _connectionState.store(HubConnectionState::IDLE, std::memory_order_release);
+    _bleUuid = BLEUUID(LPF2_UUID);
+    _charachteristicUuid = BLEUUID(LPF2_CHARACHTERISTIC);
+    _hubType = HubType::UNKNOWNHUB;
+
+    BLEDevice::init("");
+    pBLEScan = BLEDevice::getScan();
+}
+
+/**
+ * @brief Init function for a hub with a known address. The scan is skipped and the hub
+ * is directly ready to connect (isConnecting() == true). Since there is no advertisement, 
+ * the hub name is empty and the hub type is the given one
+ * @param [in] deviceAddress address of the hub represented by a hex string of the format: 00:00:00:00:00:00
+ * @param [in] hubType type of the hub (optional)
+ */
+void Lpf2Hub::initDirect(std::string deviceAddress, HubType hubType)
+{
+    initWithoutScan();
+    if (_requestedDeviceAddress != nullptr)
+    {
+        delete _requestedDeviceAddress;
+    }
+    _requestedDeviceAddress = new BLEAddress(deviceAddress);
+    if (_pServerAddress != nullptr)
+    {
+        delete _pServerAddress;
+    }
+    _pServerAddress = new BLEAddress(deviceAddress);
+    _hubType = hubType;
+    _isConnecting = true;
+    _connectionState.store(HubConnectionState::FOUND, std::memory_order_release);
+}
+
+/**
+ * @brief Get the hub type out of the manufacturer data of an advertised device
+ * @param [in] advertisedDevice advertised device of a scan
+ * @return hub type or UNKNOWNHUB if the manufacturer data does not contain a known hub type
+ */
+HubType Lpf2Hub::getHubTypeForAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice)
+{
+    if (!advertisedDevice->haveManufacturerData())
+    {
+        return HubType::UNKNOWNHUB;
+    }
+    std::string manufacturerData = advertisedDevice->getManufacturerData();
+    if (manufacturerData.length() < 4)
+    {
+        return HubType::UNKNOWNHUB;
+    }
+    log_d("manufacturer data hub type: %x", (uint8_t)manufacturerData[3]);
+    //check device type ID
+    switch ((uint8_t)manufacturerData[3])
+    {
+    case DUPLO_TRAIN_HUB_ID:
+        return HubType::DUPLO_TRAIN_HUB;
+    case BOOST_MOVE_HUB_ID:
+        return HubType::BOOST_MOVE_HUB;
+    case POWERED_UP_HUB_ID:
+        return HubType::POWERED_UP_HUB;
+    case POWERED_UP_REMOTE_ID:
+        return HubType::POWERED_UP_REMOTE;
+    case CONTROL_PLUS_HUB_ID:
+        return HubType::CONTROL_PLUS_HUB;
+    case MARIO_HUB_ID:
+        return HubType::MARIO_HUB;
+    default:
+        return HubType::UNKNOWNHUB;
+    }
+}
+
+/**
+ * @brief Check if an advertised device is a hub which fits the requested address, hub type and name
+ * @param [in] advertisedDevice advertised device of a scan
+ * @param [in] hubType hub type of the advertised device
+ * @return true if the advertised device fits the requested hub
+ */
+bool Lpf2Hub::matchesAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice, HubType hubType)
+{
+    if (!advertisedDevice->haveServiceUUID() || !advertisedDevice->getServiceUUID().equals(_bleUuid))
+    {
+        return false;
+    }
+    if (_requestedDeviceAddress != nullptr && !advertisedDevice->getAddress().equals(*_requestedDeviceAddress))
+    {
+        return false;
+    }
+    if (_requestedHubType != HubType::UNKNOWNHUB && hubType != _requestedHubType)
+    {
+        return false;
+    }
+    if (!_requestedHubName.empty() && advertisedDevice->getName() != _requestedHubName)
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Take over the address, name and type of a found hub. Afterwards the hub is ready to connect
+ * @param [in] advertisedDevice advertised device of a scan
+ */
+void Lpf2Hub::applyAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice)
+{
+    if (_pServerAddress != nullptr)
+    {
+        delete _pServerAddress;
+    }
+    _pServerAddress = new BLEAddress(advertisedDevice->getAddress());
+    _hubName = advertisedDevice->getName();
+    _hubType = getHubTypeForAdvertisedDevice(advertisedDevice);
+    _isConnecting = true;
+    _connectionState.store(HubConnectionState::FOUND, std::memory_order_release);
+}
+
+/**
+ * @brief Init function set the UUIDs and scan for the Hub
+ * @param [in] deviceAddress to which the arduino should connect represented by a hex string of the format: 00:00:00:00:00:00
+ */
+void Lpf2Hub::init(std::string deviceAddress)
+{
+    _requestedDeviceAddress = new BLEAddress(deviceAddress);
+    init();
+}
+
+/**
+ * @brief Init function set the BLE scan duration (default value 5s)
+ * @param [in] BLE scan durtation in unit seconds
+ */
+void Lpf2Hub::init(uint32_t scanDuration)
+{
+    _scanDuration = scanDuration;
+    init();
+}
+
+/**
+ * @brief Init function set the BLE scan duration (default value 5s)
+ * @param [in] deviceAddress to which the arduino should connect represented by a hex string of the format: 00:00:00:00:00:00
+ * @param [in] BLE scan durtation in unit seconds
+ */
+void Lpf2Hub::init(std::string deviceAddress, uint32_t scanDuration)
+{
+    _requestedDeviceAddress = new BLEAddress(deviceAddress);
+    _scanDuration = scanDuration;
+    init();
+}
+
+/**
+ * @brief Get the address of the HUB (server address)
+ * @return HUB Address
+ */
+NimBLEAddress Lpf2Hub::getHubAddress()
+{
+    NimBLEAddress pAddress = *_pServerAddress;
+    return pAddress;
+}
+
+/**
+ * @brief Get the array index of a specific connected device on a defined port in the connectedDevices array.
+ * The index changes if another device is detached
+ * @param [in] port number
+ * @return array index of the connected device or -1 if no device is connected
+ */
+int Lpf2Hub::getDeviceIndexForPortNumber(byte portNumber)
+{
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    portEXIT_CRITICAL(&_stateLock);
+    if (deviceIndex == LPF2_NO_DEVICE_INDEX)
+    {
+        countUnknownPort(portNumber);
+        return -1;
+    }
+    return deviceIndex;
+}
+
+/**
+ * @brief Get the device type of a specific connected device on a defined port in the connectedDevices array
+ * @param [in] port number
+ * @return device type of the connected device
+ */
+byte Lpf2Hub::getDeviceTypeForPortNumber(byte portNumber)
+{
+    Device device;
+    if (!getPortDevice(portNumber, &device))
+    {
+        countUnknownPort(portNumber);
+        return (byte)DeviceType::UNKNOWNDEVICE;
+    }
+    return device.DeviceType;
+}
+
+/**
+ * @brief Copy the device which is registered on a port. The device table is changed by the attach events in the
+ * NimBLE host task and by the user loop, so the entries are only accessed under the state lock
+ * @param [in] portNumber number of the port
+ * @param [out] device receives the copy of the device
+ * @return false if no device is registered on the port
+ */
+bool Lpf2Hub::getPortDevice(byte portNumber, Device *device)
+{
+    portENTER_CRITICAL(&_stateLock);
+    byte deviceIndex = _portDeviceIndex[portNumber];
+    if (deviceIndex != LPF2_NO_DEVICE_INDEX)
+    {
+        *device = connectedDevices[deviceIndex];
+    }
+    portEXIT_CRITICAL(&_stateLock);
+    return deviceIndex != LPF2_NO_DEVICE_INDEX;
+}
+
+/**
+ * @brief Count an access to a port without a registered device in the hub statistics
+ * @param [in] portNumber number of the port
+ */
+void Lpf2Hub::countUnknownPort(byte portNumber)
+{
+    log_hot_w("no device found for port number %x", portNumber);
+    _hubStatistics.UnknownPorts++;
+}
+
+/**
+ * @brief Check if a device is registered on a port
+ * @param [in] portNumber number of the port
+ * @return true if the hub has reported an attached device on the port
+ */
+bool Lpf2Hub::isPortDeviceRegistered(byte portNumber)
+{
+    portENTER_CRITICAL(&_stateLock);
+    bool isRegistered = _portDeviceIndex[portNumber] != LPF2_NO_DEVICE_INDEX;
+    portEXIT_CRITICAL(&_stateLock);
+    return isRegistered;
+}
+
+/**
+ * @brief Get the port where a specific device is connected
+ * @param [in] device type
+ * @return port number if device type is found or 255
  */
 byte Lpf2Hub::getPortForDeviceType(byte deviceType)
 {
-    log_d("Number of connected devices: %d", numberOfConnectedDevices);
-    for (int idx = 0; idx < numberOfConnectedDevices; idx++)
+    portENTER_CRITICAL(&_stateLock);
+    byte portNumber = _deviceTypePort[deviceType];
+    portEXIT_CRITICAL(&_stateLock);
+    if (portNumber == LPF2_NO_PORT)
     {
-        log_v("device %d, port number: %x, device type: %x, callback address: %x", idx, connectedDevices[idx].PortNumber, connectedDevices[idx].DeviceType, connectedDevices[idx].Callback);
-        if (connectedDevices[idx].DeviceType == deviceType)
-        {
-            log_d("port %x has device of type %x", connectedDevices[idx].PortNumber, deviceType);
-            return connectedDevices[idx].PortNumber;
-        }
+        log_hot_w("no port found with device type %x", deviceType);
+        _hubStatistics.UnknownPorts++;
     }
-    log_w("no port found with device type %x", deviceType);
-    return 255;
+    return portNumber;
 }
 
 /**
  * @brief Set the color of the HUB LED with predefined colors
  * @param [in] color one of the available hub colors
  */
-void Lpf2Hub::setLedColor(Color color)
+void Lpf2Hub::setLedColor(Color color)
+{
+    byte port = getPortForDeviceType((byte)DeviceType::HUB_LED);
+    writePortInputFormatSetup(port, 0x00, 1, false);
+    Lpf2HubMessage setColor(port, 0x11, 0x51);
+    setColor.writeUInt8(0x00);
+    setColor.writeUInt8(color);
+    WriteValue(setColor);
+}
+
+/**
+ * @brief Set the color of the HUB LED with RGB values 
+ * @param [in] red 0..255 
+ * @param [in] green 0..255 
+ * @param [in] blue 0..255 
+ */
+void Lpf2Hub::setLedRGBColor(char red, char green, char blue)
+{
+    byte port = getPortForDeviceType((byte)DeviceType::HUB_LED);
+    writePortInputFormatSetup(port, 0x01, 1, false);
+    Lpf2HubMessage setRGBColor(port, 0x11, 0x51);
+    setRGBColor.writeUInt8(0x01);
+    setRGBColor.writeUInt8(red);
+    setRGBColor.writeUInt8(green);
+    setRGBColor.writeUInt8(blue);
+    WriteValue(setRGBColor);
+}
+
+/**
+ * @brief Set the color of the HUB LED with HSV values. The conversion to RGB is done
+ * with integer arithmetic (see LegoinoCommon::HsvToRgb)
+ * @param [in] hue 0..360 
+ * @param [in] saturation 0..1 
+ * @param [in] value 0..1
+ */
+void Lpf2Hub::setLedHSVColor(int hue, double saturation, double value)
+{
+    uint8_t rgb[3];
+    LegoinoCommon::HsvToRgb(hue, (uint8_t)(constrain(saturation, 0.0, 1.0) * 255), (uint8_t)(constrain(value, 0.0, 1.0) * 255), rgb);
+    setLedRGBColor(rgb[0], rgb[1], rgb[2]);
+}
+
+/**
+ * @brief Send the Shutdown command to the HUB
+ */
+void Lpf2Hub::shutDownHub()
+{
+    Lpf2HubMessage shutdownCommand(MessageType::HUB_ACTIONS);
+    shutdownCommand.writeUInt8(ActionType::SWITCH_OFF_HUB);
+    WriteValue(shutdownCommand);
+}
+
+/**
+ * @brief Set name of the HUB
+ * @param [in] name character array which contains the name (max 14 characters are supported)
+ */
+void Lpf2Hub::setHubName(char name[])
+{
+    int nameLength = strlen(name);
+    if (nameLength > 14)
+    {
+        return;
+    }
+    _hubName = std::string(name, nameLength);
+
+    Lpf2HubMessage setNameCommand(MessageType::HUB_PROPERTIES);
+    setNameCommand.writeUInt8((byte)HubPropertyReference::ADVERTISING_NAME);
+    setNameCommand.writeUInt8((byte)HubPropertyOperation::SET_DOWNSTREAM);
+    setNameCommand.writeBytes((uint8_t *)name, nameLength);
+    WriteValue(setNameCommand);
+}
+
+/**
+ * @brief Activate the update/notification of hub specific property changes (battery level, rssi, ...)
+ * @param [in] hubProperty for which updates should be activated
+ * @param [in] optional callback function which will be called if a value has changed
+ */
+void Lpf2Hub::activateHubPropertyUpdate(HubPropertyReference hubProperty, HubPropertyChangeCallback hubPropertyChangeCallback)
+{
+    if (hubPropertyChangeCallback != nullptr)
+    {
+        _hubPropertyChangeCallback = hubPropertyChangeCallback;
+    }
+    if ((byte)hubProperty < LPF2_MAX_HUB_PROPERTIES)
+    {
+        _hubPropertySubscriptions |= (uint64_t)1 << (byte)hubProperty;
+    }
+
+    // Activate reports
+    Lpf2HubMessage notifyPropertyCommand(MessageType::HUB_PROPERTIES);
+    notifyPropertyCommand.writeUInt8((byte)hubProperty);
+    notifyPropertyCommand.writeUInt8((byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM);
+    WriteValue(notifyPropertyCommand);
+}
+
+/**
+ * @brief Request a hub specific property value (battery level, rssi, ...)
+ * @param [in] hubProperty for which the value should be requested
+ * @param [in] optional callback function which will be called if a value has changed
+ */
+void Lpf2Hub::requestHubPropertyUpdate(HubPropertyReference hubProperty, HubPropertyChangeCallback hubPropertyChangeCallback)
+{
+    if (hubPropertyChangeCallback != nullptr)
+    {
+        _hubPropertyChangeCallback = hubPropertyChangeCallback;
+    }
+
+    // Activate reports
+    Lpf2HubMessage notifyPropertyCommand(MessageType::HUB_PROPERTIES);
+    notifyPropertyCommand.writeUInt8((byte)hubProperty);
+    notifyPropertyCommand.writeUInt8((byte)HubPropertyOperation::REQUEST_UPDATE_DOWNSTREAM);
+    WriteValue(notifyPropertyCommand);
+}
+
+/**
+ * @brief Deactivate the update/notification of hub specific property changes (battery level, rssi, ...)
+ * @param [in] hubProperty for which updates should be activated
+ */
+void Lpf2Hub::deactivateHubPropertyUpdate(HubPropertyReference hubProperty)
+{
+    if ((byte)hubProperty < LPF2_MAX_HUB_PROPERTIES)
+    {
+        _hubPropertySubscriptions &= ~((uint64_t)1 << (byte)hubProperty);
+    }
+
+    // Activate reports
+    Lpf2HubMessage notifyPropertyCommand(MessageType::HUB_PROPERTIES);
+    notifyPropertyCommand.writeUInt8((byte)hubProperty);
+    notifyPropertyCommand.writeUInt8((byte)HubPropertyOperation::DISABLE_UPDATES_DOWNSTREAM);
+    WriteValue(notifyPropertyCommand);
+}
+
+/**
+ * @brief Connect to the HUB, get a reference to the characteristic and register for notifications.
+ * The call blocks until the connection is ready or has failed
+ * @return true if the connection is ready
+ */
+bool Lpf2Hub::connectHub()
+{
+    if (_isConnectTaskRunning.load(std::memory_order_acquire))
+    {
+        log_w("asynchronous connect is running");
+        return false;
+    }
+    handleConnectionLoss();
+    return runConnectPhases();
+}
+
+/**
+ * @brief Worker task of the asynchronous connect
+ * @param [in] pvParameters hub instance
+ */
+void Lpf2Hub::connectTask(void *pvParameters)
+{
+    Lpf2Hub *hub = (Lpf2Hub *)pvParameters;
+    hub->runConnectPhases();
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Start the connection to a found HUB without blocking the caller. The connect, the service discovery
+ * and the subscription are done in a worker task. The progress could be checked with getConnectionState() 
+ * @return true if the connect was started
+ */
+bool Lpf2Hub::connectHubAsync()
+{
+    HubConnectionState connectionState = _connectionState.load(std::memory_order_acquire);
+    if (connectionState != HubConnectionState::FOUND && connectionState != HubConnectionState::FAILED)
+    {
+        log_w("hub is not ready for a connect, state: %d", (int)connectionState);
+        return false;
+    }
+    if (_isConnectTaskRunning.exchange(true, std::memory_order_acq_rel))
+    {
+        return false;
+    }
+    handleConnectionLoss();
+    if (xTaskCreate(connectTask, "Lpf2HubConnect", LPF2_CONNECT_TASK_STACK_SIZE, this, 1, nullptr) != pdPASS)
+    {
+        log_e("failed to create connect task");
+        _isConnectTaskRunning.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Run all phases of the connection pipeline and measure the duration of each phase
+ * @return true if the connection is ready
+ */
+bool Lpf2Hub::runConnectPhases()
+{
+    uint32_t startTime = micros();
+    // measured in a local copy, the timing is published once at the end (read by the user loop)
+    ConnectionTiming timing = {0, 0, 0, 0};
+
+    _connectionState.store(HubConnectionState::CONNECTING, std::memory_order_release);
+    bool isReady = connectClient();
+    uint32_t phaseEndTime = micros();
+    timing.Connect = phaseEndTime - startTime;
+
+    if (isReady)
+    {
+        _connectionState.store(HubConnectionState::DISCOVERING, std::memory_order_release);
+        isReady = discoverCharacteristic();
+        timing.Discover = micros() - phaseEndTime;
+        phaseEndTime = micros();
+    }
+
+    if (isReady)
+    {
+        _connectionState.store(HubConnectionState::SUBSCRIBING, std::memory_order_release);
+        isReady = subscribeCharacteristic();
+        timing.Subscribe = micros() - phaseEndTime;
+    }
+
+    timing.Total = micros() - startTime;
+    log_d("connect: %u us, discover: %u us, subscribe: %u us", timing.Connect, timing.Discover, timing.Subscribe);
+
+    // sequence lock, odd while the timing is written
+    uint32_t lock = _connectionTimingLock.load(std::memory_order_relaxed);
+    _connectionTimingLock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _connectionTiming = timing;
+    _connectionTimingLock.store(lock + 2, std::memory_order_release);
+
+    _connectionState.store(isReady ? HubConnectionState::READY : HubConnectionState::FAILED, std::memory_order_release);
+    _isConnectTaskRunning.store(false, std::memory_order_release);
+    return isReady;
+}
+
+/**
+ * @brief Connection phase: get a (reused or new) BLE client and connect it to the HUB
+ * @return true if the client is connected
+ */
+bool Lpf2Hub::connectClient()
+{
+    BLEAddress pAddress = *_pServerAddress;
+    NimBLEClient *pClient = nullptr;
+
+    log_d("number of ble clients: %d", NimBLEDevice::getClientListSize());
+
+    /** Check if we have a client we should reuse first **/
+    if (NimBLEDevice::getClientListSize())
+    {
+        /** Special case when we already know this device, we send false as the 
+         *  second argument in connect() to prevent refreshing the service database.
+         *  This saves considerable time and power.
+         */
+        pClient = NimBLEDevice::getClientByPeerAddress(pAddress);
+        if (pClient)
+        {
+            applyConnectionParameters(pClient);
+            if (!pClient->connect(pAddress, false))
+            {
+                log_e("reconnect failed");
+                return false;
+            }
+            log_d("reconnect client");
+        }
+        /** We don't already have a client that knows this device,
+         *  we will check for a client that is disconnected that we can use.
+         */
+        else
+        {
+            pClient = NimBLEDevice::getDisconnectedClient();
+        }
+    }
+
+    /** No client to reuse? Create a new one. */
+    if (!pClient)
+    {
+        if (NimBLEDevice::getClientListSize() >= NIMBLE_MAX_CONNECTIONS)
+        {
+            log_w("max clients reached - no more connections available: %d", NimBLEDevice::getClientListSize());
+            return false;
+        }
+
+        pClient = NimBLEDevice::createClient();
+    }
+
+    if (!pClient->isConnected())
+    {
+        // the attribute database of the client is refreshed with this connect
+        _isAttributeCacheValid = false;
+        applyConnectionParameters(pClient);
+        if (!pClient->connect(pAddress))
+        {
+            log_e("failed to connect");
+            return false;
+        }
+    }
+
+    log_d("connected to: %s, RSSI: %d", pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
+    if (pClient != _pClient)
+    {
+        _isAttributeCacheValid = false;
+    }
+    _pClient = pClient;
+    return true;
+}
+
+/**
+ * @brief Discovery phase: get the LPF2 service and characteristic of the connected HUB
+ * @return true if the characteristic is available
+ */
+bool Lpf2Hub::discoverCharacteristic()
+{
+    // on a reconnect of the same client the attribute database is kept, so the service and
+    // characteristic of the last connect are still valid
+    if (_isAttributeCacheValid && _pRemoteCharacteristic != nullptr)
+    {
+        log_d("use cached characteristic");
+        return true;
+    }
+
+    BLERemoteService *pRemoteService = _pClient->getService(_bleUuid);
+    if (pRemoteService == nullptr)
+    {
+        log_e("failed to get ble client");
+        return false;
+    }
+
+    _pRemoteCharacteristic = pRemoteService->getCharacteristic(_charachteristicUuid);
+    if (_pRemoteCharacteristic == nullptr)
+    {
+        log_e("failed to get ble service");
+        return false;
+    }
+    _isAttributeCacheValid = true;
+    return true;
+}
+
+/**
+ * @brief Subscription phase: register for notifications of the characteristic and for disconnect events
+ * @return true if the connection is ready
+ */
+bool Lpf2Hub::subscribeCharacteristic()
+{
+    // register notifications (callback function) for the characteristic
+    if (_pRemoteCharacteristic->canNotify())
+    {
+        _pRemoteCharacteristic->subscribe(true, std::bind(&Lpf2Hub::notifyCallback, this, _1, _2, _3, _4), true);
+    }
+
+    // add callback instance to get notified if a disconnect event appears
+    _pClient->setClientCallbacks(_pClientCallbacks, false);
+
+    // Set states
+    _isConnected = true;
+    _isConnecting = false;
+    return true;
+}
+
+/**
+ * @brief Enable or disable the automatic reconnect. If enabled, poll() starts an asynchronous connect
+ * after a connection loss. Failed attempts are repeated with an exponential backoff. After the reconnect,
+ * the hub property updates and port subscriptions (and optional the motor setpoints) are replayed.
+ * @param [in] enabled true to enable the automatic reconnect
+ * @param [in] minBackoff wait time after the first failed attempt in unit milliseconds
+ * @param [in] maxBackoff max. wait time between two attempts in unit milliseconds
+ */
+void Lpf2Hub::setAutoReconnect(bool enabled, uint32_t minBackoff, uint32_t maxBackoff)
+{
+    _isAutoReconnectEnabled = enabled;
+    _reconnectMinBackoff = minBackoff;
+    _reconnectMaxBackoff = max(minBackoff, maxBackoff);
+    if (!enabled)
+    {
+        _isReconnecting = false;
+    }
+}
+
+/**
+ * @brief Enable or disable the replay of the last speed command of each motor port after a reconnect.
+ * With this, a train continues with the speed it had before the connection loss
+ * @param [in] enabled true to replay the motor setpoints
+ */
+void Lpf2Hub::setMotorSetpointReplay(bool enabled)
 {
-    byte port = getPortForDeviceType((byte)DeviceType::HUB_LED);
-    byte setColorMode[8] = {0x41, port, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
-    WriteValue(setColorMode, 8);
-    byte setColor[6] = {0x81, port, 0x11, 0x51, 0x00, color};
-    WriteValue(setColor, 6);
+    _isMotorSetpointReplayEnabled = enabled;
 }
 
 /**
- * @brief Set the color of the HUB LED with RGB values 
- * @param [in] red 0..255 
- * @param [in] green 0..255 
- * @param [in] blue 0..255 
+ * @brief Retrieve the counters of the reconnect supervisor
+ * @return number of disconnects, reconnects, failed attempts and the time to recover in unit milliseconds
  */
-void Lpf2Hub::setLedRGBColor(char red, char green, char blue)
+ReconnectStatistics Lpf2Hub::getReconnectStatistics()
 {
-    byte port = getPortForDeviceType((byte)DeviceType::HUB_LED);
-    byte setRGBMode[8] = {0x41, port, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00};
-    WriteValue(setRGBMode, 8);
-    byte setRGBColor[8] = {0x81, port, 0x11, 0x51, 0x01, red, green, blue};
-    WriteValue(setRGBColor, 8);
+    return _reconnectStatistics;
 }
 
 /**
- * @brief Set the color of the HUB LED with HSV values 
- * @param [in] hue 0..360 
- * @param [in] saturation 0..1 
- * @param [in] value 0..1
+ * @brief Get the recorded subscription of a port
+ * @param [in] portNumber port number
+ * @param [in] create true to create a new entry if the port has no subscription
+ * @return subscription or nullptr
  */
-void Lpf2Hub::setLedHSVColor(int hue, double saturation, double value)
+PortSubscription *Lpf2Hub::getPortSubscription(byte portNumber, bool create)
 {
-    hue = hue % 360; // map hue to 0..360
-    double huePart = hue / 60.0;
-    double fract = huePart - floor(huePart);
-
-    double p = value * (1. - saturation);
-    double q = value * (1. - saturation * fract);
-    double t = value * (1. - saturation * (1. - fract));
-
-    if (huePart >= 0.0 && huePart < 1.0)
-    {
-        setLedRGBColor((char)(value * 255), (char)(t * 255), (char)(p * 255));
-    }
-    else if (huePart >= 1.0 && huePart < 2.0)
+    for (int idx = 0; idx < _numberOfPortSubscriptions; idx++)
     {
-        setLedRGBColor((char)(q * 255), (char)(value * 255), (char)(p * 255));
-    }
-    else if (huePart >= 2.0 && huePart < 3.0)
-    {
-        setLedRGBColor((char)(p * 255), (char)(value * 255), (char)(t * 255));
-    }
-    else if (huePart >= 3.0 && huePart < 4.0)
-    {
-        setLedRGBColor((char)(p * 255), (char)(q * 255), (char)(value * 255));
-    }
-    else if (huePart >= 4.0 && huePart < 5.0)
-    {
-        setLedRGBColor((char)(t * 255), (char)(p * 255), (char)(value * 255));
-    }
-    else if (huePart >= 5.0 && huePart < 6.0)
-    {
-        setLedRGBColor((char)(value * 255), (char)(p * 255), (char)(q * 255));
+        if (_portSubscriptions[idx].PortNumber == portNumber)
+        {
+            return &_portSubscriptions[idx];
+        }
     }
-    else
+    if (!create || _numberOfPortSubscriptions >= LPF2_MAX_CONNECTED_DEVICES)
     {
-        setLedRGBColor(0, 0, 0);
+        return nullptr;
     }
+    PortSubscription *subscription = &_portSubscriptions[_numberOfPortSubscriptions++];
+    memset(subscription, 0, sizeof(PortSubscription));
+    subscription->PortNumber = portNumber;
+    return subscription;
 }
 
 /**
- * @brief Send the Shutdown command to the HUB
+ * @brief Remove the recorded subscription of a port
+ * @param [in] portNumber port number
  */
-void Lpf2Hub::shutDownHub()
+void Lpf2Hub::removePortSubscription(byte portNumber)
 {
-    byte shutdownCommand[2] = {0x02, 0X01};
-    WriteValue(shutdownCommand, 2);
+    for (int idx = 0; idx < _numberOfPortSubscriptions; idx++)
+    {
+        if (_portSubscriptions[idx].PortNumber == portNumber)
+        {
+            _portSubscriptions[idx] = _portSubscriptions[--_numberOfPortSubscriptions];
+            return;
+        }
+    }
 }
 
 /**
- * @brief Set name of the HUB
- * @param [in] name character array which contains the name (max 14 characters are supported)
+ * @brief Record the last speed command of a motor port for the replay after a reconnect
+ * @param [in] portNumber port number
+ * @param [in] message encoded speed command
  */
-void Lpf2Hub::setHubName(char name[])
+void Lpf2Hub::recordMotorSetpoint(byte portNumber, const Lpf2HubMessage &message)
 {
-    int nameLength = strlen(name);
-    if (nameLength > 14)
+    if (!_isMotorSetpointReplayEnabled || !message.isValid())
     {
         return;
     }
-    _hubName = std::string(name, nameLength);
-
-    char offset = 3;
-    int arraySize = offset + nameLength;
-    byte setNameCommand[arraySize] = {0x01, 0x01, 0x01};
-
-    memcpy(setNameCommand + offset, name, nameLength);
-    WriteValue(setNameCommand, arraySize);
+    MotorSetpoint *setpoint = nullptr;
+    for (int idx = 0; idx < _numberOfMotorSetpoints; idx++)
+    {
+        if (_motorSetpoints[idx].PortNumber == portNumber)
+        {
+            setpoint = &_motorSetpoints[idx];
+            break;
+        }
+    }
+    if (setpoint == nullptr)
+    {
+        if (_numberOfMotorSetpoints >= LPF2_MAX_MOTOR_SETPOINTS)
+        {
+            return;
+        }
+        setpoint = &_motorSetpoints[_numberOfMotorSetpoints++];
+        setpoint->PortNumber = portNumber;
+    }
+    setpoint->Length = message.length();
+    memcpy(setpoint->Command, message.data(), message.length());
+    setpoint->IsReplayPending = false;
 }
 
 /**
- * @brief Activate the update/notification of hub specific property changes (battery level, rssi, ...)
- * @param [in] hubProperty for which updates should be activated
- * @param [in] optional callback function which will be called if a value has changed
+ * @brief Clean up the port state of a lost connection. The hub resets the input formats and drops the running
+ * and buffered commands with the connection. If the automatic reconnect is enabled, the devices are removed,
+ * because the hub reports them again after the reconnect and the replay waits for these events. Called by poll()
+ * and before a new connect, so the disconnect callback of the NimBLE host task changes nothing but flags
  */
-void Lpf2Hub::activateHubPropertyUpdate(HubPropertyReference hubProperty, HubPropertyChangeCallback hubPropertyChangeCallback)
+void Lpf2Hub::handleConnectionLoss()
 {
-    if (hubPropertyChangeCallback != nullptr)
+    if (!_isConnectionLossPending.exchange(false, std::memory_order_acq_rel))
     {
-        _hubPropertyChangeCallback = hubPropertyChangeCallback;
+        return;
     }
-
-    // Activate reports
-    byte notifyPropertyCommand[3] = {0x01, (byte)hubProperty, (byte)HubPropertyOperation::ENABLE_UPDATES_DOWNSTREAM};
-    WriteValue(notifyPropertyCommand, 3);
+    invalidatePortInputFormats();
+    resetPortCommandFeedbacks();
+    if (_isAutoReconnectEnabled)
+    {
+        clearPortDevices();
+    }
+    abortTrackedCommands();
 }
 
 /**
- * @brief Request a hub specific property value (battery level, rssi, ...)
- * @param [in] hubProperty for which the value should be requested
- * @param [in] optional callback function which will be called if a value has changed
+ * @brief Reconnect supervisor which is driven by poll(). Starts the reconnect attempts after a connection loss
+ * and marks the recorded state for the replay if the connection is ready again
  */
-void Lpf2Hub::requestHubPropertyUpdate(HubPropertyReference hubProperty, HubPropertyChangeCallback hubPropertyChangeCallback)
+void Lpf2Hub::superviseConnection()
 {
-    if (hubPropertyChangeCallback != nullptr)
+    handleConnectionLoss();
+    if (_isDisconnectPending.exchange(false, std::memory_order_acq_rel))
     {
-        _hubPropertyChangeCallback = hubPropertyChangeCallback;
+        _reconnectStatistics.Disconnects++;
+        if (_isAutoReconnectEnabled && !_isReconnecting && _pServerAddress != nullptr)
+        {
+            log_d("connection lost, start reconnect");
+            _isReconnecting = true;
+            _isReconnectAttemptRunning = false;
+            _reconnectBackoff = _reconnectMinBackoff;
+            _nextReconnectTime = millis();
+        }
+    }
+    if (!_isReconnecting)
+    {
+        return;
     }
 
-    // Activate reports
-    byte notifyPropertyCommand[3] = {0x01, (byte)hubProperty, (byte)HubPropertyOperation::REQUEST_UPDATE_DOWNSTREAM};
-    WriteValue(notifyPropertyCommand, 3);
-}
+    if (_isReconnectAttemptRunning)
+    {
+        HubConnectionState connectionState = getConnectionState();
+        if (connectionState == HubConnectionState::READY)
+        {
+            uint32_t timeToRecover = millis() - _disconnectTime;
+            _reconnectStatistics.Reconnects++;
+            _reconnectStatistics.LastTimeToRecover = timeToRecover;
+            _reconnectStatistics.MaxTimeToRecover = max(_reconnectStatistics.MaxTimeToRecover, timeToRecover);
+            log_d("reconnected after %u ms", timeToRecover);
 
-/**
- * @brief Deactivate the update/notification of hub specific property changes (battery level, rssi, ...)
- * @param [in] hubProperty for which updates should be activated
- */
-void Lpf2Hub::deactivateHubPropertyUpdate(HubPropertyReference hubProperty)
-{
+            _isReconnecting = false;
+            _isReconnectAttemptRunning = false;
+            // the port related state is replayed when the ports are attached again
+            _isHubPropertyReplayPending = _hubPropertySubscriptions != 0;
+            for (int idx = 0; idx < _numberOfPortSubscriptions; idx++)
+            {
+                _portSubscriptions[idx].IsReplayPending = true;
+            }
+            for (int idx = 0; idx < _numberOfMotorSetpoints; idx++)
+            {
+                _motorSetpoints[idx].IsReplayPending = _isMotorSetpointReplayEnabled;
+            }
+            for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
+            {
+                _virtualPorts[idx].IsReplayPending = true;
+            }
+            return;
+        }
+        if (connectionState != HubConnectionState::FAILED)
+        {
+            // attempt is still running
+            return;
+        }
+        _isReconnectAttemptRunning = false;
+        _reconnectStatistics.FailedAttempts++;
+        _nextReconnectTime = millis() + _reconnectBackoff;
+        log_d("reconnect failed, next attempt in %u ms", _reconnectBackoff);
+        _reconnectBackoff = min(_reconnectBackoff * 2, _reconnectMaxBackoff);
+    }
 
-    // Activate reports
-    byte notifyPropertyCommand[3] = {0x01, (byte)hubProperty, (byte)HubPropertyOperation::DISABLE_UPDATES_DOWNSTREAM};
-    WriteValue(notifyPropertyCommand, 3);
+    if ((int32_t)(millis() - _nextReconnectTime) < 0)
+    {
+        return;
+    }
+    _isConnecting = true;
+    _connectionState.store(HubConnectionState::FOUND, std::memory_order_release);
+    if (connectHubAsync())
+    {
+        _isReconnectAttemptRunning = true;
+    }
+    else
+    {
+        _nextReconnectTime = millis() + _reconnectBackoff;
+    }
 }
 
 /**
- * @brief Connect to the HUB, get a reference to the characteristic and register for notifications
+ * @brief Replay the recorded state after a reconnect. Only one message (group) is sent per call to
+ * give the hub some time between the setup messages. Port related state is replayed after the port is attached again
  */
-bool Lpf2Hub::connectHub()
+void Lpf2Hub::replayState()
 {
-    BLEAddress pAddress = *_pServerAddress;
-    NimBLEClient *pClient = nullptr;
-
-    log_d("number of ble clients: %d", NimBLEDevice::getClientListSize());
+    if (!_isConnected)
+    {
+        return;
+    }
 
-    /** Check if we have a client we should reuse first **/
-    if (NimBLEDevice::getClientListSize())
+    if (_isHubPropertyReplayPending)
     {
-        /** Special case when we already know this device, we send false as the 
-         *  second argument in connect() to prevent refreshing the service database.
-         *  This saves considerable time and power.
-         */
-        pClient = NimBLEDevice::getClientByPeerAddress(pAddress);
-        if (pClient)
+        _isHubPropertyReplayPending = false;
+        for (byte hubProperty = 0; hubProperty < LPF2_MAX_HUB_PROPERTIES; hubProperty++)
         {
-            if (!pClient->connect(pAddress, false))
+            if (_hubPropertySubscriptions & ((uint64_t)1 << hubProperty))
             {
-                log_e("reconnect failed");
-                return false;
+                activateHubPropertyUpdate((HubPropertyReference)hubProperty);
             }
-            log_d("reconnect client");
         }
-        /** We don't already have a client that knows this device,
-         *  we will check for a client that is disconnected that we can use.
-         */
-        else
+        return;
+    }
+
+    for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
+    {
+        VirtualPort *virtualPort = &_virtualPorts[idx];
+        if (!virtualPort->IsReplayPending || !isPortDeviceRegistered(virtualPort->PortA) || !isPortDeviceRegistered(virtualPort->PortB))
         {
-            pClient = NimBLEDevice::getDisconnectedClient();
+            continue;
         }
+        virtualPort->IsReplayPending = false;
+        log_d("replay virtual port of ports %x and %x", virtualPort->PortA, virtualPort->PortB);
+        writeVirtualPortSetup(virtualPort->PortA, virtualPort->PortB);
+        return;
     }
 
-    /** No client to reuse? Create a new one. */
-    if (!pClient)
+    for (int idx = 0; idx < _numberOfPortSubscriptions; idx++)
     {
-        if (NimBLEDevice::getClientListSize() >= NIMBLE_MAX_CONNECTIONS)
+        PortSubscription *subscription = &_portSubscriptions[idx];
+        if (!subscription->IsReplayPending || !isPortDeviceRegistered(subscription->PortNumber))
         {
-            log_w("max clients reached - no more connections available: %d", NimBLEDevice::getClientListSize());
-            return false;
+            continue;
         }
-
-        pClient = NimBLEDevice::createClient();
+        subscription->IsReplayPending = false;
+        log_d("replay subscription of port %x", subscription->PortNumber);
+        if (subscription->IsCombinedMode)
+        {
+            // copy the modes, the subscription entry is rewritten by the activation
+            byte modes[LPF2_MAX_COMBINED_MODE_DATASETS];
+            memcpy(modes, subscription->Modes, subscription->NumberOfModes);
+            activatePortDeviceCombinedMode(subscription->PortNumber, modes, subscription->NumberOfModes, subscription->CombinedCallback, subscription->DeltaInterval);
+        }
+        else
+        {
+            activatePortDevice(subscription->PortNumber, subscription->Mode, subscription->DeltaInterval, subscription->Callback);
+        }
+        return;
     }
 
-    if (!pClient->isConnected())
+    for (int idx = 0; idx < _numberOfMotorSetpoints; idx++)
     {
-        if (!pClient->connect(pAddress))
+        MotorSetpoint *setpoint = &_motorSetpoints[idx];
+        if (!setpoint->IsReplayPending || !isPortDeviceRegistered(setpoint->PortNumber))
         {
-            log_e("failed to connect");
-            return false;
+            continue;
         }
+        setpoint->IsReplayPending = false;
+        log_d("replay motor setpoint of port %x", setpoint->PortNumber);
+        writeCharacteristic(setpoint->Command, setpoint->Length);
+        trackPortOutputCommand(setpoint->Command, setpoint->Length);
+        return;
     }
+}
 
-    log_d("connected to: %s, RSSI: %d", pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
-    BLERemoteService *pRemoteService = pClient->getService(_bleUuid);
-    if (pRemoteService == nullptr)
+/**
+ * @brief Request the parameters of the BLE connection. A short connection interval reduces the latency
+ * between a command and its execution on the hub (and between a sensor change and the notification)
+ * at the cost of more power and air time. The parameters are used for the next connect and are updated
+ * immediately if the hub is already connected. The hub could reject the request, the negotiated values
+ * are available with getConnectionParameters()
+ * @param [in] minInterval min. connection interval in unit 1.25 ms (6..3200, 6 = 7.5 ms)
+ * @param [in] maxInterval max. connection interval in unit 1.25 ms (6..3200)
+ * @param [in] latency number of connection events the hub is allowed to skip (0..499)
+ * @param [in] timeout supervision timeout in unit 10 ms (10..3200)
+ */
+void Lpf2Hub::setConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout)
+{
+    _minConnectionInterval = minInterval;
+    _maxConnectionInterval = max(minInterval, maxInterval);
+    _connectionLatency = latency;
+    _supervisionTimeout = timeout;
+    _hasConnectionParameters = true;
+    if (_isConnected && _pClient != nullptr)
     {
-        log_e("failed to get ble client");
-        return false;
+        _pClient->updateConnParams(_minConnectionInterval, _maxConnectionInterval, _connectionLatency, _supervisionTimeout);
     }
+}
 
-    _pRemoteCharacteristic = pRemoteService->getCharacteristic(_charachteristicUuid);
-    if (_pRemoteCharacteristic == nullptr)
+/**
+ * @brief Retrieve the parameters which are negotiated for the current connection
+ * @return connection interval in unit 1.25 ms, latency and supervision timeout in unit 10 ms (all 0 if not connected)
+ */
+ConnectionParameters Lpf2Hub::getConnectionParameters()
+{
+    ConnectionParameters connectionParameters = {0, 0, 0};
+    if (_isConnected && _pClient != nullptr)
     {
-        log_e("failed to get ble service");
-        return false;
+        NimBLEConnInfo connInfo = _pClient->getConnInfo();
+        connectionParameters.Interval = connInfo.getConnInterval();
+        connectionParameters.Latency = connInfo.getConnLatency();
+        connectionParameters.Timeout = connInfo.getConnTimeout();
     }
+    return connectionParameters;
+}
 
-    // register notifications (callback function) for the characteristic
-    if (_pRemoteCharacteristic->canNotify())
+/**
+ * @brief Pass the requested connection parameters to the client before a connect
+ * @param [in] pClient client which is used for the connect
+ */
+void Lpf2Hub::applyConnectionParameters(NimBLEClient *pClient)
+{
+    if (_hasConnectionParameters)
     {
-        _pRemoteCharacteristic->subscribe(true, std::bind(&Lpf2Hub::notifyCallback, this, _1, _2, _3, _4), true);
+        pClient->setConnectionParams(_minConnectionInterval, _maxConnectionInterval, _connectionLatency, _supervisionTimeout);
     }
+}
 
-    // add callback instance to get notified if a disconnect event appears
-    pClient->setClientCallbacks(new Lpf2HubClientCallback(this));
-
-    // Set states
-    _isConnected = true;
-    _isConnecting = false;
+/**
+ * @brief Check a connection parameter update which is requested by the hub. If parameters are requested by
+ * setConnectionParameters, the hub is not allowed to increase the interval above the requested max. interval
+ * @param [in] params parameters which are requested by the hub
+ * @return true if the update is accepted
+ */
+bool Lpf2Hub::acceptConnectionParameters(const ble_gap_upd_params *params)
+{
+    if (_hasConnectionParameters && params->itvl_min > _maxConnectionInterval)
+    {
+        log_d("reject connection interval %d (max %d)", params->itvl_min, _maxConnectionInterval);
+        return false;
+    }
     return true;
 }
 
+/**
+ * @brief Retrieve the state of the connection pipeline
+ * @return connection state
+ */
+HubConnectionState Lpf2Hub::getConnectionState()
+{
+    return _connectionState.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Retrieve the duration of the phases of the last finished connect. The timing is read
+ * with a sequence lock, so it is consistent also while the connect task finishes a connect
+ * @return duration of the phases in unit microseconds
+ */
+ConnectionTiming Lpf2Hub::getConnectionTiming()
+{
+    ConnectionTiming timing;
+    uint32_t lockBefore;
+    uint32_t lockAfter;
+    do
+    {
+        lockBefore = _connectionTimingLock.load(std::memory_order_acquire);
+        memcpy(&timing, &_connectionTiming, sizeof(ConnectionTiming));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        lockAfter = _connectionTimingLock.load(std::memory_order_relaxed);
+    } while ((lockBefore & 1) || lockBefore != lockAfter);
+    return timing;
+}
+
 /**
  * @brief Retrieve the connection state. The BLE client (ESP32) has found a service with the desired UUID (HUB)
  * If this state is available, you can try to connect to the Hub
@@ -1215,8 +4166,23 @@ std::string Lpf2Hub::getHubName()
  */
 void Lpf2Hub::setBasicMotorSpeed(byte port, int speed = 0)
 {
-    byte setMotorCommand[8] = {0x81, port, 0x11, 0x51, 0x00, LegoinoCommon::MapSpeed(speed)}; //train, batmobil
-    WriteValue(setMotorCommand, 6);
+    Lpf2HubMessage setMotorCommand = encodeBasicMotorSpeed(port, speed);
+    writePortCommand(setMotorCommand, false);
+    recordMotorSetpoint(port, setMotorCommand);
+}
+
+/**
+ * @brief Encode the command to set the motor speed on a defined port (see setBasicMotorSpeed)
+ * @param [in] port Port of the Hub on which the speed of the motor will set (A, B)
+ * @param [in] speed Speed of the Motor -100..0..100 negative values will reverse the rotation
+ * @return encoded command
+ */
+Lpf2HubMessage Lpf2Hub::encodeBasicMotorSpeed(byte port, int speed)
+{
+    Lpf2HubMessage setMotorCommand(port, 0x11, 0x51); //train, batmobil
+    setMotorCommand.writeUInt8(0x00);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speed));
+    return setMotorCommand;
 }
 
 /**
@@ -1234,10 +4200,29 @@ void Lpf2Hub::stopBasicMotor(byte port)
  * @param [in] speed Speed of the Motor -100..0..100 negative values will reverse the rotation
  */
 void Lpf2Hub::setTachoMotorSpeed(byte port, int speed, byte maxPower, BrakingStyle brakingStyle)
+{
+    Lpf2HubMessage setMotorCommand = encodeTachoMotorSpeed(port, speed, maxPower, brakingStyle);
+    writePortCommand(setMotorCommand, false);
+    recordMotorSetpoint(port, setMotorCommand);
+}
+
+/**
+ * @brief Encode the command to set the speed of a tacho motor (see setTachoMotorSpeed)
+ * @param [in] port Port of the Hub on which the speed of the motor will set (A, B, AB, C, D)
+ * @param [in] speed Speed of the Motor -100..0..100 negative values will reverse the rotation
+ * @param [in] maxPower Maximum power level 0..100
+ * @param [in] brakingStyle brake behavior after the motor is stopped
+ * @return encoded command
+ */
+Lpf2HubMessage Lpf2Hub::encodeTachoMotorSpeed(byte port, int speed, byte maxPower, BrakingStyle brakingStyle)
 {
     //Use acc and dec profile (0x03 last two bits set)
-    byte setMotorCommand[8] = {0x81, port, 0x11, 0x01, LegoinoCommon::MapSpeed(speed), maxPower, (byte)brakingStyle, 0x03};
-    WriteValue(setMotorCommand, 8);
+    Lpf2HubMessage setMotorCommand(port, 0x11, 0x01);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speed));
+    setMotorCommand.writeUInt8(maxPower);
+    setMotorCommand.writeUInt8((byte)brakingStyle);
+    setMotorCommand.writeUInt8(0x03);
+    return setMotorCommand;
 }
 
 /**
@@ -1256,9 +4241,10 @@ void Lpf2Hub::stopTachoMotor(byte port)
  */
 void Lpf2Hub::setAccelerationProfile(byte port, int16_t time)
 {
-    byte *timeBytes = LegoinoCommon::Int16ToByteArray(time);
-    byte setMotorCommand[7] = {0x81, port, 0x10, 0x05, timeBytes[0], timeBytes[1], 0x01};
-    WriteValue(setMotorCommand, 7);
+    Lpf2HubMessage setMotorCommand(port, 0x10, 0x05);
+    setMotorCommand.writeInt16LE(time);
+    setMotorCommand.writeUInt8(0x01);
+    WriteValue(setMotorCommand);
 }
 
 /**
@@ -1268,9 +4254,10 @@ void Lpf2Hub::setAccelerationProfile(byte port, int16_t time)
  */
 void Lpf2Hub::setDecelerationProfile(byte port, int16_t time)
 {
-    byte *timeBytes = LegoinoCommon::Int16ToByteArray(time);
-    byte setMotorCommand[7] = {0x81, port, 0x10, 0x06, timeBytes[0], timeBytes[1], 0x02};
-    WriteValue(setMotorCommand, 7);
+    Lpf2HubMessage setMotorCommand(port, 0x10, 0x06);
+    setMotorCommand.writeInt16LE(time);
+    setMotorCommand.writeUInt8(0x02);
+    WriteValue(setMotorCommand);
 }
 
 /**
@@ -1280,13 +4267,18 @@ void Lpf2Hub::setDecelerationProfile(byte port, int16_t time)
  * @param [in] time Time in miliseconds for running the motor on the desired speed
  * @param [in] maximum Power of the Motor 0..100 (default value = 100)
  * @param [in] brakingStyle Braking style how the motor will stop. Brake(default), Float, Hold are available
+ * @return handle which is resolved by the port output command feedback
  */
-void Lpf2Hub::setTachoMotorSpeedForTime(byte port, int speed, int16_t time = 0, byte maxPower, BrakingStyle brakingStyle)
+Lpf2CommandHandle Lpf2Hub::setTachoMotorSpeedForTime(byte port, int speed, int16_t time = 0, byte maxPower, BrakingStyle brakingStyle)
 {
     //Use acc and dec profile (0x03 last two bits set)
-    byte *timeBytes = LegoinoCommon::Int16ToByteArray(time);
-    byte setMotorCommand[10] = {0x81, port, 0x11, 0x09, timeBytes[0], timeBytes[1], LegoinoCommon::MapSpeed(speed), maxPower, (byte)brakingStyle, 0x03};
-    WriteValue(setMotorCommand, 10);
+    Lpf2HubMessage setMotorCommand(port, 0x11, 0x09);
+    setMotorCommand.writeInt16LE(time);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speed));
+    setMotorCommand.writeUInt8(maxPower);
+    setMotorCommand.writeUInt8((byte)brakingStyle);
+    setMotorCommand.writeUInt8(0x03);
+    return writePortCommand(setMotorCommand, true);
 }
 
 /**
@@ -1296,13 +4288,18 @@ void Lpf2Hub::setTachoMotorSpeedForTime(byte port, int speed, int16_t time = 0,
  * @param [in] time Time in miliseconds for running the motor on the desired speed
  * @param [in] maximum Power of the Motor 0..100 (default value = 100)
  * @param [in] brakingStyle Braking style how the motor will stop. Brake(default), Float, Hold are available
+ * @return handle which is resolved by the port output command feedback
  */
-void Lpf2Hub::setTachoMotorSpeedForDegrees(byte port, int speed, int32_t degrees, byte maxPower, BrakingStyle brakingStyle)
+Lpf2CommandHandle Lpf2Hub::setTachoMotorSpeedForDegrees(byte port, int speed, int32_t degrees, byte maxPower, BrakingStyle brakingStyle)
 {
-    byte *degreeBytes = LegoinoCommon::Int32ToByteArray(degrees);
     //Use acc and dec profile (0x03 last two bits set)
-    byte setMotorCommand[12] = {0x81, port, 0x11, 0x0B, degreeBytes[0], degreeBytes[1], degreeBytes[2], degreeBytes[3], LegoinoCommon::MapSpeed(speed), maxPower, (byte)brakingStyle, 0x03};
-    WriteValue(setMotorCommand, 12);
+    Lpf2HubMessage setMotorCommand(port, 0x11, 0x0B);
+    setMotorCommand.writeInt32LE(degrees);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speed));
+    setMotorCommand.writeUInt8(maxPower);
+    setMotorCommand.writeUInt8((byte)brakingStyle);
+    setMotorCommand.writeUInt8(0x03);
+    return writePortCommand(setMotorCommand, true);
 }
 
 /**
@@ -1312,13 +4309,18 @@ void Lpf2Hub::setTachoMotorSpeedForDegrees(byte port, int speed, int32_t degrees
  * @param [in] position Position in degrees (relative to zero point on power up, or encoder reset) -2,147,483,648..0..2,147,483,647
  * @param [in] maximum Power of the Motor 0..100 (default value = 100)
  * @param [in] brakingStyle Braking style how the motor will stop. Brake(default), Float, Hold are available
+ * @return handle which is resolved by the port output command feedback
  */
-void Lpf2Hub::setAbsoluteMotorPosition(byte port, int speed, int32_t position, byte maxPower, BrakingStyle brakingStyle)
+Lpf2CommandHandle Lpf2Hub::setAbsoluteMotorPosition(byte port, int speed, int32_t position, byte maxPower, BrakingStyle brakingStyle)
 {
-    byte *positionBytes = LegoinoCommon::Int32ToByteArray(position);
     //Use acc and dec profile (0x03 last two bits set)
-    byte setMotorCommand[12] = {0x81, port, 0x11, 0x0D, positionBytes[0], positionBytes[1], positionBytes[2], positionBytes[3], LegoinoCommon::MapSpeed(speed), maxPower, (byte)brakingStyle, 0x03};
-    WriteValue(setMotorCommand, 12);
+    Lpf2HubMessage setMotorCommand(port, 0x11, 0x0D);
+    setMotorCommand.writeInt32LE(position);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speed));
+    setMotorCommand.writeUInt8(maxPower);
+    setMotorCommand.writeUInt8((byte)brakingStyle);
+    setMotorCommand.writeUInt8(0x03);
+    return writePortCommand(setMotorCommand, true);
 }
 
 /**
@@ -1328,11 +4330,12 @@ void Lpf2Hub::setAbsoluteMotorPosition(byte port, int speed, int32_t position, b
  */
 void Lpf2Hub::setAbsoluteMotorEncoderPosition(byte port, int32_t position)
 {
-    byte *positionBytes = LegoinoCommon::Int32ToByteArray(position);
     //WriteModeData (0x51)
     //PresetEncoder mode (0x02)
-    byte setMotorCommand[9] = {0x81, port, 0x11, 0x51, 0x02, positionBytes[0], positionBytes[1], positionBytes[2], positionBytes[3]};
-    WriteValue(setMotorCommand, 9);
+    Lpf2HubMessage setMotorCommand(port, 0x11, 0x51);
+    setMotorCommand.writeUInt8(0x02);
+    setMotorCommand.writeInt32LE(position);
+    WriteValue(setMotorCommand);
 }
 
 /**
@@ -1342,14 +4345,143 @@ void Lpf2Hub::setAbsoluteMotorEncoderPosition(byte port, int32_t position)
  * @param [in] degrees till which rotation in degrees the motors should run
  * @param [in] maximum Power of the Motor 0..100 (default value = 100)
  * @param [in] brakingStyle Braking style how the motor will stop. Brake(default), Float, Hold are available
+ * @return handle which is resolved by the port output command feedback
+ */
+Lpf2CommandHandle Lpf2Hub::setTachoMotorSpeedsForDegrees(int speedLeft, int speedRight, int32_t degrees, byte maxPower, BrakingStyle brakingStyle)
+{
+    return setVirtualPortMotorSpeedsForDegrees((byte)MoveHubPort::AB, speedLeft, speedRight, degrees, maxPower, brakingStyle);
+}
+
+/**
+ * @brief Create a virtual port of two physical ports with tacho motors. The hub reports the new
+ * virtual port with an attached virtual io event, afterwards the port number is available via getVirtualPort.
+ * Both motors could then be controlled with one command (and in the same connection event)
+ * @param [in] portA port of the left motor
+ * @param [in] portB port of the right motor
+ */
+void Lpf2Hub::createVirtualPort(byte portA, byte portB)
+{
+    bool isKnown = false;
+    for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
+    {
+        if (_virtualPorts[idx].PortA == portA && _virtualPorts[idx].PortB == portB)
+        {
+            isKnown = true;
+            break;
+        }
+    }
+    if (!isKnown)
+    {
+        if (_numberOfVirtualPorts >= LPF2_MAX_VIRTUAL_PORTS)
+        {
+            log_w("max number of virtual ports reached: %d", LPF2_MAX_VIRTUAL_PORTS);
+            return;
+        }
+        _virtualPorts[_numberOfVirtualPorts++] = {LPF2_NO_PORT, portA, portB, false};
+    }
+    writeVirtualPortSetup(portA, portB);
+}
+
+/**
+ * @brief Delete a virtual port which was created with createVirtualPort
+ * @param [in] virtualPort number of the virtual port
+ */
+void Lpf2Hub::deleteVirtualPort(byte virtualPort)
+{
+    for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
+    {
+        if (_virtualPorts[idx].PortNumber == virtualPort)
+        {
+            _virtualPorts[idx] = _virtualPorts[--_numberOfVirtualPorts];
+            break;
+        }
+    }
+    Lpf2HubMessage virtualPortSetup(MessageType::VIRTUAL_PORT_SETUP);
+    virtualPortSetup.writeUInt8(0x00); // disconnect
+    virtualPortSetup.writeUInt8(virtualPort);
+    WriteValue(virtualPortSetup);
+}
+
+/**
+ * @brief Get the number of the virtual port of two physical ports
+ * @param [in] portA port of the left motor
+ * @param [in] portB port of the right motor
+ * @return port number or LPF2_NO_PORT if the hub has not reported the virtual port (yet)
+ */
+byte Lpf2Hub::getVirtualPort(byte portA, byte portB)
+{
+    for (int idx = 0; idx < _numberOfVirtualPorts; idx++)
+    {
+        if (_virtualPorts[idx].PortA == portA && _virtualPorts[idx].PortB == portB)
+        {
+            return _virtualPorts[idx].PortNumber;
+        }
+    }
+    return LPF2_NO_PORT;
+}
+
+/**
+ * @brief Set the speeds of the two motors of a virtual port
+ * @param [in] virtualPort number of the virtual port (e.g. from getVirtualPort or MoveHubPort::AB)
+ * @param [in] speedLeft Speed of the left motor -100..0..100
+ * @param [in] speedRight Speed of the right motor -100..0..100
+ * @param [in] maxPower Maximum power level 0..100
+ */
+void Lpf2Hub::setVirtualPortMotorSpeeds(byte virtualPort, int speedLeft, int speedRight, byte maxPower)
+{
+    //Use acc and dec profile (0x03 last two bits set)
+    Lpf2HubMessage setMotorCommand(virtualPort, 0x11, 0x08);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speedLeft));
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speedRight));
+    setMotorCommand.writeUInt8(maxPower);
+    setMotorCommand.writeUInt8(0x03);
+    writePortCommand(setMotorCommand, false);
+}
+
+/**
+ * @brief Set the speeds of the two motors of a virtual port for a given time
+ * @param [in] virtualPort number of the virtual port (e.g. from getVirtualPort or MoveHubPort::AB)
+ * @param [in] speedLeft Speed of the left motor -100..0..100
+ * @param [in] speedRight Speed of the right motor -100..0..100
+ * @param [in] time Time in unit milliseconds
+ * @param [in] maxPower Maximum power level 0..100
+ * @param [in] brakingStyle Braking style how the motors will stop. Brake(default), Float, Hold are available
+ * @return handle which is resolved by the port output command feedback
+ */
+Lpf2CommandHandle Lpf2Hub::setVirtualPortMotorSpeedsForTime(byte virtualPort, int speedLeft, int speedRight, int16_t time, byte maxPower, BrakingStyle brakingStyle)
+{
+    //Use acc and dec profile (0x03 last two bits set)
+    Lpf2HubMessage setMotorCommand(virtualPort, 0x11, 0x0A);
+    setMotorCommand.writeInt16LE(time);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speedLeft));
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speedRight));
+    setMotorCommand.writeUInt8(maxPower);
+    setMotorCommand.writeUInt8((byte)brakingStyle);
+    setMotorCommand.writeUInt8(0x03);
+    return writePortCommand(setMotorCommand, true);
+}
+
+/**
+ * @brief Set the speeds of the two motors of a virtual port till a rotation in degrees is reached
+ * @param [in] virtualPort number of the virtual port (e.g. from getVirtualPort or MoveHubPort::AB)
+ * @param [in] speedLeft Speed of the left motor -100..0..100
+ * @param [in] speedRight Speed of the right motor -100..0..100
+ * @param [in] degrees till which rotation in degrees the motors should run
+ * @param [in] maxPower Maximum power level 0..100
+ * @param [in] brakingStyle Braking style how the motors will stop. Brake(default), Float, Hold are available
+ * @return handle which is resolved by the port output command feedback
  */
-void Lpf2Hub::setTachoMotorSpeedsForDegrees(int speedLeft, int speedRight, int32_t degrees, byte maxPower, BrakingStyle brakingStyle)
+Lpf2CommandHandle Lpf2Hub::setVirtualPortMotorSpeedsForDegrees(byte virtualPort, int speedLeft, int speedRight, int32_t degrees, byte maxPower, BrakingStyle brakingStyle)
 {
-    byte *degreeBytes = LegoinoCommon::Int32ToByteArray(degrees);
-    byte port = (byte)MoveHubPort::AB;
     //Use acc and dec profile (0x03 last two bits set)
-    byte setMotorCommand[13] = {0x81, port, 0x11, 0x0C, degreeBytes[0], degreeBytes[1], degreeBytes[2], degreeBytes[3], LegoinoCommon::MapSpeed(speedLeft), LegoinoCommon::MapSpeed(speedRight), maxPower, (byte)brakingStyle, 0x03}; //boost with time
-    WriteValue(setMotorCommand, 13);
+    Lpf2HubMessage setMotorCommand(virtualPort, 0x11, 0x0C); //boost with time
+    setMotorCommand.writeInt32LE(degrees);
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speedLeft));
+    setMotorCommand.writeUInt8(LegoinoCommon::MapSpeed(speedRight));
+    setMotorCommand.writeUInt8(maxPower);
+    setMotorCommand.writeUInt8((byte)brakingStyle);
+    setMotorCommand.writeUInt8(0x03);
+    return writePortCommand(setMotorCommand, true);
 }
 
 /**
@@ -1358,10 +4490,11 @@ void Lpf2Hub::setTachoMotorSpeedsForDegrees(int speedLeft, int speedRight, int32
  */
 void Lpf2Hub::playSound(byte sound)
 {
-    byte setSoundMode[8] = {0x41, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x01};
-    WriteValue(setSoundMode, 8);
-    byte playSound[6] = {0x81, 0x01, 0x11, 0x51, 0x01, sound};
-    WriteValue(playSound, 6);
+    writePortInputFormatSetup(0x01, 0x01, 1, true);
+    Lpf2HubMessage playSound(0x01, 0x11, 0x51);
+    playSound.writeUInt8(0x01);
+    playSound.writeUInt8(sound);
+    WriteValue(playSound);
 }
 
 /**
@@ -1371,10 +4504,11 @@ void Lpf2Hub::playSound(byte sound)
  */
 void Lpf2Hub::playTone(byte number)
 {
-    byte setToneMode[8] = {0x41, 0x01, 0x02, 0x01, 0x00, 0x00, 0x00, 0x01};
-    WriteValue(setToneMode, 8);
-    byte playTone[6] = {0x81, 0x01, 0x11, 0x51, 0x02, number};
-    WriteValue(playTone, 6);
+    writePortInputFormatSetup(0x01, 0x02, 1, true);
+    Lpf2HubMessage playTone(0x01, 0x11, 0x51);
+    playTone.writeUInt8(0x02);
+    playTone.writeUInt8(number);
+    WriteValue(playTone);
 }
 
 /**
@@ -1383,8 +4517,11 @@ void Lpf2Hub::playTone(byte number)
  */
 void Lpf2Hub::setMarioVolume(byte volume)
 {
-    byte setVolume[4] = {0x01, 0x12, 0x01, volume};
-    WriteValue(setVolume, 4);
+    Lpf2HubMessage setVolume(MessageType::HUB_PROPERTIES);
+    setVolume.writeUInt8(0x12);
+    setVolume.writeUInt8((byte)HubPropertyOperation::SET_DOWNSTREAM);
+    setVolume.writeUInt8(volume);
+    WriteValue(setVolume);
 }
 
-#endif // ESP32
\ No newline at end of file
+#endif // ESP32 || LEGOINO_NATIVE
\ No newline at end of file
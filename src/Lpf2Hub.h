@@ -6,7 +6,7 @@
  * 
 */
 
-#if defined(ESP32)
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
 
 #ifndef Lpf2Hub_h
 #define Lpf2Hub_h
@@ -15,34 +15,309 @@
 #include "NimBLEDevice.h"
 #include "Lpf2HubConst.h"
 #include "LegoinoCommon.h"
+#include "Lpf2HubMessage.h"
+#include "Lpf2HubEventQueue.h"
+#include "Lpf2HubCapabilityCache.h"
 
 using namespace std::placeholders;
 
+// max number of devices (built-in, external and virtual ports) which could be registered
+#define LPF2_MAX_CONNECTED_DEVICES 32
+// marker values of the port and device type index tables
+#define LPF2_NO_DEVICE_INDEX 255
+#define LPF2_NO_PORT 255
+
+// max number of mode/dataset entries of a combined mode subscription
+#define LPF2_MAX_COMBINED_MODE_DATASETS 8
+
+// stack size of the worker task of the asynchronous connect
+#ifndef LPF2_CONNECT_TASK_STACK_SIZE
+#define LPF2_CONNECT_TASK_STACK_SIZE 4096
+#endif
+
+// default supervision timeout of setConnectionParameters in unit 10 ms
+#define LPF2_DEFAULT_SUPERVISION_TIMEOUT 200
+
+// bounds of the exponential backoff between reconnect attempts in unit milliseconds
+#define LPF2_RECONNECT_MIN_BACKOFF 500
+#define LPF2_RECONNECT_MAX_BACKOFF 30000
+
+// max number of motor setpoints (last speed command per port) which are replayed after a reconnect
+#define LPF2_MAX_MOTOR_SETPOINTS 8
+
+// max number of virtual ports (synchronized motor pairs) which are created by createVirtualPort
+#define LPF2_MAX_VIRTUAL_PORTS 4
+
+// max number of port output commands which are tracked for completion handles at the same time
+#define LPF2_MAX_TRACKED_COMMANDS 16
+#define LPF2_NO_TRACKED_COMMAND 255
+
+// max number of ports with a client side command queue and max number of commands per queue
+#define LPF2_MAX_COMMAND_QUEUES 4
+#define LPF2_COMMAND_QUEUE_LENGTH 8
+
+// commands of a queue which are sent to the hub at the same time (one in execution, one in the buffer of the hub)
+#define LPF2_MAX_BUFFERED_COMMANDS 2
+
+// startup and completion information of port output commands
+#define LPF2_STARTUP_IMMEDIATE_WITH_FEEDBACK 0x11
+#define LPF2_STARTUP_BUFFERED_WITH_FEEDBACK 0x01
+
+// size of the hub property decoder table (hub property references 0x00..0x3F)
+#define LPF2_MAX_HUB_PROPERTIES 64
+
+// max number of ports with a cached latest value (the slot of a port is released when its device is detached)
+// and max number of cached values (datasets) per port
+#ifndef LPF2_MAX_PORT_VALUES
+#define LPF2_MAX_PORT_VALUES 16
+#endif
+#define LPF2_MAX_PORT_VALUE_DATASETS 4
+#define LPF2_NO_PORT_VALUE 255
+// mode of a cached port value which was received as combined mode update
+#define LPF2_COMBINED_MODE 0xFF
+
+// timeout of a port or mode information request of the port discovery and number of retries before the port is skipped
+#define LPF2_DISCOVERY_REQUEST_TIMEOUT 1000
+#define LPF2_DISCOVERY_REQUEST_RETRIES 2
+// information type of the port discovery step which requests the mode info of the port (PORT_INFORMATION_REQUEST)
+#define LPF2_DISCOVERY_PORT_INFORMATION 0xFF
+
+// number of per message type counters of the hub statistics (upstream message types and one for all others)
+#define LPF2_MESSAGE_TYPE_COUNTERS 16
+
+// debug output of the per-message paths (parsers, frame dispatch, port lookups). It is compiled out unless
+// LEGOINO_HOT_PATH_LOGGING is set, also if CORE_DEBUG_LEVEL enables log_d, because formatting a message
+// costs more than parsing it. The hub statistics (getHubStatistics) are always available
+#ifndef LEGOINO_HOT_PATH_LOGGING
+#define LEGOINO_HOT_PATH_LOGGING 0
+#endif
+
+#if LEGOINO_HOT_PATH_LOGGING
+#define log_hot_d(format, ...) log_d(format, ##__VA_ARGS__)
+#define log_hot_w(format, ...) log_w(format, ##__VA_ARGS__)
+#else
+#define log_hot_d(format, ...)
+#define log_hot_w(format, ...)
+#endif
+
 typedef void (*HubPropertyChangeCallback)(void *hub, HubPropertyReference hubProperty, uint8_t *pData);
 typedef void (*PortValueChangeCallback)(void *hub, byte portNumber, DeviceType deviceType, uint8_t *pData);
+typedef void (*PortCombinedValueChangeCallback)(void *hub, byte portNumber, DeviceType deviceType, byte mode, byte dataset, int32_t value);
+typedef void (*PortCommandFeedbackCallback)(void *hub, byte portNumber, byte feedback);
+typedef void (*CommandCompletionCallback)(void *hub, byte portNumber, CommandState state);
+
+class Lpf2Hub;
+
+// lightweight handle of a timed or positional motor command which is resolved by the port output command feedback
+class Lpf2CommandHandle
+{
+public:
+  Lpf2CommandHandle() : _hub(nullptr), _slot(LPF2_NO_TRACKED_COMMAND), _id(0) {}
+  Lpf2CommandHandle(Lpf2Hub *hub, byte slot, uint16_t id) : _hub(hub), _slot(slot), _id(id) {}
+
+  bool isValid() const;
+  CommandState getState() const;
+  bool isDone() const;
+  bool isCompleted() const;
+  void setTimeout(uint32_t timeout);
+  void onDone(CommandCompletionCallback callback);
+
+private:
+  Lpf2Hub *_hub;
+  byte _slot;
+  uint16_t _id;
+};
+
+// port output command which is tracked for a Lpf2CommandHandle
+struct TrackedCommand
+{
+  uint16_t Id;
+  byte PortNumber;
+  CommandState State;
+  // false while the command waits in the client side queue, sequence gives the send order
+  bool IsSent;
+  uint16_t Sequence;
+  uint32_t StartTime;
+  uint32_t Timeout;
+  CommandCompletionCallback Callback;
+};
+
+// resolved command whose callback is called after the state lock of the hub is released
+struct CommandCompletion
+{
+  CommandCompletionCallback Callback;
+  byte PortNumber;
+  CommandState State;
+};
+
+// port output command in the client side queue
+struct QueuedCommand
+{
+  byte TrackingSlot;
+  CommandPriority Priority;
+  byte Length;
+  byte Data[LPF2_MAX_MESSAGE_LENGTH];
+};
+
+// client side command queue of a port, index 0 is the next command
+struct PortCommandQueue
+{
+  byte PortNumber;
+  byte Count;
+  QueuedCommand Commands[LPF2_COMMAND_QUEUE_LENGTH];
+};
+
+// duration of the phases of a connect in unit microseconds
+struct ConnectionTiming
+{
+  uint32_t Connect;
+  uint32_t Discover;
+  uint32_t Subscribe;
+  uint32_t Total;
+};
+
+// negotiated parameters of the connection, interval in unit 1.25 ms, timeout in unit 10 ms
+struct ConnectionParameters
+{
+  uint16_t Interval;
+  uint16_t Latency;
+  uint16_t Timeout;
+};
+
+// counters of the reconnect supervisor, durations in unit milliseconds
+struct ReconnectStatistics
+{
+  uint32_t Disconnects;
+  uint32_t Reconnects;
+  uint32_t FailedAttempts;
+  uint32_t LastTimeToRecover;
+  uint32_t MaxTimeToRecover;
+};
+
+// counters of the notification and command paths. Unknown ports are messages and lookups of ports without a
+// registered device, drops are messages with an invalid length and notifications lost by an event queue overflow,
+// port value overflows are values which are not cached because all LPF2_MAX_PORT_VALUES slots are assigned
+struct HubStatistics
+{
+  uint32_t MessagesIn;
+  uint32_t BytesIn;
+  uint32_t MessagesOut;
+  uint32_t BytesOut;
+  uint32_t UnknownPorts;
+  uint32_t Drops;
+  uint32_t PortValueOverflows;
+};
+
+// latest decoded value of a port. The values are the datasets of the mode in device units (e.g. degrees of a tacho
+// motor, raw axis values of a tilt sensor). Voltage (mV), current (mA), color/distance sensor (color, distance in mm)
+// and Mario barcode sensor (barcode, color) in their default mode are decoded like the parse methods
+struct PortValue
+{
+  // number of received updates of the port (0: no value received)
+  uint32_t Sequence;
+  // millis() of the last update
+  uint32_t Timestamp;
+  byte DeviceType;
+  // mode of the update or LPF2_COMBINED_MODE (values in the order of the mode/dataset combination)
+  byte Mode;
+  byte NumberOfValues;
+  int32_t Values[LPF2_MAX_PORT_VALUE_DATASETS];
+};
+
+// cached latest value of a port, written by the dispatch of the notifications and read by the user loop
+struct PortValueSlot
+{
+  // sequence lock, odd while the value is written
+  std::atomic<uint32_t> Lock;
+  byte PortNumber;
+  // value format of the last decoded mode (0 datasets: one value with the size of the message)
+  byte FormatDeviceType;
+  byte FormatMode;
+  byte FormatDatasets;
+  byte FormatValueSize;
+  bool FormatIsFloat;
+  // generation of the capability cache which was used for the value format
+  uint32_t FormatCapabilityGeneration;
+  PortValue Value;
+};
+
+// port subscription of activatePortDevice or activatePortDeviceCombinedMode which is replayed after a reconnect
+struct PortSubscription
+{
+  byte PortNumber;
+  bool IsCombinedMode;
+  byte Mode;
+  uint32_t DeltaInterval;
+  PortValueChangeCallback Callback;
+  byte NumberOfModes;
+  byte Modes[LPF2_MAX_COMBINED_MODE_DATASETS];
+  PortCombinedValueChangeCallback CombinedCallback;
+  bool IsReplayPending;
+};
+
+// last speed command of a motor port
+struct MotorSetpoint
+{
+  byte PortNumber;
+  byte Length;
+  byte Command[LPF2_MAX_MESSAGE_LENGTH];
+  bool IsReplayPending;
+};
+
+// virtual port of two physical ports, port number is LPF2_NO_PORT until the hub reports the virtual port
+struct VirtualPort
+{
+  byte PortNumber;
+  byte PortA;
+  byte PortB;
+  bool IsReplayPending;
+};
 
 struct Device
 {
   byte PortNumber;
   byte DeviceType;
   PortValueChangeCallback Callback;
+  // software version of the attached io message and true until the port discovery has checked the device
+  uint32_t SoftwareVersion;
+  bool IsDiscoveryPending;
+  // last input format (mode, delta interval, notification) which was set up for the port
+  bool HasInputFormat;
+  byte Mode;
+  uint32_t DeltaInterval;
+  bool NotificationEnabled;
+  // mode/dataset entries (mode << 4 | dataset) of a combined mode subscription
+  byte CombinedModeDatasetCount;
+  byte CombinedModeDatasets[LPF2_MAX_COMBINED_MODE_DATASETS];
+  byte CombinedModeValueSizes[LPF2_MAX_COMBINED_MODE_DATASETS];
+  PortCombinedValueChangeCallback CombinedCallback;
 };
 
 class Lpf2Hub
 {
 
 public:
-  // constructor
+  // constructor and destructor (frees the event queue of the deferred dispatch)
   Lpf2Hub();
+  virtual ~Lpf2Hub();
 
   // initializer methods
   void init();
   void init(uint32_t scanDuration);
   void init(std::string deviceAddress);
   void init(std::string deviceAddress, uint32_t scanDuration);
+  void initDirect(std::string deviceAddress, HubType hubType = HubType::UNKNOWNHUB);
 
   // hub related methods
   bool connectHub();
+  bool connectHubAsync();
+  HubConnectionState getConnectionState();
+  ConnectionTiming getConnectionTiming();
+  void setConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency = 0, uint16_t timeout = LPF2_DEFAULT_SUPERVISION_TIMEOUT);
+  ConnectionParameters getConnectionParameters();
+  void setAutoReconnect(bool enabled, uint32_t minBackoff = LPF2_RECONNECT_MIN_BACKOFF, uint32_t maxBackoff = LPF2_RECONNECT_MAX_BACKOFF);
+  void setMotorSetpointReplay(bool enabled);
+  ReconnectStatistics getReconnectStatistics();
   bool isConnected();
   bool isConnecting();
   bool isScanning();
@@ -55,20 +330,51 @@ public:
   void deactivateHubPropertyUpdate(HubPropertyReference hubProperty);
   void requestHubPropertyUpdate(HubPropertyReference hubProperty, HubPropertyChangeCallback hubPropertyChangeCallback = nullptr);
 
+  // deferred dispatch of notifications in the user loop
+  void setDeferredDispatch(bool enabled, EventQueuePolicy policy = EventQueuePolicy::ALL_EVENTS);
+  int poll();
+  EventQueueStatistics getEventQueueStatistics();
+  void resetEventQueueStatistics();
+
+  // counters of received and sent messages
+  HubStatistics getHubStatistics();
+  uint32_t getMessageCount(MessageType messageType);
+  void resetHubStatistics();
+
+  // dispatch table registration for device types and hub properties
+  static void registerDeviceType(byte deviceType, byte mode, PortValueChangeCallback decoder);
+  static void registerHubProperty(HubPropertyReference hubProperty, HubPropertyChangeCallback decoder);
+
   // port and device related methods
   int getDeviceIndexForPortNumber(byte portNumber);
   byte getDeviceTypeForPortNumber(byte portNumber);
   byte getPortForDeviceType(byte deviceType);
-  byte getModeForDeviceType(byte deviceType);
+  byte getModeForDeviceType(byte deviceType, uint32_t softwareVersion = LPF2_ANY_SOFTWARE_VERSION);
   void registerPortDevice(byte portNumber, byte deviceType);
   void deregisterPortDevice(byte portNumber);
   void activatePortDevice(byte portNumber, byte deviceType, PortValueChangeCallback portValueChangeCallback = nullptr);
   void activatePortDevice(byte portNumber, PortValueChangeCallback portValueChangeCallback = nullptr);
+  void activatePortDevice(byte portNumber, byte mode, uint32_t deltaInterval, PortValueChangeCallback portValueChangeCallback);
+  void setPortUpdateDelta(byte portNumber, uint32_t deltaInterval);
+  void setPortMode(byte portNumber, byte mode);
   void deactivatePortDevice(byte portNumber, byte deviceType);
   void deactivatePortDevice(byte portNumber);
+  bool activatePortDeviceCombinedMode(byte portNumber, byte modes[], byte numberOfModes, PortCombinedValueChangeCallback portCombinedValueChangeCallback = nullptr, uint32_t deltaInterval = 1);
+  void deactivatePortDeviceCombinedMode(byte portNumber);
+  byte getDatasetsForDeviceMode(byte deviceType, byte mode, DatasetType *datasetType, uint32_t softwareVersion = LPF2_ANY_SOFTWARE_VERSION);
+
+  // discovery of the modes, ranges and value formats of attached devices (shared Lpf2HubCapabilityCache)
+  void setPortDiscovery(bool enabled);
+  bool isPortDiscoveryComplete();
+  const DeviceCapabilities *getPortCapabilities(byte portNumber);
+
+  // latest decoded value of each port (filled by the value notifications, also without callbacks)
+  bool getPortValue(byte portNumber, PortValue *portValue);
+  uint32_t getPortValueSequence(byte portNumber);
 
   // write (set) operations on port devices
   void WriteValue(byte command[], int size);
+  void WriteValue(const Lpf2HubMessage &message);
 
   void setLedColor(Color color);
   void setLedRGBColor(char red, char green, char blue);
@@ -77,15 +383,42 @@ public:
   void stopBasicMotor(byte port);
   void setBasicMotorSpeed(byte port, int speed);
 
+  // encoded motor commands (e.g. for the burst of Lpf2HubFleet)
+  static Lpf2HubMessage encodeBasicMotorSpeed(byte port, int speed);
+  static Lpf2HubMessage encodeTachoMotorSpeed(byte port, int speed, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+
   void setAccelerationProfile(byte port, int16_t time);
   void setDecelerationProfile(byte port, int16_t time);
   void stopTachoMotor(byte port);
   void setTachoMotorSpeed(byte port, int speed, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
-  void setTachoMotorSpeedForTime(byte port, int speed, int16_t time, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
-  void setTachoMotorSpeedForDegrees(byte port, int speed, int32_t degrees, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
-  void setTachoMotorSpeedsForDegrees(int speedLeft, int speedRight, int32_t degrees, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+  Lpf2CommandHandle setTachoMotorSpeedForTime(byte port, int speed, int16_t time, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+  Lpf2CommandHandle setTachoMotorSpeedForDegrees(byte port, int speed, int32_t degrees, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+  Lpf2CommandHandle setTachoMotorSpeedsForDegrees(int speedLeft, int speedRight, int32_t degrees, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+
+  // port output command feedback
+  void setPortCommandFeedbackCallback(PortCommandFeedbackCallback portCommandFeedbackCallback);
+  byte getPortCommandFeedback(byte port);
+  int getPortCommandsInFlight(byte port);
+  bool isPortIdle(byte port);
+  bool isPortBusy(byte port);
+
+  // buffering and client side queueing of port output commands
+  void setCommandBuffering(bool enabled);
+  void setCommandQueueing(bool enabled);
+  Lpf2CommandHandle queuePortCommand(Lpf2HubMessage message, CommandPriority priority = CommandPriority::NORMAL);
+  void emergencyStop(byte port);
+  void flushCommandQueue(byte port);
+  int getQueuedCommandCount(byte port);
 
-  void setAbsoluteMotorPosition(byte port, int speed, int32_t position, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+  // virtual ports (two motors which are controlled with one command)
+  void createVirtualPort(byte portA, byte portB);
+  void deleteVirtualPort(byte virtualPort);
+  byte getVirtualPort(byte portA, byte portB);
+  void setVirtualPortMotorSpeeds(byte virtualPort, int speedLeft, int speedRight, byte maxPower = 100);
+  Lpf2CommandHandle setVirtualPortMotorSpeedsForTime(byte virtualPort, int speedLeft, int speedRight, int16_t time, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+  Lpf2CommandHandle setVirtualPortMotorSpeedsForDegrees(byte virtualPort, int speedLeft, int speedRight, int32_t degrees, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+
+  Lpf2CommandHandle setAbsoluteMotorPosition(byte port, int speed, int32_t position, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
   void setAbsoluteMotorEncoderPosition(byte port, int32_t position);
 
   void playSound(byte sound);
@@ -93,12 +426,20 @@ public:
   void setMarioVolume(byte volume);
 
   // parse methods to read in the message content of the charachteristic value
-  void parseDeviceInfo(uint8_t *pData);
-  void parsePortMessage(uint8_t *pData);
-  void parseSensorMessage(uint8_t *pData);
+  // (length 0: the length is taken from the one byte length header of the message)
+  void parseDeviceInfo(uint8_t *pData, size_t length = 0);
+  void parsePortMessage(uint8_t *pData, size_t length = 0);
+  void parseSensorMessage(uint8_t *pData, size_t length = 0);
+  void parsePortInputFormat(uint8_t *pData, size_t length = 0);
+  void parseCombinedSensorMessage(uint8_t *pData, size_t length = 0);
+  void parsePortInformation(uint8_t *pData, size_t length = 0);
+  void parsePortModeInformation(uint8_t *pData, size_t length = 0);
   double parseVoltageSensor(uint8_t *pData);
   double parseCurrentSensor(uint8_t *pData);
   double parseDistance(uint8_t *data);
+  int parseVoltageSensorMilliVolts(uint8_t *pData);
+  int parseCurrentSensorMilliAmps(uint8_t *pData);
+  int parseDistanceMillimeters(uint8_t *pData);
   int parseColor(uint8_t *data);
   int parseReflectivity(uint8_t *pData);
   int parseTachoMotor(uint8_t *data);
@@ -113,7 +454,7 @@ public:
   MarioBarcode parseMarioBarcode(uint8_t *pData);
   MarioColor parseMarioColor(uint8_t *pData);
   ButtonState parseRemoteButton(uint8_t *pData);
-  void parsePortAction(uint8_t *pData);
+  void parsePortAction(uint8_t *pData, size_t length = 0);
   uint8_t parseSystemTypeId(uint8_t *pData);
   byte parseBatteryType(uint8_t *pData);
   uint8_t parseBatteryLevel(uint8_t *pData);
@@ -126,27 +467,193 @@ public:
   void notifyCallback(NimBLERemoteCharacteristic *pBLERemoteCharacteristic, uint8_t *pData, size_t length, bool isNotify);
   BLEUUID _bleUuid;
   BLEUUID _charachteristicUuid;
-  BLEAddress *_pServerAddress;
+  BLEAddress *_pServerAddress = nullptr;
   BLEAddress *_requestedDeviceAddress = nullptr;
+  HubType _requestedHubType = HubType::UNKNOWNHUB;
+  std::string _requestedHubName;
   BLERemoteCharacteristic *_pRemoteCharacteristic;
   BLEScan *pBLEScan;
   HubType _hubType;
   std::string _hubName;
-  boolean _isConnecting;
-  boolean _isConnected;
+  // written by the connect task and the disconnect callback, read by the user loop
+  std::atomic<bool> _isConnecting{false};
+  std::atomic<bool> _isConnected{false};
 
 private:
+  friend class Lpf2HubClientCallback;
+  friend class Lpf2HubAdvertisedDeviceCallbacks;
+  friend class Lpf2HubManager;
+  friend class Lpf2HubFleet;
+  friend class Lpf2CommandHandle;
+
+  void initWithoutScan();
+  static void connectTask(void *pvParameters);
+  bool runConnectPhases();
+  bool connectClient();
+  bool discoverCharacteristic();
+  bool subscribeCharacteristic();
+  static HubType getHubTypeForAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice);
+  bool matchesAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice, HubType hubType);
+  void applyAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice);
+
+  static void initDispatchTables();
+  void dispatchFrames(uint8_t *pData, size_t length);
+  void dispatchFrame(uint8_t *pData, size_t length);
+  void dispatchMessage(uint8_t *pData, size_t length);
+  void writeCharacteristic(const uint8_t *pData, size_t length);
+  void invalidatePortInputFormats();
+  void clearPortDevices();
+  void removePortDevice(byte portNumber);
+  bool getPortDevice(byte portNumber, Device *device);
+  bool isPortDeviceRegistered(byte portNumber);
+  void countUnknownPort(byte portNumber);
+  void attachVirtualPort(byte portNumber, byte portA, byte portB);
+  void detachVirtualPort(byte portNumber);
+  void writeVirtualPortSetup(byte portA, byte portB);
+  void trackPortOutputCommand(const uint8_t *pData, size_t length);
+  void resetPortCommandFeedback(byte portNumber);
+  void resetPortCommandFeedbacks();
+  Lpf2CommandHandle trackCommand(byte portNumber);
+  byte allocateTrackedCommand(byte portNumber);
+  void markTrackedCommandSent(byte slot);
+  int getSentCommandCount(byte portNumber);
+  Lpf2CommandHandle writePortCommand(Lpf2HubMessage &message, bool isTracked);
+  PortCommandQueue *getCommandQueue(byte portNumber, bool create);
+  void flushCommandQueue(PortCommandQueue *queue, CommandState state, CommandCompletion *completions, int *numberOfCompletions);
+  void serviceCommandQueue(PortCommandQueue *queue);
+  void serviceCommandQueues();
+  void resolveTrackedCommands(byte portNumber, byte feedback);
+  void resolveTrackedCommand(TrackedCommand *command, CommandState state, CommandCompletion *completions, int *numberOfCompletions);
+  void callCompletionCallbacks(const CommandCompletion *completions, int numberOfCompletions);
+  TrackedCommand *getTrackedCommand(byte slot, uint16_t id);
+  void expireTrackedCommands();
+  void abortTrackedCommands();
+  void handleConnectionLoss();
+  void writePortInputFormatSetup(byte portNumber, byte mode, uint32_t deltaInterval, bool notificationEnabled);
+  void writeCombinedModeSetup(byte portNumber, CombinedModeSubCommand subCommand);
+  PortSubscription *getPortSubscription(byte portNumber, bool create);
+  void removePortSubscription(byte portNumber);
+  PortValueSlot *getPortValueSlot(byte portNumber);
+  void releasePortValueSlot(byte portNumber);
+  byte decodePortValueDatasets(PortValueSlot *slot, const Device *device, byte mode, uint8_t *pData, size_t length, int32_t *values);
+  static const DeviceCapabilities *findDeviceCapabilities(byte deviceType, uint32_t softwareVersion);
+  uint32_t getPortSoftwareVersion(byte portNumber);
+  void storePortValue(const Device *device, uint8_t *pData, size_t length);
+  void writePortValue(PortValueSlot *slot, byte deviceType, byte mode, const int32_t *values, byte numberOfValues);
+  void stepPortDiscovery();
+  void writeDiscoveryRequest();
+  void finishPortDiscovery(bool isComplete);
+  void recordMotorSetpoint(byte portNumber, const Lpf2HubMessage &message);
+  void applyConnectionParameters(NimBLEClient *pClient);
+  bool acceptConnectionParameters(const ble_gap_upd_params *params);
+  void superviseConnection();
+  void replayState();
+
   // Notification callbacks
   HubPropertyChangeCallback _hubPropertyChangeCallback = nullptr;
+  PortCommandFeedbackCallback _portCommandFeedbackCallback = nullptr;
+
+  // connection pipeline
+  NimBLEClient *_pClient = nullptr;
+  NimBLEClientCallbacks *_pClientCallbacks = nullptr;
+  // true if _pRemoteCharacteristic belongs to the attribute database of the current client connection
+  bool _isAttributeCacheValid = false;
+  std::atomic<HubConnectionState> _connectionState{HubConnectionState::IDLE};
+  std::atomic<bool> _isConnectTaskRunning{false};
+  ConnectionTiming _connectionTiming = {0, 0, 0, 0};
+  std::atomic<uint32_t> _connectionTimingLock{0};
+
+  // requested connection parameters (only applied if set by setConnectionParameters)
+  bool _hasConnectionParameters = false;
+  uint16_t _minConnectionInterval = 0;
+  uint16_t _maxConnectionInterval = 0;
+  uint16_t _connectionLatency = 0;
+  uint16_t _supervisionTimeout = LPF2_DEFAULT_SUPERVISION_TIMEOUT;
+
+  // reconnect supervisor
+  bool _isAutoReconnectEnabled = false;
+  bool _isMotorSetpointReplayEnabled = false;
+  bool _isReconnecting = false;
+  bool _isReconnectAttemptRunning = false;
+  std::atomic<bool> _isDisconnectPending{false};
+  std::atomic<bool> _isConnectionLossPending{false};
+  uint32_t _disconnectTime = 0;
+  uint32_t _reconnectMinBackoff = LPF2_RECONNECT_MIN_BACKOFF;
+  uint32_t _reconnectMaxBackoff = LPF2_RECONNECT_MAX_BACKOFF;
+  uint32_t _reconnectBackoff = LPF2_RECONNECT_MIN_BACKOFF;
+  uint32_t _nextReconnectTime = 0;
+  ReconnectStatistics _reconnectStatistics = {0, 0, 0, 0, 0};
+
+  // state which is replayed after a reconnect: hub property updates (bit n: property n), port subscriptions, motor setpoints
+  uint64_t _hubPropertySubscriptions = 0;
+  bool _isHubPropertyReplayPending = false;
+  PortSubscription _portSubscriptions[LPF2_MAX_CONNECTED_DEVICES];
+  int _numberOfPortSubscriptions = 0;
+  MotorSetpoint _motorSetpoints[LPF2_MAX_MOTOR_SETPOINTS];
+  int _numberOfMotorSetpoints = 0;
+
+  // guards the tracked commands, the client side command queues and the device table, which are changed by the
+  // notifications in the NimBLE host task and by the user loop. Callbacks are never called and nothing is written
+  // while the lock is held
+  portMUX_TYPE _stateLock = portMUX_INITIALIZER_UNLOCKED;
+
+  // commands of the completion handles
+  TrackedCommand _trackedCommands[LPF2_MAX_TRACKED_COMMANDS];
+  uint16_t _nextTrackedCommandId = 1;
+  uint16_t _nextTrackedCommandSequence = 0;
+  byte _nextTrackedCommandSlot = 0;
+
+  // buffering (startup information) and client side queues of port output commands
+  bool _isCommandBuffering = false;
+  bool _isCommandQueueing = false;
+  PortCommandQueue _commandQueues[LPF2_MAX_COMMAND_QUEUES];
+  int _numberOfCommandQueues = 0;
+
+  // requested virtual ports (replayed after a reconnect)
+  VirtualPort _virtualPorts[LPF2_MAX_VIRTUAL_PORTS];
+  int _numberOfVirtualPorts = 0;
+
+  // queue of notifications which are dispatched in poll()
+  Lpf2HubEventQueue *_eventQueue = nullptr;
+  std::atomic<int> _activeNotifications{0};
+  std::atomic<bool> _isDeferredDispatch{false};
+
+  // latest value of the ports, port number -> index in _portValues
+  PortValueSlot _portValues[LPF2_MAX_PORT_VALUES];
+  std::atomic<byte> _portValueIndex[256];
+
+  // port discovery, one request is outstanding at a time. The reply handlers only fill _discovery
+  // if the reply matches the outstanding request (port, mode, information type)
+  bool _isPortDiscoveryEnabled = false;
+  DeviceCapabilities _discovery;
+  byte _discoveryPort = LPF2_NO_PORT;
+  byte _discoveryMode = 0;
+  byte _discoveryInformationType = LPF2_DISCOVERY_PORT_INFORMATION;
+  byte _discoveryRetries = 0;
+  uint32_t _discoveryRequestTime = 0;
+  std::atomic<bool> _isDiscoveryReplyReceived{false};
+
+  // counters of the notification and command paths
+  HubStatistics _hubStatistics = {0, 0, 0, 0, 0, 0, 0};
+  uint32_t _messageTypeCounts[LPF2_MESSAGE_TYPE_COUNTERS] = {0};
 
   // List of connected devices
-  Device connectedDevices[13];
+  Device connectedDevices[LPF2_MAX_CONNECTED_DEVICES];
   int numberOfConnectedDevices = 0;
 
+  // last port output command feedback (CommandFeedback bits) and number of commands which are not completed per port.
+  // The commands in flight are incremented by the user loop and decremented by the feedback in the BLE task
+  std::atomic<uint8_t> _portCommandFeedback[256];
+  std::atomic<uint8_t> _portCommandsInFlight[256];
+
+  // index tables: port number -> index in connectedDevices, device type -> port number
+  byte _portDeviceIndex[256];
+  byte _deviceTypePort[256];
+
   //BLE settings
   uint32_t _scanDuration = 10;
 };
 
 #endif // Lpf2Hub_h
 
-#endif // ESP32
+#endif // ESP32 || LEGOINO_NATIVE
@@ -0,0 +1,217 @@
+/*
+ * Lpf2HubCapabilityCache.cpp - Discovered modes, ranges and value formats of device types
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#include <atomic>
+#include <Preferences.h>
+#include "Lpf2HubCapabilityCache.h"
+
+// header of the stored cache, the entries are only loaded if the layout matches
+#define LPF2_CAPABILITY_CACHE_MAGIC 0x4C43
+#define LPF2_CAPABILITY_CACHE_VERSION 1
+
+struct CapabilityCacheHeader
+{
+  uint16_t Magic;
+  uint8_t Version;
+  uint8_t NumberOfEntries;
+  uint16_t EntrySize;
+};
+
+/**
+ * Entries of the cache. Entries are only appended (the number of entries is published after the
+ * entry is written), so the lookups in the dispatch of the notifications do not need a lock
+ */
+static DeviceCapabilities capabilityEntries[LPF2_MAX_CAPABILITY_ENTRIES];
+static std::atomic<int> numberOfCapabilityEntries{0};
+// incremented on each change of the entries, so cached value formats of the hubs could be checked with one load
+static std::atomic<uint32_t> capabilityGeneration{0};
+static bool isCapabilityCacheLoaded = false;
+
+/**
+ * @brief Find the capabilities of a device type with a specific firmware
+ * @param [in] deviceType type of the device
+ * @param [in] softwareVersion software version of the attached io message
+ * @return pointer to the capabilities or nullptr if the device type/firmware is not known
+ */
+const DeviceCapabilities *Lpf2HubCapabilityCache::find(byte deviceType, uint32_t softwareVersion)
+{
+    int numberOfEntries = numberOfCapabilityEntries.load(std::memory_order_acquire);
+    for (int idx = 0; idx < numberOfEntries; idx++)
+    {
+        if (capabilityEntries[idx].DeviceType == deviceType && capabilityEntries[idx].SoftwareVersion == softwareVersion)
+        {
+            return &capabilityEntries[idx];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Find the capabilities of a device type with any firmware (the latest added entry)
+ * @param [in] deviceType type of the device
+ * @return pointer to the capabilities or nullptr if the device type is not known
+ */
+const DeviceCapabilities *Lpf2HubCapabilityCache::find(byte deviceType)
+{
+    int numberOfEntries = numberOfCapabilityEntries.load(std::memory_order_acquire);
+    for (int idx = numberOfEntries - 1; idx >= 0; idx--)
+    {
+        if (capabilityEntries[idx].DeviceType == deviceType)
+        {
+            return &capabilityEntries[idx];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Add the discovered capabilities of a device type/firmware and store the cache
+ * @param [in] capabilities discovered capabilities
+ * @return true if the entry was added (or is already known), false if the cache is full
+ */
+bool Lpf2HubCapabilityCache::add(const DeviceCapabilities &capabilities)
+{
+    if (find(capabilities.DeviceType, capabilities.SoftwareVersion) != nullptr)
+    {
+        return true;
+    }
+    int numberOfEntries = numberOfCapabilityEntries.load(std::memory_order_relaxed);
+    if (numberOfEntries >= LPF2_MAX_CAPABILITY_ENTRIES)
+    {
+        log_w("max number of capability entries reached: %d", LPF2_MAX_CAPABILITY_ENTRIES);
+        return false;
+    }
+    capabilityEntries[numberOfEntries] = capabilities;
+    numberOfCapabilityEntries.store(numberOfEntries + 1, std::memory_order_release);
+    capabilityGeneration.fetch_add(1, std::memory_order_release);
+    save();
+    return true;
+}
+
+/**
+ * @brief Get the number of cached device type/firmware entries
+ * @return number of entries
+ */
+int Lpf2HubCapabilityCache::getNumberOfEntries()
+{
+    return numberOfCapabilityEntries.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Get the generation of the cache which is incremented on each change of the entries
+ * @return generation of the cache
+ */
+uint32_t Lpf2HubCapabilityCache::getGeneration()
+{
+    return capabilityGeneration.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Remove all entries. Should not be called while a discovery is running or
+ * notifications of a hub are dispatched
+ * @param [in] persistent true to remove the stored cache as well
+ */
+void Lpf2HubCapabilityCache::clear(bool persistent)
+{
+    numberOfCapabilityEntries.store(0, std::memory_order_release);
+    capabilityGeneration.fetch_add(1, std::memory_order_release);
+    if (persistent)
+    {
+        Preferences preferences;
+        if (preferences.begin(LPF2_CAPABILITY_CACHE_NAMESPACE, false))
+        {
+            preferences.remove(LPF2_CAPABILITY_CACHE_HEADER_KEY);
+            preferences.remove(LPF2_CAPABILITY_CACHE_KEY);
+            preferences.end();
+        }
+    }
+}
+
+/**
+ * @brief Load the stored cache into the empty cache, a stored cache with a different layout (e.g. after a
+ * library update) is ignored. The hubs keep pointers to the entries in the dispatch of the notifications, so
+ * the entries in memory are never replaced: the cache has to be loaded before the first device is discovered
+ * (done by the first setPortDiscovery(true))
+ * @return true if stored entries were loaded
+ */
+bool Lpf2HubCapabilityCache::load()
+{
+    isCapabilityCacheLoaded = true;
+    if (numberOfCapabilityEntries.load(std::memory_order_acquire) > 0)
+    {
+        log_w("capability cache is in use, the stored cache is not loaded");
+        return false;
+    }
+    Preferences preferences;
+    if (!preferences.begin(LPF2_CAPABILITY_CACHE_NAMESPACE, true))
+    {
+        return false;
+    }
+    CapabilityCacheHeader header;
+    bool isValid = preferences.getBytes(LPF2_CAPABILITY_CACHE_HEADER_KEY, &header, sizeof(header)) == sizeof(header) &&
+                   header.Magic == LPF2_CAPABILITY_CACHE_MAGIC && header.Version == LPF2_CAPABILITY_CACHE_VERSION &&
+                   header.EntrySize == sizeof(DeviceCapabilities) && header.NumberOfEntries <= LPF2_MAX_CAPABILITY_ENTRIES &&
+                   preferences.getBytesLength(LPF2_CAPABILITY_CACHE_KEY) == header.NumberOfEntries * sizeof(DeviceCapabilities);
+    if (!isValid)
+    {
+        preferences.end();
+        log_d("no valid stored capability cache");
+        return false;
+    }
+
+    size_t length = header.NumberOfEntries * sizeof(DeviceCapabilities);
+    isValid = preferences.getBytes(LPF2_CAPABILITY_CACHE_KEY, capabilityEntries, length) == length;
+    preferences.end();
+    if (!isValid)
+    {
+        return false;
+    }
+    numberOfCapabilityEntries.store(header.NumberOfEntries, std::memory_order_release);
+    capabilityGeneration.fetch_add(1, std::memory_order_release);
+    log_d("loaded %d capability entries", header.NumberOfEntries);
+    return true;
+}
+
+/**
+ * @brief Store all entries of the cache (called by add)
+ * @return true if the entries were stored
+ */
+bool Lpf2HubCapabilityCache::save()
+{
+    Preferences preferences;
+    if (!preferences.begin(LPF2_CAPABILITY_CACHE_NAMESPACE, false))
+    {
+        log_w("failed to open the preferences namespace %s", LPF2_CAPABILITY_CACHE_NAMESPACE);
+        return false;
+    }
+    CapabilityCacheHeader header;
+    header.Magic = LPF2_CAPABILITY_CACHE_MAGIC;
+    header.Version = LPF2_CAPABILITY_CACHE_VERSION;
+    header.NumberOfEntries = (uint8_t)numberOfCapabilityEntries.load(std::memory_order_acquire);
+    header.EntrySize = sizeof(DeviceCapabilities);
+
+    // the entries are written first, so an interrupted save leaves a header which does not match
+    size_t length = header.NumberOfEntries * sizeof(DeviceCapabilities);
+    bool isStored = preferences.putBytes(LPF2_CAPABILITY_CACHE_KEY, capabilityEntries, length) == length &&
+                    preferences.putBytes(LPF2_CAPABILITY_CACHE_HEADER_KEY, &header, sizeof(header)) == sizeof(header);
+    preferences.end();
+    return isStored;
+}
+
+/**
+ * @brief Get the state of the stored cache
+ * @return true if load() was called (e.g. by enabling the port discovery of a hub)
+ */
+bool Lpf2HubCapabilityCache::isLoaded()
+{
+    return isCapabilityCacheLoaded;
+}
+
+#endif // ESP32 || LEGOINO_NATIVE
@@ -0,0 +1,82 @@
+/*
+ * Lpf2HubCapabilityCache.h - Discovered modes, ranges and value formats of device types
+ *
+ * The capabilities of an attached device (PORT_INFORMATION and PORT_MODE_INFORMATION replies) only
+ * depend on the device type and its firmware, so they are shared by all hub instances. The cache is
+ * stored with the Preferences library in the NVS of the ESP32, so discovered devices are known
+ * directly after the next boot.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#ifndef Lpf2HubCapabilityCache_h
+#define Lpf2HubCapabilityCache_h
+
+#include "Arduino.h"
+#include "Lpf2HubConst.h"
+
+// max number of modes of a device which are discovered
+#define LPF2_MAX_DISCOVERED_MODES 16
+
+// max number of device type/firmware entries of the cache
+#ifndef LPF2_MAX_CAPABILITY_ENTRIES
+#define LPF2_MAX_CAPABILITY_ENTRIES 8
+#endif
+
+// software version which matches any firmware of a device type (not a valid BCD encoded version)
+#define LPF2_ANY_SOFTWARE_VERSION 0xFFFFFFFF
+
+// Preferences namespace and keys (max 15 characters) of the stored cache
+#define LPF2_CAPABILITY_CACHE_NAMESPACE "legoino"
+#define LPF2_CAPABILITY_CACHE_HEADER_KEY "capabilityhdr"
+#define LPF2_CAPABILITY_CACHE_KEY "capabilities"
+
+// value format and ranges of a mode (0 datasets: mode without value format)
+struct ModeCapabilities
+{
+  byte Datasets;
+  DatasetType Type;
+  byte Figures;
+  byte Decimals;
+  float RawMin;
+  float RawMax;
+  float SiMin;
+  float SiMax;
+};
+
+// modes of a device type with a firmware version. Capabilities bit 0: output, bit 1: input,
+// bit 2: logical combinable, bit 3: logical synchronizable. Bit n of the mode masks: mode n
+struct DeviceCapabilities
+{
+  byte DeviceType;
+  byte Capabilities;
+  byte ModeCount;
+  uint16_t InputModes;
+  uint16_t OutputModes;
+  uint32_t SoftwareVersion;
+  ModeCapabilities Modes[LPF2_MAX_DISCOVERED_MODES];
+};
+
+class Lpf2HubCapabilityCache
+{
+public:
+  static const DeviceCapabilities *find(byte deviceType, uint32_t softwareVersion);
+  static const DeviceCapabilities *find(byte deviceType);
+  static bool add(const DeviceCapabilities &capabilities);
+  static int getNumberOfEntries();
+  static uint32_t getGeneration();
+  static void clear(bool persistent = false);
+
+  // persistent storage (Preferences)
+  static bool load();
+  static bool save();
+  static bool isLoaded();
+};
+
+#endif // Lpf2HubCapabilityCache_h
+
+#endif // ESP32 || LEGOINO_NATIVE
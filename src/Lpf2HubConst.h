@@ -13,11 +13,16 @@
 #define LPF2_CHARACHTERISTIC "00001624-1212-efde-1623-785feabcd123"
 
 #define LPF2_VOLTAGE_MAX 9.6
+#define LPF2_VOLTAGE_MAX_MV 9600
 #define LPF2_VOLTAGE_MAX_RAW 3893
 
 #define LPF2_CURRENT_MAX 2444
 #define LPF2_CURRENT_MAX_RAW 4095
 
+// fixed point (Q16) scaling factors of the integer sensor decoding (raw value -> mV/mA)
+#define LPF2_VOLTAGE_SCALE_Q16 ((((uint32_t)LPF2_VOLTAGE_MAX_MV << 16) + LPF2_VOLTAGE_MAX_RAW / 2) / LPF2_VOLTAGE_MAX_RAW)
+#define LPF2_CURRENT_SCALE_Q16 ((((uint32_t)LPF2_CURRENT_MAX << 16) + LPF2_CURRENT_MAX_RAW / 2) / LPF2_CURRENT_MAX_RAW)
+
 struct Version
 {
   int Build;
@@ -37,6 +42,37 @@ enum struct HubType
   MARIO_HUB = 7
 };
 
+// states of the connection pipeline (scan -> connect -> service discovery -> subscription)
+enum struct HubConnectionState
+{
+  IDLE = 0,
+  FOUND = 1,
+  CONNECTING = 2,
+  DISCOVERING = 3,
+  SUBSCRIBING = 4,
+  READY = 5,
+  FAILED = 6
+};
+
+// states of a port output command which is tracked by a Lpf2CommandHandle
+enum struct CommandState
+{
+  UNKNOWN = 0,
+  PENDING = 1,
+  COMPLETED = 2,
+  DISCARDED = 3,
+  TIMED_OUT = 4,
+  DISCONNECTED = 5
+};
+
+// priority classes of the client side port command queue
+enum struct CommandPriority
+{
+  EMERGENCY = 0,
+  HIGH = 1,
+  NORMAL = 2
+};
+
 enum BLEManufacturerData
 {
   DUPLO_TRAIN_HUB_ID = 32,   //0x20
@@ -136,6 +172,44 @@ enum struct MessageType
   PORT_OUTPUT_COMMAND_FEEDBACK = 0x82,
 };
 
+enum struct CombinedModeSubCommand
+{
+  SET_MODE_DATASET_COMBINATIONS = 0x01,
+  LOCK_DEVICE_FOR_SETUP = 0x02,
+  UNLOCK_AND_START_MULTI_UPDATE_ENABLED = 0x03,
+  UNLOCK_AND_START_MULTI_UPDATE_DISABLED = 0x04,
+  RESET_SENSOR = 0x06
+};
+
+// information types of a PORT_INFORMATION_REQUEST
+enum struct PortInformationType
+{
+  MODE_INFO = 0x01,
+  POSSIBLE_MODE_COMBINATIONS = 0x02
+};
+
+// information types of a PORT_MODE_INFORMATION_REQUEST
+enum struct ModeInformationType
+{
+  NAME = 0x00,
+  RAW = 0x01,
+  PCT = 0x02,
+  SI = 0x03,
+  SYMBOL = 0x04,
+  MAPPING = 0x05,
+  MOTOR_BIAS = 0x07,
+  CAPABILITY_BITS = 0x08,
+  VALUE_FORMAT = 0x80
+};
+
+enum struct DatasetType
+{
+  INT8 = 0x00,
+  INT16 = 0x01,
+  INT32 = 0x02,
+  FLOAT = 0x03
+};
+
 enum struct HubPropertyReference
 {
   ADVERTISING_NAME = 0x01,
@@ -201,6 +275,16 @@ enum Event
   ATTACHED_VIRTUAL_IO = 0x02,
 };
 
+// bits of the port output command feedback
+enum struct CommandFeedback
+{
+  BUFFER_EMPTY_COMMAND_IN_PROGRESS = 0x01,
+  BUFFER_EMPTY_COMMAND_COMPLETED = 0x02,
+  COMMAND_DISCARDED = 0x04,
+  IDLE = 0x08,
+  BUSY_FULL = 0x10,
+};
+
 enum Color
 {
   BLACK = 0,
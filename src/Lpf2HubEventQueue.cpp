@@ -0,0 +1,200 @@
+/*
+ * Lpf2HubEventQueue.cpp - Lock-free single producer/single consumer queue for hub notifications
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#include "Lpf2HubEventQueue.h"
+
+/**
+ * @brief Constructor
+ * @param [in] policy queueing policy of port value notifications
+ */
+Lpf2HubEventQueue::Lpf2HubEventQueue(EventQueuePolicy policy)
+    : _head(0), _tail(0), _policy((uint8_t)policy), _enqueued(0), _dispatched(0), _overflows(0), _coalesced(0)
+{
+    memset(_portSlot, LPF2_EVENT_NO_SLOT, sizeof(_portSlot));
+    for (int i = 0; i < LPF2_EVENT_COALESCE_SLOTS; i++)
+    {
+        _slots[i].Sequence.store(0, std::memory_order_relaxed);
+        _slots[i].Pending.store(false, std::memory_order_relaxed);
+        _slots[i].Length = 0;
+    }
+}
+
+/**
+ * @brief Copy a notification into the queue. Must only be called from one task (producer)
+ * @param [in] pData pointer to the received data
+ * @param [in] length length of the received data
+ * @return true if the notification was queued or coalesced, false if it was dropped
+ */
+bool Lpf2HubEventQueue::push(const uint8_t *pData, size_t length)
+{
+    if (length < 3 || length > LPF2_EVENT_MAX_LENGTH)
+    {
+        _overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    byte messageType = pData[(byte)MessageHeader::MESSAGE_TYPE];
+    if (_policy.load(std::memory_order_relaxed) == (uint8_t)EventQueuePolicy::LATEST_VALUE_PER_PORT &&
+        (messageType == (byte)MessageType::PORT_VALUE_SINGLE || messageType == (byte)MessageType::PORT_VALUE_COMBINEDMODE) &&
+        length > 3)
+    {
+        return pushLatestValue(pData, length);
+    }
+    return enqueue(pData, length, LPF2_EVENT_NO_SLOT);
+}
+
+/**
+ * @brief Write a port value notification into the coalesce slot of the port. A reference to the slot
+ * is only queued if the previous value of the slot was already dispatched.
+ * @param [in] pData pointer to the received data
+ * @param [in] length length of the received data
+ * @return true if the notification was queued or coalesced, false if it was dropped
+ */
+bool Lpf2HubEventQueue::pushLatestValue(const uint8_t *pData, size_t length)
+{
+    byte port = pData[3];
+    uint8_t slotIndex = _portSlot[port];
+    if (slotIndex == LPF2_EVENT_NO_SLOT)
+    {
+        if (_numberOfSlots >= LPF2_EVENT_COALESCE_SLOTS)
+        {
+            // no free slot, queue without coalescing
+            return enqueue(pData, length, LPF2_EVENT_NO_SLOT);
+        }
+        slotIndex = _numberOfSlots++;
+        _portSlot[port] = slotIndex;
+    }
+
+    CoalesceSlot *slot = &_slots[slotIndex];
+    uint32_t sequence = slot->Sequence.load(std::memory_order_relaxed);
+    slot->Sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->Length = (uint8_t)length;
+    memcpy(slot->Data, pData, length);
+    slot->Sequence.store(sequence + 2, std::memory_order_release);
+
+    if (slot->Pending.exchange(true, std::memory_order_acq_rel))
+    {
+        // the consumer will pick up the latest value with the already queued reference
+        _coalesced.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (!enqueue(nullptr, 0, slotIndex))
+    {
+        slot->Pending.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Append an entry to the ring
+ * @param [in] pData pointer to the data (not used for slot references)
+ * @param [in] length length of the data
+ * @param [in] slot index of the coalesce slot or LPF2_EVENT_NO_SLOT
+ * @return true if the entry was appended, false if the ring is full
+ */
+bool Lpf2HubEventQueue::enqueue(const uint8_t *pData, size_t length, uint8_t slot)
+{
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) >= LPF2_EVENT_QUEUE_SIZE)
+    {
+        _overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Entry *entry = &_entries[tail & (LPF2_EVENT_QUEUE_SIZE - 1)];
+    entry->Slot = slot;
+    entry->Length = (uint8_t)length;
+    if (slot == LPF2_EVENT_NO_SLOT)
+    {
+        memcpy(entry->Data, pData, length);
+    }
+    _tail.store(tail + 1, std::memory_order_release);
+    _enqueued.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Take the oldest notification out of the queue. Must only be called from one task (consumer)
+ * @param [out] pData buffer with a size of at least LPF2_EVENT_MAX_LENGTH bytes
+ * @param [out] length length of the notification
+ * @return true if a notification was copied, false if the queue is empty
+ */
+bool Lpf2HubEventQueue::pop(uint8_t *pData, size_t *length)
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    Entry *entry = &_entries[head & (LPF2_EVENT_QUEUE_SIZE - 1)];
+    if (entry->Slot == LPF2_EVENT_NO_SLOT)
+    {
+        *length = entry->Length;
+        memcpy(pData, entry->Data, entry->Length);
+    }
+    else
+    {
+        CoalesceSlot *slot = &_slots[entry->Slot];
+        // updates after this point will queue a new reference
+        slot->Pending.store(false, std::memory_order_release);
+        uint32_t sequenceBefore;
+        uint32_t sequenceAfter;
+        do
+        {
+            sequenceBefore = slot->Sequence.load(std::memory_order_acquire);
+            *length = slot->Length;
+            memcpy(pData, slot->Data, min(*length, (size_t)LPF2_EVENT_MAX_LENGTH));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            sequenceAfter = slot->Sequence.load(std::memory_order_relaxed);
+        } while ((sequenceBefore & 1) || sequenceBefore != sequenceAfter);
+    }
+    _head.store(head + 1, std::memory_order_release);
+    _dispatched.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Set the queueing policy of port value notifications
+ * @param [in] policy queueing policy
+ */
+void Lpf2HubEventQueue::setPolicy(EventQueuePolicy policy)
+{
+    _policy.store((uint8_t)policy, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the counters of the queue
+ * @return counters of queued, dispatched, dropped and coalesced notifications
+ */
+EventQueueStatistics Lpf2HubEventQueue::getStatistics()
+{
+    EventQueueStatistics statistics;
+    statistics.Enqueued = _enqueued.load(std::memory_order_relaxed);
+    statistics.Dispatched = _dispatched.load(std::memory_order_relaxed);
+    statistics.Overflows = _overflows.load(std::memory_order_relaxed);
+    statistics.Coalesced = _coalesced.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+/**
+ * @brief Reset the counters of the queue
+ */
+void Lpf2HubEventQueue::resetStatistics()
+{
+    _enqueued.store(0, std::memory_order_relaxed);
+    _dispatched.store(0, std::memory_order_relaxed);
+    _overflows.store(0, std::memory_order_relaxed);
+    _coalesced.store(0, std::memory_order_relaxed);
+}
+
+#endif // ESP32 || LEGOINO_NATIVE
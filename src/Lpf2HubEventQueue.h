@@ -0,0 +1,107 @@
+/*
+ * Lpf2HubEventQueue.h - Lock-free single producer/single consumer queue for hub notifications
+ *
+ * The NimBLE host task (producer) copies the received notifications into a fixed size ring
+ * and the user loop (consumer) drains the ring and dispatches the messages. With this, slow
+ * callbacks in the sketch do not stall the reception of notifications of the connected hubs.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#ifndef Lpf2HubEventQueue_h
+#define Lpf2HubEventQueue_h
+
+#include <atomic>
+#include "Arduino.h"
+#include "Lpf2HubConst.h"
+
+// number of queued notifications per hub (has to be a power of two)
+#ifndef LPF2_EVENT_QUEUE_SIZE
+#define LPF2_EVENT_QUEUE_SIZE 16
+#endif
+
+// max length of a queued notification, longer notifications are dropped
+#ifndef LPF2_EVENT_MAX_LENGTH
+#define LPF2_EVENT_MAX_LENGTH 64
+#endif
+
+// max number of ports with a coalesced (latest) value
+#define LPF2_EVENT_COALESCE_SLOTS 16
+#define LPF2_EVENT_NO_SLOT 255
+
+enum struct EventQueuePolicy
+{
+  // every notification is queued, if the queue is full the notification is dropped
+  ALL_EVENTS = 0,
+  // port value notifications are coalesced to the latest value per port
+  LATEST_VALUE_PER_PORT = 1,
+};
+
+struct EventQueueStatistics
+{
+  uint32_t Enqueued;
+  uint32_t Dispatched;
+  uint32_t Overflows;
+  uint32_t Coalesced;
+};
+
+class Lpf2HubEventQueue
+{
+public:
+  Lpf2HubEventQueue(EventQueuePolicy policy);
+
+  // producer side (NimBLE host task)
+  bool push(const uint8_t *pData, size_t length);
+
+  // consumer side (user loop)
+  bool pop(uint8_t *pData, size_t *length);
+
+  void setPolicy(EventQueuePolicy policy);
+  EventQueueStatistics getStatistics();
+  void resetStatistics();
+
+private:
+  struct Entry
+  {
+    uint8_t Length;
+    // index of the coalesce slot which holds the message or LPF2_EVENT_NO_SLOT
+    uint8_t Slot;
+    uint8_t Data[LPF2_EVENT_MAX_LENGTH];
+  };
+
+  struct CoalesceSlot
+  {
+    // sequence lock, odd while the producer writes the data
+    std::atomic<uint32_t> Sequence;
+    // true if a reference to the slot is queued and not yet dispatched
+    std::atomic<bool> Pending;
+    uint8_t Length;
+    uint8_t Data[LPF2_EVENT_MAX_LENGTH];
+  };
+
+  bool enqueue(const uint8_t *pData, size_t length, uint8_t slot);
+  bool pushLatestValue(const uint8_t *pData, size_t length);
+
+  Entry _entries[LPF2_EVENT_QUEUE_SIZE];
+  std::atomic<uint32_t> _head; // next entry to read (consumer)
+  std::atomic<uint32_t> _tail; // next entry to write (producer)
+
+  CoalesceSlot _slots[LPF2_EVENT_COALESCE_SLOTS];
+  // port number -> coalesce slot, only used by the producer
+  uint8_t _portSlot[256];
+  uint8_t _numberOfSlots = 0;
+
+  std::atomic<uint8_t> _policy;
+  std::atomic<uint32_t> _enqueued;
+  std::atomic<uint32_t> _dispatched;
+  std::atomic<uint32_t> _overflows;
+  std::atomic<uint32_t> _coalesced;
+};
+
+#endif // Lpf2HubEventQueue_h
+
+#endif // ESP32 || LEGOINO_NATIVE
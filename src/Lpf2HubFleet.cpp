@@ -0,0 +1,236 @@
+/*
+ * Lpf2HubFleet.cpp - Synchronized command burst for several Lpf2Hub instances
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#include "Lpf2HubFleet.h"
+
+/**
+ * @brief Add a hub instance to the fleet
+ * @param [in] hub hub instance
+ * @return true if the hub was added, false if the max. number of hubs is reached
+ */
+bool Lpf2HubFleet::addHub(Lpf2Hub *hub)
+{
+    if (getHubIndex(hub) >= 0)
+    {
+        return true;
+    }
+    if (_numberOfHubs >= LPF2_MAX_FLEET_HUBS)
+    {
+        log_w("max number of fleet hubs reached: %d", LPF2_MAX_FLEET_HUBS);
+        return false;
+    }
+    _sendSkew[_numberOfHubs] = 0;
+    _hubs[_numberOfHubs++] = hub;
+    return true;
+}
+
+/**
+ * @brief Get the number of hubs of the fleet
+ * @return number of hubs
+ */
+int Lpf2HubFleet::getNumberOfHubs()
+{
+    return _numberOfHubs;
+}
+
+/**
+ * @brief Prepare an arbitrary command for the next burst
+ * @param [in] hub hub instance (has to be added to the fleet)
+ * @param [in] message encoded command including the common header
+ * @return true if the command was prepared
+ */
+bool Lpf2HubFleet::prepareCommand(Lpf2Hub *hub, const Lpf2HubMessage &message)
+{
+    return prepare(hub, message, false);
+}
+
+/**
+ * @brief Prepare a speed command of a basic motor (train motor) for the next burst
+ * @param [in] hub hub instance (has to be added to the fleet)
+ * @param [in] port Port of the Hub on which the speed of the motor will set (A, B)
+ * @param [in] speed Speed of the Motor -100..0..100 negative values will reverse the rotation
+ * @return true if the command was prepared
+ */
+bool Lpf2HubFleet::prepareBasicMotorSpeed(Lpf2Hub *hub, byte port, int speed)
+{
+    return prepare(hub, Lpf2Hub::encodeBasicMotorSpeed(port, speed), true);
+}
+
+/**
+ * @brief Prepare a speed command of a tacho motor for the next burst
+ * @param [in] hub hub instance (has to be added to the fleet)
+ * @param [in] port Port of the Hub on which the speed of the motor will set (A, B, AB, C, D)
+ * @param [in] speed Speed of the Motor -100..0..100 negative values will reverse the rotation
+ * @param [in] maxPower Maximum power level 0..100
+ * @param [in] brakingStyle brake behavior after the motor is stopped
+ * @return true if the command was prepared
+ */
+bool Lpf2HubFleet::prepareTachoMotorSpeed(Lpf2Hub *hub, byte port, int speed, byte maxPower, BrakingStyle brakingStyle)
+{
+    return prepare(hub, Lpf2Hub::encodeTachoMotorSpeed(port, speed, maxPower, brakingStyle), true);
+}
+
+/**
+ * @brief Prepare the same basic motor speed command for all hubs of the fleet (e.g. stop all trains)
+ * @param [in] port Port of the Hubs on which the speed of the motor will set (A, B)
+ * @param [in] speed Speed of the Motor -100..0..100 negative values will reverse the rotation
+ */
+void Lpf2HubFleet::prepareBasicMotorSpeedForAll(byte port, int speed)
+{
+    Lpf2HubMessage message = Lpf2Hub::encodeBasicMotorSpeed(port, speed);
+    for (int idx = 0; idx < _numberOfHubs; idx++)
+    {
+        prepare(_hubs[idx], message, true);
+    }
+}
+
+/**
+ * @brief Remove all prepared commands
+ */
+void Lpf2HubFleet::clear()
+{
+    _numberOfCommands = 0;
+}
+
+/**
+ * @brief Write all prepared commands in one burst. The commands are written without response
+ * one after another, the encoding is already done by the prepare methods. The send time of each
+ * hub (last command of the hub) relative to the first write is stored as send skew.
+ * The prepared commands are removed after the burst.
+ * @return number of written commands (commands for disconnected hubs are skipped)
+ */
+int Lpf2HubFleet::send()
+{
+    for (int idx = 0; idx < _numberOfHubs; idx++)
+    {
+        _sendSkew[idx] = 0;
+    }
+
+    int numberOfSentCommands = 0;
+    uint32_t burstStart = micros();
+    for (int idx = 0; idx < _numberOfCommands; idx++)
+    {
+        Command *command = &_commands[idx];
+        Lpf2Hub *hub = _hubs[command->HubIndex];
+        if (!hub->_isConnected || hub->_pRemoteCharacteristic == nullptr)
+        {
+            _statistics.Skipped++;
+            continue;
+        }
+        hub->writeCharacteristic(command->Data, command->Length);
+        _sendSkew[command->HubIndex] = micros() - burstStart;
+        numberOfSentCommands++;
+    }
+
+    uint32_t maxSkew = 0;
+    for (int idx = 0; idx < _numberOfHubs; idx++)
+    {
+        maxSkew = max(maxSkew, _sendSkew[idx]);
+    }
+    _statistics.Bursts++;
+    _statistics.Commands += numberOfSentCommands;
+    _statistics.LastMaxSkew = maxSkew;
+    _statistics.MaxSkew = max(_statistics.MaxSkew, maxSkew);
+    log_hot_d("burst of %d commands, skew: %u us", numberOfSentCommands, maxSkew);
+
+    // record the commands in flight and the setpoints for the reconnect replay after the time critical part
+    for (int idx = 0; idx < _numberOfCommands; idx++)
+    {
+        Command *command = &_commands[idx];
+        Lpf2Hub *hub = _hubs[command->HubIndex];
+        if (hub->_isConnected)
+        {
+            hub->trackPortOutputCommand(command->Data, command->Length);
+        }
+        if (command->IsMotorSetpoint)
+        {
+            Lpf2HubMessage message(MessageType::PORT_OUTPUT_COMMAND);
+            message.writeBytes(command->Data + 3, command->Length - 3);
+            _hubs[command->HubIndex]->recordMotorSetpoint(command->Data[3], message);
+        }
+    }
+    _numberOfCommands = 0;
+    return numberOfSentCommands;
+}
+
+/**
+ * @brief Get the send time of a hub in the last burst
+ * @param [in] hub hub instance
+ * @return time between the first write of the burst and the last write to the hub in unit microseconds
+ */
+uint32_t Lpf2HubFleet::getSendSkew(Lpf2Hub *hub)
+{
+    int hubIndex = getHubIndex(hub);
+    return hubIndex >= 0 ? _sendSkew[hubIndex] : 0;
+}
+
+/**
+ * @brief Get the counters and the send skew of the bursts
+ * @return number of bursts, written and skipped commands, max. skew of the last and of all bursts
+ */
+FleetSendStatistics Lpf2HubFleet::getSendStatistics()
+{
+    return _statistics;
+}
+
+/**
+ * @brief Reset the counters and the send skew of the bursts
+ */
+void Lpf2HubFleet::resetSendStatistics()
+{
+    _statistics = {0, 0, 0, 0, 0};
+}
+
+/**
+ * @brief Get the index of a hub instance
+ * @param [in] hub hub instance
+ * @return index or -1 if the hub is not part of the fleet
+ */
+int Lpf2HubFleet::getHubIndex(Lpf2Hub *hub)
+{
+    for (int idx = 0; idx < _numberOfHubs; idx++)
+    {
+        if (_hubs[idx] == hub)
+        {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Store an encoded command for the next burst
+ * @param [in] hub hub instance
+ * @param [in] message encoded command
+ * @param [in] isMotorSetpoint true if the command should be recorded for the reconnect replay
+ * @return true if the command was stored
+ */
+bool Lpf2HubFleet::prepare(Lpf2Hub *hub, const Lpf2HubMessage &message, bool isMotorSetpoint)
+{
+    int hubIndex = getHubIndex(hub);
+    if (hubIndex < 0 || !message.isValid())
+    {
+        log_w("hub is not part of the fleet or message is invalid");
+        return false;
+    }
+    if (_numberOfCommands >= LPF2_MAX_FLEET_COMMANDS)
+    {
+        log_w("max number of fleet commands reached: %d", LPF2_MAX_FLEET_COMMANDS);
+        return false;
+    }
+    Command *command = &_commands[_numberOfCommands++];
+    command->HubIndex = (byte)hubIndex;
+    command->IsMotorSetpoint = isMotorSetpoint;
+    command->Length = message.length();
+    memcpy(command->Data, message.data(), message.length());
+    return true;
+}
+
+#endif // ESP32 || LEGOINO_NATIVE
@@ -0,0 +1,78 @@
+/*
+ * Lpf2HubFleet.h - Synchronized command burst for several Lpf2Hub instances
+ *
+ * Commands for several hubs (e.g. start all trains) are encoded in advance and written to the
+ * hubs in one tight loop. The send time of each hub relative to the start of the burst is
+ * measured, so the skew between the hubs could be checked against the connection interval.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#ifndef Lpf2HubFleet_h
+#define Lpf2HubFleet_h
+
+#include "Arduino.h"
+#include "Lpf2Hub.h"
+
+// max number of hub instances of a fleet
+#define LPF2_MAX_FLEET_HUBS NIMBLE_MAX_CONNECTIONS
+
+// max number of prepared commands of one burst
+#define LPF2_MAX_FLEET_COMMANDS 16
+
+// send skew of the bursts in unit microseconds
+struct FleetSendStatistics
+{
+  uint32_t Bursts;
+  uint32_t Commands;
+  uint32_t Skipped;
+  uint32_t LastMaxSkew;
+  uint32_t MaxSkew;
+};
+
+class Lpf2HubFleet
+{
+public:
+  bool addHub(Lpf2Hub *hub);
+  int getNumberOfHubs();
+
+  // prepare the commands of the next burst
+  bool prepareCommand(Lpf2Hub *hub, const Lpf2HubMessage &message);
+  bool prepareBasicMotorSpeed(Lpf2Hub *hub, byte port, int speed);
+  bool prepareTachoMotorSpeed(Lpf2Hub *hub, byte port, int speed, byte maxPower = 100, BrakingStyle brakingStyle = BrakingStyle::BRAKE);
+  void prepareBasicMotorSpeedForAll(byte port, int speed);
+  void clear();
+
+  int send();
+
+  uint32_t getSendSkew(Lpf2Hub *hub);
+  FleetSendStatistics getSendStatistics();
+  void resetSendStatistics();
+
+private:
+  struct Command
+  {
+    byte HubIndex;
+    bool IsMotorSetpoint;
+    byte Length;
+    byte Data[LPF2_MAX_MESSAGE_LENGTH];
+  };
+
+  int getHubIndex(Lpf2Hub *hub);
+  bool prepare(Lpf2Hub *hub, const Lpf2HubMessage &message, bool isMotorSetpoint);
+
+  Lpf2Hub *_hubs[LPF2_MAX_FLEET_HUBS];
+  int _numberOfHubs = 0;
+  Command _commands[LPF2_MAX_FLEET_COMMANDS];
+  int _numberOfCommands = 0;
+  uint32_t _sendSkew[LPF2_MAX_FLEET_HUBS];
+  FleetSendStatistics _statistics = {0, 0, 0, 0, 0};
+};
+
+#endif // Lpf2HubFleet_h
+
+#endif // ESP32 || LEGOINO_NATIVE
@@ -0,0 +1,230 @@
+/*
+ * Lpf2HubLedAnimation.cpp - Keyframe animation of the hub LED
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#include "Lpf2HubLedAnimation.h"
+
+/**
+ * @brief Constructor
+ * @param [in] hub hub instance with the LED which should be animated
+ */
+Lpf2HubLedAnimation::Lpf2HubLedAnimation(Lpf2Hub *hub)
+{
+    _hub = hub;
+}
+
+/**
+ * @brief Add a keyframe with a RGB color
+ * @param [in] time time of the keyframe in ms from the start of the animation (>= time of the previous keyframe)
+ * @param [in] red 0..255
+ * @param [in] green 0..255
+ * @param [in] blue 0..255
+ * @return true if the keyframe was added
+ */
+bool Lpf2HubLedAnimation::addKeyframe(uint32_t time, uint8_t red, uint8_t green, uint8_t blue)
+{
+    if (_numberOfKeyframes >= LPF2_MAX_LED_KEYFRAMES)
+    {
+        log_w("max number of keyframes reached: %d", LPF2_MAX_LED_KEYFRAMES);
+        return false;
+    }
+    if (_numberOfKeyframes > 0 && time < _keyframes[_numberOfKeyframes - 1].Time)
+    {
+        log_w("keyframe at %u ms is before the previous keyframe", time);
+        return false;
+    }
+    Keyframe *keyframe = &_keyframes[_numberOfKeyframes++];
+    keyframe->Time = time;
+    keyframe->Color[0] = red;
+    keyframe->Color[1] = green;
+    keyframe->Color[2] = blue;
+    return true;
+}
+
+/**
+ * @brief Add a keyframe with a HSV color. The color is converted once to RGB and the
+ * animation interpolates in RGB
+ * @param [in] time time of the keyframe in ms from the start of the animation (>= time of the previous keyframe)
+ * @param [in] hue 0..360
+ * @param [in] saturation 0..255
+ * @param [in] value 0..255
+ * @return true if the keyframe was added
+ */
+bool Lpf2HubLedAnimation::addHSVKeyframe(uint32_t time, int hue, uint8_t saturation, uint8_t value)
+{
+    uint8_t rgb[3];
+    LegoinoCommon::HsvToRgb(hue, saturation, value, rgb);
+    return addKeyframe(time, rgb[0], rgb[1], rgb[2]);
+}
+
+/**
+ * @brief Remove all keyframes and stop the animation
+ */
+void Lpf2HubLedAnimation::clear()
+{
+    _numberOfKeyframes = 0;
+    _isRunning = false;
+}
+
+/**
+ * @brief Set the max. number of evaluated frames per second. Between two frames update() returns
+ * without any calculation
+ * @param [in] framesPerSecond 1..255, 0 evaluates a frame on each call of update()
+ */
+void Lpf2HubLedAnimation::setFrameRate(uint8_t framesPerSecond)
+{
+    _frameInterval = framesPerSecond > 0 ? 1000 / framesPerSecond : 0;
+}
+
+/**
+ * @brief Enable or disable the repetition of the animation. A not repeated animation stops with the
+ * color of the last keyframe
+ * @param [in] enabled true to restart the animation after the last keyframe
+ */
+void Lpf2HubLedAnimation::setLoop(bool enabled)
+{
+    _isLooping = enabled;
+}
+
+/**
+ * @brief Start the animation with the first keyframe
+ */
+void Lpf2HubLedAnimation::start()
+{
+    _startTime = millis();
+    _hasFrame = false;
+    _isRunning = true;
+}
+
+/**
+ * @brief Stop the animation. The LED keeps the last written color
+ */
+void Lpf2HubLedAnimation::stop()
+{
+    _isRunning = false;
+}
+
+/**
+ * @brief Get the state of the animation
+ * @return true if the animation is running
+ */
+bool Lpf2HubLedAnimation::isRunning()
+{
+    return _isRunning;
+}
+
+/**
+ * @brief Service function of the animation which has to be called in the loop. If the frame
+ * interval has elapsed, the color of the current time is interpolated and written to the hub
+ * if it differs from the last written color
+ * @return true if a color was written to the hub
+ */
+bool Lpf2HubLedAnimation::update()
+{
+    if (!_isRunning || _numberOfKeyframes == 0)
+    {
+        return false;
+    }
+    uint32_t now = millis();
+    if (_hasFrame && now - _lastFrameTime < _frameInterval)
+    {
+        return false;
+    }
+    _hasFrame = true;
+    _lastFrameTime = now;
+
+    if (!_hub->isConnected())
+    {
+        // the LED has to be set again after a reconnect
+        _hasWrittenColor = false;
+        return false;
+    }
+    _statistics.Frames++;
+
+    uint32_t time = now - _startTime;
+    uint32_t duration = _keyframes[_numberOfKeyframes - 1].Time;
+    bool isFinished = false;
+    if (time >= duration)
+    {
+        if (_isLooping && duration > 0)
+        {
+            time %= duration;
+        }
+        else
+        {
+            time = duration;
+            isFinished = true;
+        }
+    }
+
+    uint8_t rgb[3];
+    interpolate(time, rgb);
+    bool isWritten = false;
+    if (!_hasWrittenColor || memcmp(rgb, _writtenColor, sizeof(rgb)) != 0)
+    {
+        _hub->setLedRGBColor(rgb[0], rgb[1], rgb[2]);
+        memcpy(_writtenColor, rgb, sizeof(rgb));
+        _hasWrittenColor = true;
+        _statistics.Writes++;
+        isWritten = true;
+    }
+    if (isFinished)
+    {
+        _isRunning = false;
+    }
+    return isWritten;
+}
+
+/**
+ * @brief Get the number of evaluated frames and of color writes to the hub
+ * @return counters of frames and writes
+ */
+LedAnimationStatistics Lpf2HubLedAnimation::getStatistics()
+{
+    return _statistics;
+}
+
+/**
+ * @brief Reset the counters of frames and writes
+ */
+void Lpf2HubLedAnimation::resetStatistics()
+{
+    _statistics.Frames = 0;
+    _statistics.Writes = 0;
+}
+
+/**
+ * @brief Interpolate the color between the keyframes before and after a time with an 8 bit weight
+ * @param [in] time time in ms from the start of the animation
+ * @param [out] rgb byte array of the caller with red, green, blue
+ */
+void Lpf2HubLedAnimation::interpolate(uint32_t time, uint8_t rgb[3])
+{
+    int idx = 0;
+    while (idx < _numberOfKeyframes && _keyframes[idx].Time <= time)
+    {
+        idx++;
+    }
+    if (idx == 0 || idx == _numberOfKeyframes)
+    {
+        memcpy(rgb, _keyframes[idx == 0 ? 0 : idx - 1].Color, 3);
+        return;
+    }
+
+    Keyframe *from = &_keyframes[idx - 1];
+    Keyframe *to = &_keyframes[idx];
+    // weight 0..256 of the next keyframe
+    int weight = (int)(((uint64_t)(time - from->Time) << 8) / (to->Time - from->Time));
+    for (int component = 0; component < 3; component++)
+    {
+        rgb[component] = from->Color[component] + (((int)to->Color[component] - from->Color[component]) * weight) / 256;
+    }
+}
+
+#endif // ESP32 || LEGOINO_NATIVE
@@ -0,0 +1,83 @@
+/*
+ * Lpf2HubLedAnimation.h - Keyframe animation of the hub LED
+ *
+ * The color of the hub LED is interpolated between keyframes (RGB or HSV) with integer
+ * arithmetic. The animation is driven from the loop with update(), which evaluates at most one
+ * frame per frame interval and only writes to the hub if the RGB value has changed.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#ifndef Lpf2HubLedAnimation_h
+#define Lpf2HubLedAnimation_h
+
+#include "Arduino.h"
+#include "Lpf2Hub.h"
+
+// max number of keyframes of an animation
+#define LPF2_MAX_LED_KEYFRAMES 16
+
+// default max. number of evaluated frames per second
+#define LPF2_LED_ANIMATION_FRAME_RATE 10
+
+// number of evaluated frames and of color writes to the hub
+struct LedAnimationStatistics
+{
+  uint32_t Frames;
+  uint32_t Writes;
+};
+
+class Lpf2HubLedAnimation
+{
+public:
+  Lpf2HubLedAnimation(Lpf2Hub *hub);
+
+  // keyframes in ascending order of the time (in unit milliseconds from the start of the animation)
+  bool addKeyframe(uint32_t time, uint8_t red, uint8_t green, uint8_t blue);
+  bool addHSVKeyframe(uint32_t time, int hue, uint8_t saturation, uint8_t value);
+  void clear();
+
+  void setFrameRate(uint8_t framesPerSecond);
+  void setLoop(bool enabled);
+  void start();
+  void stop();
+  bool isRunning();
+  bool update();
+
+  LedAnimationStatistics getStatistics();
+  void resetStatistics();
+
+private:
+  struct Keyframe
+  {
+    uint32_t Time;
+    uint8_t Color[3];
+  };
+
+  void interpolate(uint32_t time, uint8_t rgb[3]);
+
+  Lpf2Hub *_hub;
+  Keyframe _keyframes[LPF2_MAX_LED_KEYFRAMES];
+  int _numberOfKeyframes = 0;
+
+  uint32_t _frameInterval = 1000 / LPF2_LED_ANIMATION_FRAME_RATE;
+  bool _isLooping = true;
+  bool _isRunning = false;
+  uint32_t _startTime = 0;
+  bool _hasFrame = false;
+  uint32_t _lastFrameTime = 0;
+
+  // last color which was written to the hub (invalid after a connection loss)
+  bool _hasWrittenColor = false;
+  uint8_t _writtenColor[3];
+
+  LedAnimationStatistics _statistics = {0, 0};
+};
+
+#endif // Lpf2HubLedAnimation_h
+
+#endif // ESP32 || LEGOINO_NATIVE
@@ -0,0 +1,268 @@
+/*
+ * Lpf2HubManager.cpp - Shared BLE scan for several Lpf2Hub instances
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#include "Lpf2HubManager.h"
+
+/**
+ * Callback if the shared scan has ended. Only needed to enforce the non blocking scan start
+ */
+static void managerScanEndedCallback(NimBLEScanResults results)
+{
+    log_d("shared scan ended, number of devices: %d", results.getCount());
+}
+
+/**
+ * Forwards the advertised devices of the shared scan to the manager
+ */
+class Lpf2HubManagerAdvertisedDeviceCallbacks : public NimBLEAdvertisedDeviceCallbacks
+{
+    Lpf2HubManager *_manager;
+
+public:
+    Lpf2HubManagerAdvertisedDeviceCallbacks(Lpf2HubManager *manager) : NimBLEAdvertisedDeviceCallbacks()
+    {
+        _manager = manager;
+    }
+
+    void onResult(NimBLEAdvertisedDevice *advertisedDevice)
+    {
+        _manager->onAdvertisedDevice(advertisedDevice);
+    }
+};
+
+/**
+ * @brief Constructor
+ */
+Lpf2HubManager::Lpf2HubManager()
+{
+    _pAdvertisedDeviceCallbacks = new Lpf2HubManagerAdvertisedDeviceCallbacks(this);
+}
+
+/**
+ * @brief Add a hub instance which should be connected to the first hub which is found
+ * @param [in] hub hub instance
+ * @return true if the hub was added, false if the max. number of hubs is reached
+ */
+bool Lpf2HubManager::addHub(Lpf2Hub *hub)
+{
+    if (_numberOfHubs >= LPF2_MAX_MANAGED_HUBS)
+    {
+        log_w("max number of managed hubs reached: %d", LPF2_MAX_MANAGED_HUBS);
+        return false;
+    }
+    hub->initWithoutScan();
+    _hubs[_numberOfHubs++] = hub;
+    return true;
+}
+
+/**
+ * @brief Add a hub instance which should be connected to the hub with a specific address
+ * @param [in] hub hub instance
+ * @param [in] deviceAddress address of the hub represented by a hex string of the format: 00:00:00:00:00:00
+ * @return true if the hub was added, false if the max. number of hubs is reached
+ */
+bool Lpf2HubManager::addHub(Lpf2Hub *hub, std::string deviceAddress)
+{
+    hub->_requestedDeviceAddress = new BLEAddress(deviceAddress);
+    return addHub(hub);
+}
+
+/**
+ * @brief Add a hub instance which should be connected to the first hub of a specific type
+ * @param [in] hub hub instance
+ * @param [in] hubType type of the hub (e.g. POWERED_UP_REMOTE)
+ * @return true if the hub was added, false if the max. number of hubs is reached
+ */
+bool Lpf2HubManager::addHub(Lpf2Hub *hub, HubType hubType)
+{
+    hub->_requestedHubType = hubType;
+    return addHub(hub);
+}
+
+/**
+ * @brief Add a hub instance which should be connected to the hub with a specific advertising name
+ * @param [in] hub hub instance
+ * @param [in] hubName advertising name of the hub
+ * @return true if the hub was added, false if the max. number of hubs is reached
+ */
+bool Lpf2HubManager::addHubWithName(Lpf2Hub *hub, std::string hubName)
+{
+    hub->_requestedHubName = hubName;
+    return addHub(hub);
+}
+
+/**
+ * @brief Start the shared scan. The scan is stopped if all hubs are found.
+ * @param [in] scanDuration scan duration in unit seconds (0: scan until all hubs are found)
+ */
+void Lpf2HubManager::start(uint32_t scanDuration)
+{
+    _scanDuration = scanDuration;
+    _pBLEScan = BLEDevice::getScan();
+    _pBLEScan->setAdvertisedDeviceCallbacks(_pAdvertisedDeviceCallbacks);
+    _pBLEScan->setActiveScan(true);
+    _isStarted = true;
+    // start method with callback function to enforce the non blocking scan
+    _pBLEScan->start(_scanDuration, managerScanEndedCallback);
+}
+
+/**
+ * @brief Stop the shared scan
+ */
+void Lpf2HubManager::stop()
+{
+    _isStarted = false;
+    if (_pBLEScan != nullptr)
+    {
+        _pBLEScan->stop();
+    }
+}
+
+/**
+ * @brief Continue the shared scan if it was stopped by a connect (NimBLE stops a running
+ * scan to connect a client) and hubs are still pending. Should be called in the loop
+ */
+void Lpf2HubManager::poll()
+{
+    if (!_isStarted || _scanDuration != 0 || _pBLEScan->isScanning())
+    {
+        return;
+    }
+    if (getNumberOfPendingHubs() > 0)
+    {
+        _pBLEScan->start(_scanDuration, managerScanEndedCallback, true);
+    }
+    else
+    {
+        _isStarted = false;
+    }
+}
+
+/**
+ * @brief Determine the scanning status of the shared scan
+ * @return Scanning status
+ */
+bool Lpf2HubManager::isScanning()
+{
+    return _pBLEScan != nullptr && _pBLEScan->isScanning();
+}
+
+/**
+ * @brief Get the number of hubs which are not found so far
+ * @return number of pending hubs
+ */
+int Lpf2HubManager::getNumberOfPendingHubs()
+{
+    int numberOfPendingHubs = 0;
+    for (int idx = 0; idx < _numberOfHubs; idx++)
+    {
+        if (isPending(_hubs[idx]))
+        {
+            numberOfPendingHubs++;
+        }
+    }
+    return numberOfPendingHubs;
+}
+
+/**
+ * @brief Hand over an advertised device to the pending hub with the most specific match.
+ * Hubs with a requested address are served first, then hubs with a requested name or type
+ * and at last hubs without any requirement
+ * @param [in] advertisedDevice advertised device of the shared scan
+ */
+void Lpf2HubManager::onAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice)
+{
+    log_d("advertised device: %s", advertisedDevice->toString().c_str());
+    if (isAssigned(advertisedDevice))
+    {
+        return;
+    }
+
+    HubType hubType = Lpf2Hub::getHubTypeForAdvertisedDevice(advertisedDevice);
+    Lpf2Hub *matchingHub = nullptr;
+    int matchingPriority = -1;
+    for (int idx = 0; idx < _numberOfHubs; idx++)
+    {
+        Lpf2Hub *hub = _hubs[idx];
+        if (!isPending(hub) || !hub->matchesAdvertisedDevice(advertisedDevice, hubType))
+        {
+            continue;
+        }
+        int priority = getMatchPriority(hub);
+        if (priority > matchingPriority)
+        {
+            matchingHub = hub;
+            matchingPriority = priority;
+        }
+    }
+    if (matchingHub == nullptr)
+    {
+        return;
+    }
+
+    matchingHub->applyAdvertisedDevice(advertisedDevice);
+    log_d("hub %s found (%d pending)", matchingHub->_hubName.c_str(), getNumberOfPendingHubs());
+    if (getNumberOfPendingHubs() == 0)
+    {
+        stop();
+    }
+}
+
+/**
+ * @brief Check if a hub is still waiting for an advertised device
+ * @param [in] hub hub instance
+ * @return true if the hub is neither found nor connected
+ */
+bool Lpf2HubManager::isPending(Lpf2Hub *hub)
+{
+    return !hub->_isConnecting && !hub->_isConnected;
+}
+
+/**
+ * @brief Check if an advertised device is already handed over to one of the hubs
+ * @param [in] advertisedDevice advertised device of the shared scan
+ * @return true if a found or connected hub has the address of the advertised device
+ */
+bool Lpf2HubManager::isAssigned(NimBLEAdvertisedDevice *advertisedDevice)
+{
+    for (int idx = 0; idx < _numberOfHubs; idx++)
+    {
+        Lpf2Hub *hub = _hubs[idx];
+        if (!isPending(hub) && hub->_pServerAddress != nullptr && hub->_pServerAddress->equals(advertisedDevice->getAddress()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Get the priority of a hub for the assignment of an advertised device
+ * @param [in] hub hub instance
+ * @return 3 for a requested address, 2 for a requested name, 1 for a requested type, 0 otherwise
+ */
+int Lpf2HubManager::getMatchPriority(Lpf2Hub *hub)
+{
+    if (hub->_requestedDeviceAddress != nullptr)
+    {
+        return 3;
+    }
+    if (!hub->_requestedHubName.empty())
+    {
+        return 2;
+    }
+    if (hub->_requestedHubType != HubType::UNKNOWNHUB)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+#endif // ESP32 || LEGOINO_NATIVE
@@ -0,0 +1,59 @@
+/*
+ * Lpf2HubManager.h - Shared BLE scan for several Lpf2Hub instances
+ *
+ * Instead of a scan per hub instance (one after another), the manager runs one continuous
+ * scan and hands each advertised hub to the first pending instance whose address, hub type
+ * or name fits. With this, all hubs and remotes of a layout are found in a single scan window.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#ifndef Lpf2HubManager_h
+#define Lpf2HubManager_h
+
+#include "Arduino.h"
+#include "NimBLEDevice.h"
+#include "Lpf2Hub.h"
+
+// max number of hub instances which could be added to the manager
+#define LPF2_MAX_MANAGED_HUBS NIMBLE_MAX_CONNECTIONS
+
+class Lpf2HubManager
+{
+public:
+  Lpf2HubManager();
+
+  // add hubs which should be found by the scan (before start)
+  bool addHub(Lpf2Hub *hub);
+  bool addHub(Lpf2Hub *hub, std::string deviceAddress);
+  bool addHub(Lpf2Hub *hub, HubType hubType);
+  bool addHubWithName(Lpf2Hub *hub, std::string hubName);
+
+  void start(uint32_t scanDuration = 0);
+  void stop();
+  void poll();
+  bool isScanning();
+  int getNumberOfPendingHubs();
+
+  void onAdvertisedDevice(NimBLEAdvertisedDevice *advertisedDevice);
+
+private:
+  bool isPending(Lpf2Hub *hub);
+  bool isAssigned(NimBLEAdvertisedDevice *advertisedDevice);
+  int getMatchPriority(Lpf2Hub *hub);
+
+  Lpf2Hub *_hubs[LPF2_MAX_MANAGED_HUBS];
+  int _numberOfHubs = 0;
+  NimBLEAdvertisedDeviceCallbacks *_pAdvertisedDeviceCallbacks = nullptr;
+  BLEScan *_pBLEScan = nullptr;
+  uint32_t _scanDuration = 0;
+  bool _isStarted = false;
+};
+
+#endif // Lpf2HubManager_h
+
+#endif // ESP32 || LEGOINO_NATIVE
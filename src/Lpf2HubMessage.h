@@ -0,0 +1,324 @@
+/*
+ * Lpf2HubMessage.h - Fixed capacity builder and bounds-checked views for LEGO Wireless Protocol (LWP3) messages
+ *
+ * The message is built on the stack of the caller. The common header (length, hub id,
+ * message type) and the little endian fields are written in place, so the buffer could be
+ * handed over to the characteristic without any further copy. Received messages are read
+ * through views which only hold the pointer and the length of the message.
+ *
+ * (c) Copyright 2020 - Cornelius Munz
+ * Released under MIT License
+ *
+*/
+
+#if defined(ESP32) || defined(LEGOINO_NATIVE)
+
+#ifndef Lpf2HubMessage_h
+#define Lpf2HubMessage_h
+
+#include "Arduino.h"
+#include "Lpf2HubConst.h"
+
+// max length of an outgoing message including the common header
+#define LPF2_MAX_MESSAGE_LENGTH 32
+
+class Lpf2HubMessage
+{
+public:
+  /**
+   * @brief Start a new message with the common header
+   * @param [in] messageType type of the message
+   */
+  Lpf2HubMessage(MessageType messageType)
+  {
+    _data[(byte)MessageHeader::LENGTH] = 3;
+    _data[(byte)MessageHeader::HUB_ID] = 0x00;
+    _data[(byte)MessageHeader::MESSAGE_TYPE] = (byte)messageType;
+    _length = 3;
+  }
+
+  /**
+   * @brief Start a new port output command message (port, startup and completion information, sub command)
+   * @param [in] port number of the addressed port
+   * @param [in] startupAndCompletion startup and completion information
+   * @param [in] subCommand sub command of the port output command
+   */
+  Lpf2HubMessage(byte port, byte startupAndCompletion, byte subCommand) : Lpf2HubMessage(MessageType::PORT_OUTPUT_COMMAND)
+  {
+    writeUInt8(port);
+    writeUInt8(startupAndCompletion);
+    writeUInt8(subCommand);
+  }
+
+  void writeUInt8(uint8_t value)
+  {
+    if (_length + 1 > LPF2_MAX_MESSAGE_LENGTH)
+    {
+      _isValid = false;
+      return;
+    }
+    _data[_length++] = value;
+    _data[(byte)MessageHeader::LENGTH] = _length;
+  }
+
+  void writeInt16LE(int16_t value)
+  {
+    if (_length + 2 > LPF2_MAX_MESSAGE_LENGTH)
+    {
+      _isValid = false;
+      return;
+    }
+    _data[_length++] = (byte)(value & 0xff);
+    _data[_length++] = (byte)((value >> 8) & 0xff);
+    _data[(byte)MessageHeader::LENGTH] = _length;
+  }
+
+  void writeInt32LE(int32_t value)
+  {
+    if (_length + 4 > LPF2_MAX_MESSAGE_LENGTH)
+    {
+      _isValid = false;
+      return;
+    }
+    _data[_length++] = (byte)(value & 0xff);
+    _data[_length++] = (byte)((value >> 8) & 0xff);
+    _data[_length++] = (byte)((value >> 16) & 0xff);
+    _data[_length++] = (byte)((value >> 24) & 0xff);
+    _data[(byte)MessageHeader::LENGTH] = _length;
+  }
+
+  void writeBytes(const uint8_t *values, int size)
+  {
+    if (size < 0 || _length + size > LPF2_MAX_MESSAGE_LENGTH)
+    {
+      _isValid = false;
+      return;
+    }
+    memcpy(_data + _length, values, size);
+    _length += size;
+    _data[(byte)MessageHeader::LENGTH] = _length;
+  }
+
+  /**
+   * @brief Replace the startup and completion information of a port output command
+   * @param [in] startupAndCompletion startup and completion information (e.g. 0x11: execute immediately, 0x01: buffer if necessary)
+   */
+  void setStartupAndCompletion(byte startupAndCompletion)
+  {
+    if (_length > 4 && _data[(byte)MessageHeader::MESSAGE_TYPE] == (byte)MessageType::PORT_OUTPUT_COMMAND)
+    {
+      _data[4] = startupAndCompletion;
+    }
+  }
+
+  const uint8_t *data() const
+  {
+    return _data;
+  }
+
+  uint8_t length() const
+  {
+    return _length;
+  }
+
+  // false if a write has exceeded the capacity. The message is truncated in this case
+  bool isValid() const
+  {
+    return _isValid;
+  }
+
+private:
+  uint8_t _data[LPF2_MAX_MESSAGE_LENGTH];
+  uint8_t _length;
+  bool _isValid = true;
+};
+
+/**
+ * Read only view on a received message (pointer and length) without any copy. All read 
+ * accessors are checked against the length of the message and return 0 for fields which 
+ * are not contained in the message. The length 0 means that the length is taken from 
+ * the one byte length header of the message.
+ */
+class Lpf2HubMessageView
+{
+public:
+  constexpr Lpf2HubMessageView(const uint8_t *pData, size_t length = 0)
+      : _pData(pData), _length(length != 0 ? length : pData[(byte)MessageHeader::LENGTH]) {}
+
+  constexpr const uint8_t *data() const
+  {
+    return _pData;
+  }
+
+  constexpr size_t length() const
+  {
+    return _length;
+  }
+
+  constexpr MessageType messageType() const
+  {
+    return (MessageType)readUInt8((byte)MessageHeader::MESSAGE_TYPE);
+  }
+
+  // true if the message contains size bytes at the offset
+  constexpr bool contains(size_t offset, size_t size) const
+  {
+    return offset + size <= _length;
+  }
+
+  constexpr uint8_t readUInt8(size_t offset) const
+  {
+    return contains(offset, 1) ? _pData[offset] : 0;
+  }
+
+  constexpr int8_t readInt8(size_t offset) const
+  {
+    return (int8_t)readUInt8(offset);
+  }
+
+  constexpr uint16_t readUInt16LE(size_t offset) const
+  {
+    return contains(offset, 2) ? (uint16_t)(_pData[offset] | (_pData[offset + 1] << 8)) : 0;
+  }
+
+  constexpr int16_t readInt16LE(size_t offset) const
+  {
+    return (int16_t)readUInt16LE(offset);
+  }
+
+  constexpr uint32_t readUInt32LE(size_t offset) const
+  {
+    return contains(offset, 4) ? ((uint32_t)_pData[offset] | ((uint32_t)_pData[offset + 1] << 8) | ((uint32_t)_pData[offset + 2] << 16) | ((uint32_t)_pData[offset + 3] << 24)) : 0;
+  }
+
+  constexpr int32_t readInt32LE(size_t offset) const
+  {
+    return (int32_t)readUInt32LE(offset);
+  }
+
+private:
+  const uint8_t *_pData;
+  size_t _length;
+};
+
+// HUB_PROPERTIES: property, operation, payload
+class HubPropertyMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr HubPropertyMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr byte property() const { return readUInt8(3); }
+  constexpr byte operation() const { return readUInt8(4); }
+  constexpr const uint8_t *payload() const { return data() + 5; }
+  constexpr size_t payloadLength() const { return length() > 5 ? length() - 5 : 0; }
+};
+
+// HUB_ATTACHED_IO: port, event, device type, hw/sw version or the ports of a virtual device
+class AttachedIoMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr AttachedIoMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr byte portNumber() const { return readUInt8(3); }
+  constexpr byte event() const { return readUInt8(4); }
+  constexpr bool hasDeviceType() const { return contains(5, 1); }
+  constexpr byte deviceType() const { return readUInt8(5); }
+  constexpr uint32_t hardwareVersion() const { return readUInt32LE(7); }
+  constexpr uint32_t softwareVersion() const { return readUInt32LE(11); }
+  constexpr byte virtualPortA() const { return readUInt8(7); }
+  constexpr byte virtualPortB() const { return readUInt8(8); }
+};
+
+// PORT_VALUE_SINGLE: port, value(s) (offsets of the value accessors are relative to the first value byte)
+class PortValueMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr PortValueMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr byte portNumber() const { return readUInt8(3); }
+  constexpr size_t valueLength() const { return length() > 4 ? length() - 4 : 0; }
+  constexpr uint8_t valueUInt8(size_t offset = 0) const { return readUInt8(4 + offset); }
+  constexpr int8_t valueInt8(size_t offset = 0) const { return readInt8(4 + offset); }
+  constexpr uint16_t valueUInt16LE(size_t offset = 0) const { return readUInt16LE(4 + offset); }
+  constexpr int16_t valueInt16LE(size_t offset = 0) const { return readInt16LE(4 + offset); }
+  constexpr int32_t valueInt32LE(size_t offset = 0) const { return readInt32LE(4 + offset); }
+};
+
+// PORT_INPUT_FORMAT_SINGLE: port, mode, delta interval, notification enabled
+class PortInputFormatMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr PortInputFormatMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr byte portNumber() const { return readUInt8(3); }
+  constexpr byte mode() const { return readUInt8(4); }
+  constexpr uint32_t deltaInterval() const { return readUInt32LE(5); }
+  constexpr bool notificationEnabled() const { return readUInt8(9) != 0; }
+};
+
+// PORT_VALUE_COMBINEDMODE: port, dataset pointer, values of the contained datasets
+class CombinedValueMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr CombinedValueMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr byte portNumber() const { return readUInt8(3); }
+  constexpr uint16_t datasetPointer() const { return readUInt16LE(4); }
+  // offset of the first value
+  constexpr size_t valueOffset() const { return 6; }
+};
+
+// PORT_INFORMATION: port, information type, mode info (capabilities, mode count, input and output modes)
+class PortInformationMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr PortInformationMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr byte portNumber() const { return readUInt8(3); }
+  constexpr byte informationType() const { return readUInt8(4); }
+  constexpr byte capabilities() const { return readUInt8(5); }
+  constexpr byte modeCount() const { return readUInt8(6); }
+  constexpr uint16_t inputModes() const { return readUInt16LE(7); }
+  constexpr uint16_t outputModes() const { return readUInt16LE(9); }
+};
+
+// PORT_MODE_INFORMATION: port, mode, information type, range (min/max float) or value format
+class PortModeInformationMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr PortModeInformationMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr byte portNumber() const { return readUInt8(3); }
+  constexpr byte mode() const { return readUInt8(4); }
+  constexpr byte informationType() const { return readUInt8(5); }
+  float rangeMin() const { return readFloatLE(6); }
+  float rangeMax() const { return readFloatLE(10); }
+  constexpr byte datasets() const { return readUInt8(6); }
+  constexpr byte datasetType() const { return readUInt8(7); }
+  constexpr byte figures() const { return readUInt8(8); }
+  constexpr byte decimals() const { return readUInt8(9); }
+
+private:
+  float readFloatLE(size_t offset) const
+  {
+    uint32_t bits = readUInt32LE(offset);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+};
+
+// PORT_OUTPUT_COMMAND_FEEDBACK: list of port/feedback pairs
+class CommandFeedbackMessageView : public Lpf2HubMessageView
+{
+public:
+  constexpr CommandFeedbackMessageView(const uint8_t *pData, size_t length = 0) : Lpf2HubMessageView(pData, length) {}
+
+  constexpr size_t numberOfPorts() const { return length() > 3 ? (length() - 3) / 2 : 0; }
+  constexpr byte portNumber(size_t index) const { return readUInt8(3 + 2 * index); }
+  constexpr byte feedback(size_t index) const { return readUInt8(4 + 2 * index); }
+};
+
+#endif // Lpf2HubMessage_h
+
+#endif // ESP32 || LEGOINO_NATIVE